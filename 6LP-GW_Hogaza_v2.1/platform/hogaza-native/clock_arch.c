@@ -0,0 +1,86 @@
+/**
+ * \file		clock_arch.c
+ *
+ * \brief		Clock of the native (host) build of the 6LP-GW.
+ */
+
+#include <time.h>
+#include "clock_arch.h"
+
+/*---------------------------------------------------------------------------*/
+static struct timespec start;
+static u8_t virtual_clock;
+static clock_time_t virtual_ticks;
+/*---------------------------------------------------------------------------*/
+void
+clock_init(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	virtual_ticks = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_set_virtual(u8_t on)
+{
+	virtual_clock = on;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+clock_is_virtual(void)
+{
+	return virtual_clock;
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_advance(clock_time_t t)
+{
+	if ((s32_t)(t - virtual_ticks) > 0) {
+		virtual_ticks = t;
+	}
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+	struct timespec now;
+	
+	if (virtual_clock) {
+		return virtual_ticks;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (clock_time_t)((now.tv_sec - start.tv_sec) * CLOCK_CONF_SECOND +
+			(now.tv_nsec - start.tv_nsec) / (1000000000L / CLOCK_CONF_SECOND));
+}
+/*---------------------------------------------------------------------------*/
+u32_t
+clock_seconds(void)
+{
+	return clock_time() / CLOCK_CONF_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_delay(unsigned int i)
+{
+}
+/*---------------------------------------------------------------------------*/
+int
+clock_fine_max(void)
+{
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+clock_fine(void)
+{
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
+u32_t
+clock_cycles(void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (u32_t)((u32_t)now.tv_sec * 1000000000UL + (u32_t)now.tv_nsec);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,38 @@
+/**
+ * \file		clock_arch.h
+ *
+ * \brief		Clock of the native (host) build of the 6LP-GW. 
+ *
+ * 					The clock either follows the host monotonic clock or, when 
+ * 					replaying capture files, is a virtual clock which the main loop
+ * 					moves forward to the next event. Virtual time makes runs 
+ * 					reproducible and as fast as the host allows.
+ */
+
+#ifndef __CLOCK_ARCH_H__
+#define __CLOCK_ARCH_H__
+
+#include "contiki.h"
+
+/**
+ * A second, measured in system clock time.
+ */
+#define CLOCK_CONF_SECOND 1000
+
+/* Switches between the host clock (0) and the virtual clock (1) */
+void clock_set_virtual(u8_t on);
+u8_t clock_is_virtual(void);
+
+/* Moves the virtual clock forward to t (it never goes back) */
+void clock_advance(clock_time_t t);
+
+/**
+ * Frequency of clock_cycles(). On the host there is no portable cycle 
+ * counter, so it counts nanoseconds of the host monotonic clock (also in 
+ * virtual time).
+ */
+#define CLOCK_CYCLES_HZ 1000000000UL
+
+u32_t clock_cycles(void);
+
+#endif /* __CLOCK_ARCH_H__ */
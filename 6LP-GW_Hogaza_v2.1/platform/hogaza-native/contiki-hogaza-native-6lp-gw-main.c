@@ -0,0 +1,278 @@
+/**
+ * \file		contiki-hogaza-native-6lp-gw-main.c
+ *
+ * \brief		Main file of the native (host) build of the 6LP-GW.
+ *
+ * 					The native build runs the 6LP-GW of the hogaza platform on a 
+ * 					Linux host, so that forwarding and compression can be measured
+ * 					and replayed without the board. This directory only replaces 
+ * 					contiki-conf.h, the clock, the random generator and the 
+ * 					Ethernet and radio drivers; it is put before platform/hogaza in
+ * 					the include path and built with:
+ * 					- platform/hogaza-native: *.c, dev/ *.c, utils/ *.c
+ * 					- platform/hogaza: net/ (all of it), utils/ringbuf.c
+ * 					- apps/dhcpc and the Contiki core
+ * 					by the Makefile of this directory: make CONTIKI=<Contiki tree>.
+ *
+ * 					Host tests and benchmarks of single modules are in tests/. Each
+ * 					is built the same way, with its own file instead of this one
+ * 					(make tests, or make check to also run them).
+ *
+ * 					Links are given on the command line:
+ * 					  -e file   Ethernet input capture (DLT_EN10MB)
+ * 					  -E file   Ethernet output capture
+ * 					  -t name   Ethernet TAP device (instead of -e/-E)
+ * 					  -r file   802.15.4 input capture (DLT_IEEE802_15_4[_NOFCS])
+ * 					  -R file   802.15.4 output capture (DLT_IEEE802_15_4_NOFCS)
+ * 					  -m a:b:c  Last three bytes of the gateway MAC address
+ * 					  -d secs   Time run after the last input frame (default 5)
+ * 					  -b n:r    Run the ND benchmark (see pgw_bench.c) with n 6LNs
+ * 					            and r rounds, print its CSV results and exit
+ *
+ * 					Without a TAP device the gateway runs in virtual time: input
+ * 					frames are delivered at their capture timestamps, the clock 
+ * 					jumps to the next frame or timer when the gateway is idle, and
+ * 					the program ends once the input captures are exhausted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "contiki.h"
+#include "sys/process.h"
+#include "sys/etimer.h"
+#include "contiki-net.h"
+#include "clock_arch.h"
+#include "dev/native_link.h"
+#include "dev/eth_driver.h"
+#include "dev/radio_driver.h"
+#include "net/pgw_netstack.h"
+#include "net/p-gw/pgw.h"
+#include "net/p-gw/pgw_bench.h"
+#include "net/p-gw/pgw_nd.h"
+#include "net/uipv4/uipv4.h"
+#include "dhcpc/dhcp-client.h"
+
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-e eth.pcap] [-E eth-out.pcap] [-t tap] "
+			"[-r radio.pcap] [-R radio-out.pcap] [-m a:b:c] [-d secs] "
+			"[-b nodes:rounds]\n", name);
+	exit(1);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Polls the driver processes if their next input frame is due.
+ */
+static void
+poll_links(void)
+{
+	clock_time_t t;
+	native_link_t *link;
+	
+	link = eth_driver_native_input();
+	if (link != NULL && (link->fd >= 0 || 
+			(native_link_next_time(link, &t) && (s32_t)(clock_time() - t) >= 0))) {
+		process_poll(&eth_driver_process);
+	}
+	link = radio_driver_native_input();
+	if ((link != NULL && native_link_next_time(link, &t) && 
+			(s32_t)(clock_time() - t) >= 0) ||
+			(radio_driver_native_tx_time(&t) && (s32_t)(clock_time() - t) >= 0)) {
+		process_poll(&radio_driver_process);
+	}
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Stores in t the time of the next event (input frame, end of a radio 
+ * transmission or timer). Returns 0 if there is none.
+ */
+static u8_t
+next_event(clock_time_t *t)
+{
+	clock_time_t f;
+	u8_t found = 0;
+	
+	if (etimer_pending()) {
+		*t = etimer_next_expiration_time();
+		found = 1;
+	}
+	if (eth_driver_native_input() != NULL &&
+			native_link_next_time(eth_driver_native_input(), &f) &&
+			(!found || (s32_t)(f - *t) < 0)) {
+		*t = f;
+		found = 1;
+	}
+	if (radio_driver_native_input() != NULL &&
+			native_link_next_time(radio_driver_native_input(), &f) &&
+			(!found || (s32_t)(f - *t) < 0)) {
+		*t = f;
+		found = 1;
+	}
+	if (radio_driver_native_tx_time(&f) && (!found || (s32_t)(f - *t) < 0)) {
+		*t = f;
+		found = 1;
+	}
+	return found;
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+inputs_exhausted(void)
+{
+	clock_time_t t;
+	
+	return (eth_driver_native_input() == NULL || 
+					!native_link_next_time(eth_driver_native_input(), &t)) &&
+				 (radio_driver_native_input() == NULL ||
+					!native_link_next_time(radio_driver_native_input(), &t));
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_link(const char *name, native_link_t *link)
+{
+	if (link != NULL) {
+		fprintf(stderr, "%-10s %8lu frames %10lu bytes\n", name, 
+				(unsigned long)link->frames, (unsigned long)link->bytes);
+	}
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+	const char *eth_in = NULL, *eth_out = NULL, *tap = NULL;
+	const char *radio_in = NULL, *radio_out = NULL;
+	unsigned int mac[3] = { 0x00, 0x00, 0x01 };
+	clock_time_t drain = 5 * CLOCK_SECOND;
+	clock_time_t t, end = 0;
+	u8_t draining = 0;
+	unsigned int bench_nodes = 0, bench_rounds = PGW_BENCH_ROUNDS;
+	struct timeval tv;
+	fd_set fds;
+	int c;
+	
+	while ((c = getopt(argc, argv, "e:E:t:r:R:m:d:b:")) != -1) {
+		switch (c) {
+		case 'e': eth_in = optarg; break;
+		case 'E': eth_out = optarg; break;
+		case 't': tap = optarg; break;
+		case 'r': radio_in = optarg; break;
+		case 'R': radio_out = optarg; break;
+		case 'm':
+			if (sscanf(optarg, "%x:%x:%x", &mac[0], &mac[1], &mac[2]) != 3) {
+				usage(argv[0]);
+			}
+			break;
+		case 'd': drain = atoi(optarg) * CLOCK_SECOND; break;
+		case 'b':
+			if (sscanf(optarg, "%u:%u", &bench_nodes, &bench_rounds) < 1 ||
+					bench_nodes == 0) {
+				usage(argv[0]);
+			}
+			break;
+		default: usage(argv[0]);
+		}
+	}
+	
+	clock_init();
+	clock_set_virtual(tap == NULL);
+	if (!eth_driver_native_open(eth_in, eth_out, tap) ||
+			!radio_driver_native_open(radio_in, radio_out)) {
+		fprintf(stderr, "%s: cannot open links\n", argv[0]);
+		return 1;
+	}
+	
+	/* initialize uip variables */
+	memset(uip_buf, 0, UIP_CONF_BUFFER_SIZE);
+	uip_len = 0;
+	
+	/* Same address layout as on the board, with the given unique bytes */
+	rimeaddr_node_addr.u8[0] = NODE_BASE_ADDR0;
+	rimeaddr_node_addr.u8[1] = NODE_BASE_ADDR1;
+	rimeaddr_node_addr.u8[2] = NODE_BASE_ADDR2;
+	rimeaddr_node_addr.u8[3] = NODE_BASE_ADDR3;
+	rimeaddr_node_addr.u8[4] = NODE_BASE_ADDR4;
+	rimeaddr_node_addr.u8[5] = mac[0];
+	rimeaddr_node_addr.u8[6] = mac[1];
+	rimeaddr_node_addr.u8[7] = mac[2];
+	rimeaddr_copy((rimeaddr_t*)&uip_lladdr.addr, &rimeaddr_node_addr);
+	uip_ethaddr.addr[0] = NODE_BASE_ADDR0;
+	uip_ethaddr.addr[1] = NODE_BASE_ADDR1;
+	uip_ethaddr.addr[2] = NODE_BASE_ADDR2;
+	uip_ethaddr.addr[3] = mac[0];
+	uip_ethaddr.addr[4] = mac[1];
+	uip_ethaddr.addr[5] = mac[2];
+	
+	process_init();
+	process_start(&etimer_process, NULL);
+	pgw_netstack_init();
+	process_start(&dhcp_process, NULL);
+	
+	if (bench_nodes > 0) {
+		/* The benchmark never runs the radio process to empty the TX queue */
+		radio_driver_native_airtime(0);
+		pgw_bench_run(bench_nodes > 255 ? 255 : bench_nodes, bench_rounds);
+	}
+	
+	while (bench_nodes == 0) {
+		poll_links();
+		if (process_run() > 0) {
+			continue;
+		}
+		/* Idle. Wait (or, in virtual time, jump) to the next event */
+		if (clock_is_virtual()) {
+			if (inputs_exhausted()) {
+				if (!draining) {
+					draining = 1;
+					end = clock_time() + drain;
+				}
+				if (!next_event(&t) || (s32_t)(t - end) > 0) {
+					break;
+				}
+			} else if (!next_event(&t)) {
+				break;
+			}
+			clock_advance(t);
+		} else {
+			FD_ZERO(&fds);
+			FD_SET(eth_driver_native_input()->fd, &fds);
+			tv.tv_sec = 0;
+			tv.tv_usec = 1000000L / CLOCK_SECOND;
+			if (next_event(&t) && (s32_t)(t - clock_time()) > 0) {
+				tv.tv_sec = (t - clock_time()) / CLOCK_SECOND;
+				tv.tv_usec = ((t - clock_time()) % CLOCK_SECOND) * 
+						(1000000L / CLOCK_SECOND);
+			}
+			select(eth_driver_native_input()->fd + 1, &fds, NULL, NULL, &tv);
+		}
+		if (etimer_pending()) {
+			etimer_request_poll();
+		}
+	}
+	
+	print_link("eth in", eth_driver_native_input());
+	print_link("eth out", eth_driver_native_output());
+	print_link("radio in", radio_driver_native_input());
+	print_link("radio out", radio_driver_native_output());
+#if PGW_STATISTICS
+	/* Frames received from each 6LN (captures carry no RSSI nor LQI) */
+	pgw_nbr_link_print();
+	/* Registration latency */
+	pgw_dad_print();
+	/* Radio TX queue, Ethernet egress and packet buffers */
+	pgw_txq_print("radio", &radio_tx_queue.stats);
+	pgw_txq_print("eth", &eth_tx_stats);
+	pgw_pbuf_print();
+#endif /* PGW_STATISTICS */
+	native_link_close(eth_driver_native_input());
+	if (eth_driver_native_output() != eth_driver_native_input()) {
+		native_link_close(eth_driver_native_output());
+	}
+	native_link_close(radio_driver_native_input());
+	native_link_close(radio_driver_native_output());
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
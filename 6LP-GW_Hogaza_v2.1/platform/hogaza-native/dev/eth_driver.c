@@ -0,0 +1,305 @@
+/*
+ * This file implements the ethernet driver of the native (host) build of the 
+ * 6LP-GW. It has the same interface as the ENC28J60 driver of the hogaza
+ * platform, but frames come from and go to a capture file or a TAP device.
+ * The ENC28J60 receive hash filter is emulated, so that the 6LP-GW sees the 
+ * same frames as on the board.
+ */
+#include <string.h>
+#include "dev/eth_driver.h"
+#include "contiki-net.h"
+#include "dev/native_link.h"
+#include "net/p-gw/pgw_fwd.h"
+
+/* The driver state */
+static eth_driver_state_t eth_state = ETH_DRIVER_OFF;
+
+static native_link_t eth_in, eth_out;
+static native_link_t *eth_input, *eth_output;
+
+/* Receive filter: hash table image, or promiscuous if filter_on is 0 */
+static unsigned char filter_table[8];
+static u8_t filter_on;
+
+/* Frame being read, see peek() */
+static u8_t *frame;
+static u16_t frame_len;
+
+static void init(void);
+static int send(const void *payload, unsigned short payload_len);
+static int sendv(const eth_segment_t *seg, unsigned char count);
+static int read(const void *payload, unsigned short payload_len);
+static int peek(const void *payload, unsigned short peek_len);
+static int read_rest(const void *payload, unsigned short peek_len, unsigned short payload_len);
+static void drop(void);
+static void filter_add(unsigned char *table, const void *addr);
+static void set_filter(const unsigned char *table);
+static int pending_packet(void);
+static void on(void);
+static void off(void);
+
+/*---------------------------------------------------------------------------*/
+PROCESS(eth_driver_process, "eth_driver_process");
+/*---------------------------------------------------------------------------*/
+/*
+ * Same as the hogaza poll handler, except that the process is only polled 
+ * again while frames are due, so that the main loop can tell when the 
+ * gateway is idle. The main loop polls it when the next frame is due.
+ */
+static void
+pollhandler(void)
+{
+	u8_t n;
+	
+	for (n = 0; n < ETH_DRIVER_RX_BATCH && pending_packet(); n++) {
+		/* Set current incoming interface */
+		incoming_if = IEEE_802_3;
+		/* Read the headers */
+		if (peek(uip_buf, ETH_DRIVER_PEEK_LEN) < ETH_DRIVER_PEEK_LEN ||
+				NETSTACK_MAC_ETH.filter()) {
+			/* Runt or unwanted frame */
+			drop();
+		} else {
+			/* Read the rest of the packet */
+			uip_len = read_rest(uip_buf, ETH_DRIVER_PEEK_LEN, UIP_BUFSIZE);
+			/* Forward the packet to the upper level in the stack */
+			NETSTACK_MAC_ETH.input();
+		}
+	}
+	PGW_STAT(pgw_fwd_rx_batch(&eth_rx_stats, n, ETH_DRIVER_RX_BATCH));
+	if (n > 0) {
+		process_poll(&eth_driver_process);
+	}
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(eth_driver_process, ev, data)
+{
+	PROCESS_POLLHANDLER(pollhandler());
+	
+	PROCESS_BEGIN();
+	
+	process_poll(&eth_driver_process);
+	PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_EXIT);
+	
+	PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+int
+eth_driver_native_open(const char *in, const char *out, const char *tap)
+{
+	if (tap != NULL) {
+		if (!native_link_open_tap(&eth_in, tap)) {
+			return 0;
+		}
+		eth_input = eth_output = &eth_in;
+		return 1;
+	}
+	if (in != NULL) {
+		if (!native_link_open_read(&eth_in, in) || 
+				eth_in.linktype != NATIVE_LINK_DLT_EN10MB) {
+			return 0;
+		}
+		eth_input = &eth_in;
+	}
+	if (out != NULL) {
+		if (!native_link_open_write(&eth_out, out, NATIVE_LINK_DLT_EN10MB)) {
+			return 0;
+		}
+		eth_output = &eth_out;
+	}
+	return 1;
+}
+
+native_link_t *
+eth_driver_native_input(void)
+{
+	return eth_input;
+}
+
+native_link_t *
+eth_driver_native_output(void)
+{
+	return eth_output;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Same hash as the ENC28J60: bits 28:23 of the CRC-32 of the destination
+ * address.
+ */
+static u8_t
+hash_index(const u8_t *addr)
+{
+	u32_t crc = 0xFFFFFFFF;
+	u8_t i, j, b;
+	
+	for (i = 0; i < 6; i++) {
+		b = addr[i];
+		for (j = 0; j < 8; j++) {
+			if (((crc >> 31) ^ b) & 0x01) {
+				crc = (crc << 1) ^ 0x04C11DB7;
+			} else {
+				crc <<= 1;
+			}
+			b >>= 1;
+		}
+	}
+	return (crc >> 23) & 0x3F;
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+filter_accepts(const u8_t *f)
+{
+	static const u8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	u8_t i;
+	
+	if (!filter_on || memcmp(f, broadcast, 6) == 0) {
+		return 1;
+	}
+	i = hash_index(f);
+	return filter_table[i >> 3] & (1 << (i & 0x07));
+}
+/*---------------------------------------------------------------------------*/
+static void 
+init()
+{
+	on();
+	process_start(&eth_driver_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static int
+send(const void *payload, unsigned short payload_len)
+{
+	if (eth_state == ETH_DRIVER_ON && eth_output != NULL) {
+		native_link_write(eth_output, payload, payload_len);
+		return 1;
+	}
+	return 0;
+}
+
+/* Captures and TAP devices take whole frames, so the segments are gathered */
+static int
+sendv(const eth_segment_t *seg, unsigned char count)
+{
+	u8_t buf[UIP_BUFSIZE];
+	u16_t len = 0;
+	unsigned char i;
+	
+	for (i = 0; i < count; i++) {
+		if (len + seg[i].len > sizeof(buf)) {
+			return 0;
+		}
+		memcpy(&buf[len], seg[i].data, seg[i].len);
+		len += seg[i].len;
+	}
+	return send(buf, len);
+}
+
+static int
+read(const void *payload, unsigned short payload_len)
+{
+	if (!peek(payload, 0)) {
+		return 0;
+	}
+	return read_rest(payload, 0, payload_len);
+}
+
+static int
+peek(const void *payload, unsigned short peek_len)
+{
+	if (frame == NULL) {
+		return 0;
+	}
+	memcpy((u8_t *)payload, frame, peek_len < frame_len ? peek_len : frame_len);
+	return frame_len;
+}
+
+static int
+read_rest(const void *payload, unsigned short peek_len, unsigned short payload_len)
+{
+	u16_t len = frame_len < payload_len ? frame_len : payload_len;
+	
+	if (len > peek_len) {
+		memcpy((u8_t *)payload + peek_len, frame + peek_len, len - peek_len);
+	}
+	drop();
+	return len;
+}
+
+static void
+drop()
+{
+	frame = NULL;
+	native_link_release(eth_input);
+}
+
+static void
+filter_add(unsigned char *table, const void *addr)
+{
+	u8_t i = hash_index(addr);
+	
+	table[i >> 3] |= 1 << (i & 0x07);
+}
+
+static void
+set_filter(const unsigned char *table)
+{
+	if (table == NULL) {
+		filter_on = 0;
+	} else {
+		memcpy(filter_table, table, sizeof(filter_table));
+		filter_on = 1;
+	}
+}
+
+/*
+ * Loads the next due frame, if any, dropping those the emulated receive 
+ * filter rejects.
+ */
+static int
+pending_packet()
+{
+	if (eth_state != ETH_DRIVER_ON || eth_input == NULL) {
+		return 0;
+	}
+	while (frame == NULL) {
+		frame = native_link_next(eth_input, &frame_len);
+		if (frame == NULL) {
+			return 0;
+		}
+		if (frame_len < 6 || !filter_accepts(frame)) {
+			drop();
+		}
+	}
+	return 1;
+}
+
+static void
+on()
+{
+	eth_state = ETH_DRIVER_ON;
+}
+
+static void
+off()
+{
+	eth_state = ETH_DRIVER_OFF;
+}
+
+
+const eth_driver_t eth_driver =
+  {
+  	init,
+  	send,
+  	sendv,
+  	read,
+  	peek,
+  	read_rest,
+  	drop,
+  	filter_add,
+  	set_filter,
+  	pending_packet,
+  	on,
+  	off
+  };
+
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,247 @@
+/**
+ * \file		native_link.c
+ *
+ * \brief		Capture files and TAP devices backing the Ethernet and 802.15.4
+ * 					links of the native (host) build of the 6LP-GW.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include "dev/native_link.h"
+
+#define PCAP_MAGIC				0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED		0xd4c3b2a1
+
+struct pcap_file_hdr {
+	u32_t magic;
+	u16_t version_major;
+	u16_t version_minor;
+	s32_t thiszone;
+	u32_t sigfigs;
+	u32_t snaplen;
+	u32_t linktype;
+};
+
+struct pcap_rec_hdr {
+	u32_t ts_sec;
+	u32_t ts_usec;
+	u32_t incl_len;
+	u32_t orig_len;
+};
+
+/*---------------------------------------------------------------------------*/
+static u32_t
+swap32(native_link_t *link, u32_t x)
+{
+	if (!link->swapped) {
+		return x;
+	}
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_init(native_link_t *link)
+{
+	memset(link, 0, sizeof(native_link_t));
+	link->fd = -1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the next record of the input capture file ahead.
+ */
+static void
+read_ahead(native_link_t *link)
+{
+	struct pcap_rec_hdr rec;
+	u32_t sec, usec, len;
+	
+	if (link->pending || link->eof || link->file == NULL) {
+		return;
+	}
+	if (fread(&rec, sizeof(rec), 1, link->file) != 1) {
+		link->eof = 1;
+		return;
+	}
+	sec = swap32(link, rec.ts_sec);
+	usec = swap32(link, rec.ts_usec);
+	len = swap32(link, rec.incl_len);
+	if (len > NATIVE_LINK_MAX_FRAME || 
+			fread(link->frame, 1, len, link->file) != len) {
+		link->eof = 1;
+		return;
+	}
+	if (!link->started) {
+		link->started = 1;
+		link->sec0 = sec;
+		link->usec0 = usec;
+	}
+	link->time = (clock_time_t)((sec - link->sec0) * CLOCK_SECOND +
+			((s32_t)usec - (s32_t)link->usec0) / (1000000L / CLOCK_SECOND));
+	link->len = len;
+	link->pending = 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+native_link_open_read(native_link_t *link, const char *path)
+{
+	struct pcap_file_hdr hdr;
+	
+	link_init(link);
+	link->file = fopen(path, "rb");
+	if (link->file == NULL) {
+		return 0;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, link->file) != 1 ||
+			(hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_SWAPPED)) {
+		fclose(link->file);
+		link->file = NULL;
+		return 0;
+	}
+	link->swapped = (hdr.magic == PCAP_MAGIC_SWAPPED);
+	link->linktype = swap32(link, hdr.linktype);
+	read_ahead(link);
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+native_link_open_write(native_link_t *link, const char *path, u32_t linktype)
+{
+	struct pcap_file_hdr hdr;
+	
+	link_init(link);
+	link->file = fopen(path, "wb");
+	if (link->file == NULL) {
+		return 0;
+	}
+	hdr.magic = PCAP_MAGIC;
+	hdr.version_major = 2;
+	hdr.version_minor = 4;
+	hdr.thiszone = 0;
+	hdr.sigfigs = 0;
+	hdr.snaplen = NATIVE_LINK_MAX_FRAME;
+	hdr.linktype = linktype;
+	link->linktype = linktype;
+	fwrite(&hdr, sizeof(hdr), 1, link->file);
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+native_link_open_tap(native_link_t *link, const char *name)
+{
+	struct ifreq ifr;
+	
+	link_init(link);
+	link->fd = open("/dev/net/tun", O_RDWR);
+	if (link->fd < 0) {
+		return 0;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+	if (ioctl(link->fd, TUNSETIFF, &ifr) < 0) {
+		close(link->fd);
+		link->fd = -1;
+		return 0;
+	}
+	fcntl(link->fd, F_SETFL, O_NONBLOCK);
+	link->linktype = NATIVE_LINK_DLT_EN10MB;
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+native_link_close(native_link_t *link)
+{
+	if (link == NULL) {
+		return;
+	}
+	if (link->file != NULL) {
+		fclose(link->file);
+		link->file = NULL;
+	}
+	if (link->fd >= 0) {
+		close(link->fd);
+		link->fd = -1;
+	}
+}
+/*---------------------------------------------------------------------------*/
+u8_t *
+native_link_next(native_link_t *link, u16_t *len)
+{
+	ssize_t n;
+	
+	if (link->fd >= 0) {
+		if (!link->pending) {
+			n = read(link->fd, link->frame, sizeof(link->frame));
+			if (n <= 0) {
+				return NULL;
+			}
+			link->len = n;
+			link->pending = 1;
+		}
+	} else {
+		read_ahead(link);
+		if (!link->pending || (s32_t)(clock_time() - link->time) < 0) {
+			return NULL;
+		}
+	}
+	*len = link->len;
+	return link->frame;
+}
+/*---------------------------------------------------------------------------*/
+void
+native_link_release(native_link_t *link)
+{
+	if (link->pending) {
+		link->pending = 0;
+		link->frames++;
+		link->bytes += link->len;
+	}
+	read_ahead(link);
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+native_link_next_time(native_link_t *link, clock_time_t *t)
+{
+	if (link->fd >= 0 || link->file == NULL) {
+		return 0;
+	}
+	read_ahead(link);
+	if (!link->pending) {
+		return 0;
+	}
+	*t = link->time;
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+native_link_write(native_link_t *link, const u8_t *frame, u16_t len)
+{
+	struct pcap_rec_hdr rec;
+	clock_time_t now;
+	
+	link->frames++;
+	link->bytes += len;
+	if (link->fd >= 0) {
+		if (write(link->fd, frame, len) < 0) {
+			perror("tap write");
+		}
+		return;
+	}
+	if (link->file == NULL) {
+		return;
+	}
+	now = clock_time();
+	rec.ts_sec = now / CLOCK_SECOND;
+	rec.ts_usec = (now % CLOCK_SECOND) * (1000000L / CLOCK_SECOND);
+	rec.incl_len = len;
+	rec.orig_len = len;
+	fwrite(&rec, sizeof(rec), 1, link->file);
+	fwrite(frame, 1, len, link->file);
+}
+/*---------------------------------------------------------------------------*/
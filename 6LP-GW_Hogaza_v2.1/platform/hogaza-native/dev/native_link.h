@@ -0,0 +1,81 @@
+/**
+ * \file		native_link.h
+ *
+ * \brief		Capture files and TAP devices backing the Ethernet and 802.15.4
+ * 					links of the native (host) build of the 6LP-GW.
+ *
+ * 					Input capture files are replayed according to their timestamps 
+ * 					(relative to the first frame), output capture files are stamped
+ * 					with the clock, so that replays in virtual time are reproducible.
+ */
+
+#ifndef NATIVE_LINK_H_
+#define NATIVE_LINK_H_
+
+#include <stdio.h>
+#include "contiki.h"
+
+/* Link types */
+#define NATIVE_LINK_DLT_EN10MB								1
+#define NATIVE_LINK_DLT_IEEE802_15_4					195	/* With FCS */
+#define NATIVE_LINK_DLT_IEEE802_15_4_NOFCS		230
+
+#define NATIVE_LINK_MAX_FRAME	1600
+
+/* A link: a capture file to read from or write to, or a TAP device */
+typedef struct {
+	FILE *file;
+	int fd;
+	u32_t linktype;
+	u8_t swapped;
+	u8_t eof;
+	/* Frame read ahead from the input capture file */
+	u8_t pending;
+	u16_t len;
+	clock_time_t time;
+	u8_t frame[NATIVE_LINK_MAX_FRAME];
+	/* Timestamp of the first frame, to which frame times are relative */
+	u8_t started;
+	u32_t sec0, usec0;
+	/* Frame counters */
+	u32_t frames;
+	u32_t bytes;
+} native_link_t;
+
+int native_link_open_read(native_link_t *link, const char *path);
+int native_link_open_write(native_link_t *link, const char *path, u32_t linktype);
+int native_link_open_tap(native_link_t *link, const char *name);
+void native_link_close(native_link_t *link);
+
+/* 
+ * Returns the next input frame if it is due (or, for a TAP device, if one 
+ * has been received), NULL otherwise. The frame must be released with 
+ * native_link_release().
+ */
+u8_t *native_link_next(native_link_t *link, u16_t *len);
+void native_link_release(native_link_t *link);
+
+/* 
+ * Stores in t the time at which the next input frame is due. Returns 0 if
+ * there is none (end of capture file, or TAP device).
+ */
+u8_t native_link_next_time(native_link_t *link, clock_time_t *t);
+
+void native_link_write(native_link_t *link, const u8_t *frame, u16_t len);
+
+/* Entry points used by the main loop to plug and schedule the drivers */
+int eth_driver_native_open(const char *in, const char *out, const char *tap);
+int radio_driver_native_open(const char *in, const char *out);
+native_link_t *eth_driver_native_input(void);
+native_link_t *eth_driver_native_output(void);
+native_link_t *radio_driver_native_input(void);
+native_link_t *radio_driver_native_output(void);
+/* 
+ * Stores in t the time at which the frame on air is done. Returns 0 if the
+ * radio is not transmitting.
+ */
+u8_t radio_driver_native_tx_time(clock_time_t *t);
+/* Whether frames take their time on air (1, the default) or none */
+void radio_driver_native_airtime(u8_t on);
+
+#endif /*NATIVE_LINK_H_*/
@@ -0,0 +1,288 @@
+/*
+ * This file implements the radio driver of the native (host) build of the 
+ * 6LP-GW. It has the same interface as the CC2520 driver of the hogaza 
+ * platform, but frames come from and go to IEEE 802.15.4 capture files 
+ * (DLT_IEEE802_15_4 or DLT_IEEE802_15_4_NOFCS). Transmissions always succeed
+ * and take the time the frame would be on air at 250 kb/s, so that the TX 
+ * queue behaves as on the board. The frame is written to the output capture
+ * when its transmission starts. Captures carry no acknowledgments, so frames
+ * that request one are taken as acknowledged the first time.
+ */
+#include <string.h>
+#include "dev/radio_driver.h"
+#include "contiki-net.h"
+#include "dev/native_link.h"
+#include "net/p-gw/pgw_fwd.h"
+
+/* Maximum 802.15.4 frame size, FCS included */
+#define MAX_802154_PACKET_SIZE 127
+
+/* Clock ticks a frame of len bytes is on air, with its 6-byte PHY header */
+#define AIRTIME(len) \
+	((((len) + 6) * 32UL * CLOCK_SECOND + 999999UL) / 1000000UL)
+
+static int init(void);
+static int send(const void *payload, unsigned short payload_len);
+static int read(void *buf, unsigned short buf_len);
+static int pending_packet(void);
+static int on(void);
+static int off(void);
+
+/* The driver state */
+static radio_driver_state_t radio_state = OFF;
+
+static native_link_t radio_in, radio_out;
+static native_link_t *radio_input, *radio_output;
+
+/* Frames waiting for the radio, see the hogaza driver */
+pgw_txq_t radio_tx_queue;
+
+/* The frame on air, until tx_end. Frames take no time if tx_airtime is 0 */
+static pgw_pbuf_t tx_frame = PGW_PBUF_NONE;
+static clock_time_t tx_end;
+static u8_t tx_airtime = 1;
+/*---------------------------------------------------------------------------*/
+/*
+ * Completes the frame on air once its time is over and starts the next ones.
+ */
+static void
+tx_step(void)
+{
+	mac_callback_t sent;
+	void *ptr;
+	
+	for (;;) {
+		if (tx_frame != PGW_PBUF_NONE) {
+			if ((s32_t)(clock_time() - tx_end) < 0) {
+				return;
+			}
+			sent = pgw_txq_frame(tx_frame)->sent;
+			ptr = pgw_txq_frame(tx_frame)->ptr;
+			pgw_pbuf_unref(tx_frame);
+			tx_frame = PGW_PBUF_NONE;
+			if (sent) {
+				sent(ptr, MAC_TX_OK, 1);
+			}
+		}
+		if ((tx_frame = pgw_txq_pop(&radio_tx_queue)) == PGW_PBUF_NONE) {
+			return;
+		}
+		if (radio_output != NULL) {
+			native_link_write(radio_output, pgw_pbuf_data(tx_frame), 
+												pgw_pbuf_len(tx_frame));
+		}
+		tx_end = clock_time() + (tx_airtime ? AIRTIME(pgw_pbuf_len(tx_frame)) : 0);
+	}
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(radio_driver_process, "radio_driver_process");
+/*---------------------------------------------------------------------------*/
+/*
+ * Same as the hogaza poll handler, except that the process is only polled
+ * again while frames are due (see eth_driver.c). The main loop also polls it
+ * when the frame on air is done.
+ */
+static void
+pollhandler(void)
+{
+	u8_t n;
+	
+	tx_step();
+	
+	for (n = 0; n < RADIO_RX_BATCH && pending_packet(); n++) {
+		
+		incoming_if = IEEE_802_15_4;
+	
+		packetbuf_clear();
+		packetbuf_set_datalen(read(packetbuf_dataptr(), PACKETBUF_SIZE));
+		/* Forward the packet to the upper level in the stack */
+		NESTACK_MAC_RADIO.input();
+	}
+	PGW_STAT(pgw_fwd_rx_batch(&radio_rx_stats, n, RADIO_RX_BATCH));
+	if (n > 0) {
+		process_poll(&radio_driver_process);
+	}
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(radio_driver_process, ev, data)
+{
+	PROCESS_POLLHANDLER(pollhandler());
+	
+	PROCESS_BEGIN();
+	
+	process_poll(&radio_driver_process);
+	PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_EXIT);
+	
+	PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+int
+radio_driver_native_open(const char *in, const char *out)
+{
+	if (in != NULL) {
+		if (!native_link_open_read(&radio_in, in) || 
+				(radio_in.linktype != NATIVE_LINK_DLT_IEEE802_15_4 &&
+				 radio_in.linktype != NATIVE_LINK_DLT_IEEE802_15_4_NOFCS)) {
+			return 0;
+		}
+		radio_input = &radio_in;
+	}
+	if (out != NULL) {
+		if (!native_link_open_write(&radio_out, out, 
+																NATIVE_LINK_DLT_IEEE802_15_4_NOFCS)) {
+			return 0;
+		}
+		radio_output = &radio_out;
+	}
+	return 1;
+}
+
+native_link_t *
+radio_driver_native_input(void)
+{
+	return radio_input;
+}
+
+native_link_t *
+radio_driver_native_output(void)
+{
+	return radio_output;
+}
+
+u8_t
+radio_driver_native_tx_time(clock_time_t *t)
+{
+	if (tx_frame == PGW_PBUF_NONE) {
+		return 0;
+	}
+	*t = tx_end;
+	return 1;
+}
+
+void
+radio_driver_native_airtime(u8_t on)
+{
+	tx_airtime = on;
+}
+/*---------------------------------------------------------------------------*/
+int
+radio_driver_send_async(const void *payload, unsigned short payload_len,
+                        u8_t transmissions, mac_callback_t sent, void *ptr)
+{
+	pgw_pbuf_t frame;
+	
+	if (radio_state != ON || payload_len > MAX_802154_PACKET_SIZE ||
+			(frame = pgw_txq_alloc(&radio_tx_queue, pgw_txq_class, 
+														 payload_len)) == PGW_PBUF_NONE) {
+		return RADIO_TX_ERR;
+	}
+	memcpy(pgw_pbuf_data(frame), payload, payload_len);
+	pgw_txq_frame(frame)->sent = sent;
+	pgw_txq_frame(frame)->ptr = ptr;
+	pgw_txq_frame(frame)->transmissions = transmissions;
+	pgw_txq_push(&radio_tx_queue, frame, pgw_txq_class);
+	tx_step();
+	return RADIO_TX_OK;
+}
+
+u8_t
+radio_driver_tx_room(void)
+{
+	return pgw_txq_room(&radio_tx_queue, pgw_txq_class);
+}
+/*---------------------------------------------------------------------------*/
+static int 
+init()
+{
+	pgw_txq_init(&radio_tx_queue, RADIO_TX_QUEUE_LEN);
+	on();
+	process_start(&radio_driver_process, NULL);
+	return 1;
+}
+
+static int
+send(const void *payload, unsigned short payload_len)
+{
+	return radio_driver_send_async(payload, payload_len, 1, NULL, NULL);
+}
+
+static int 
+read(void *buf, unsigned short buf_len) 
+{
+	u8_t *frame;
+	u16_t len;
+	
+	if (radio_state != ON || radio_input == NULL ||
+			(frame = native_link_next(radio_input, &len)) == NULL) {
+		return 0;
+	}
+	if (radio_input->linktype == NATIVE_LINK_DLT_IEEE802_15_4) {
+		/* substract CRC length */
+		len = len < 2 ? 0 : len - 2;
+	}
+	if (len > buf_len) {
+		len = buf_len;
+	}
+	memcpy(buf, frame, len);
+	native_link_release(radio_input);
+	return len;
+}
+
+static int
+pending_packet()
+{
+	u16_t len;
+	
+	if (radio_state != ON || radio_input == NULL) {
+		return 0;
+	}
+	return native_link_next(radio_input, &len) != NULL;
+}
+
+static int
+on()
+{
+	radio_state = ON;
+	return 1;
+}
+
+static int
+off()
+{
+	radio_state = OFF;
+	return 1;
+}
+
+/* These functions are not used; They are defined only for compliance with 
+ * struct radio_driver defined in radio.h*/
+static int 
+prepare(const void *payload, unsigned short payload_len)
+{return 1;}
+
+static int
+transmit(unsigned short transmit_len)
+{return 1;}
+
+static int
+channel_clear(void)
+{return 1;}
+
+static int
+receiving_packet(void)
+{return 0;}
+
+const struct radio_driver radio_driver =
+  {
+  	init,
+  	prepare,
+  	transmit,
+    send,
+		read,
+		channel_clear,
+		receiving_packet,
+		pending_packet,
+		on,
+		off
+  };
+
+/*---------------------------------------------------------------------------*/
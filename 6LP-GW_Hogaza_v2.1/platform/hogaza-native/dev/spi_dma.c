@@ -0,0 +1,154 @@
+/*
+ * This file implements the SPI DMA layer of the native (host) build of the
+ * 6LP-GW, as a mock of platform/hogaza/dev/spi_dma.c. Nothing is sent: the
+ * bytes are counted per bus as on the board (transfers shorter than 
+ * SPI_DMA_MIN_LEN by the CPU, the rest by DMA) and the chip answers with the
+ * bytes set by spi_mock_reply(). Along with msp430/msp430f5435a.h, it lets
+ * the ENC28J60 and CC2520 drivers run on the host.
+ *
+ * Asynchronous transfers complete at once: the callback is run before
+ * spi_dma_transfer_async() returns, and spi_dma_wait() never sleeps.
+ */
+#include "dev/spi_dma.h"
+#include "dev/spi_mock.h"
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+/* What the chip on each bus answers with */
+static struct {
+	const u8_t *buf;
+	u16_t len;
+} reply[SPI_BUSES];
+
+/* USCI flags and transmit buffers, see msp430f5435a.h */
+static volatile unsigned char ifg[SPI_BUSES];
+static volatile unsigned char txbuf[SPI_BUSES];
+
+#if SPI_DMA_STATISTICS
+spi_dma_stats_t spi_dma_stats[SPI_BUSES];
+#define SPI_DMA_STAT(s) s
+#else
+#define SPI_DMA_STAT(s)
+#endif /* SPI_DMA_STATISTICS */
+
+/*---------------------------------------------------------------------------*/
+static u8_t
+reply_byte(spi_bus_t bus)
+{
+	if (reply[bus].len == 0) {
+		return 0;
+	}
+	reply[bus].len--;
+	return *reply[bus].buf++;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Clocks len bytes in, into rx unless it is NULL.
+ */
+static void
+clock_in(spi_bus_t bus, u8_t *rx, u16_t len)
+{
+	while (len--) {
+		if (rx != NULL) {
+			*rx++ = reply_byte(bus);
+		} else {
+			reply_byte(bus);
+		}
+	}
+}
+/*---------------------------------------------------------------------------*/
+static void
+transfer(spi_bus_t bus, u8_t *rx, u16_t len)
+{
+	if (len < SPI_DMA_MIN_LEN) {
+		SPI_DMA_STAT(spi_dma_stats[bus].cpu_bytes += len);
+	} else {
+		SPI_DMA_STAT(spi_dma_stats[bus].dma_bytes += len);
+	}
+	clock_in(bus, rx, len);
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_mock_reply(spi_bus_t bus, const u8_t *buf, u16_t len)
+{
+	reply[bus].buf = buf;
+	reply[bus].len = len;
+}
+/*---------------------------------------------------------------------------*/
+u16_t
+spi_mock_reply_left(spi_bus_t bus)
+{
+	return reply[bus].len;
+}
+/*---------------------------------------------------------------------------*/
+volatile unsigned char *
+spi_mock_ifg(int bus)
+{
+	/* UCRXIFG | UCTXIFG: the byte is moved as soon as it is written */
+	ifg[bus] = 0x03;
+	return &ifg[bus];
+}
+/*---------------------------------------------------------------------------*/
+volatile unsigned char *
+spi_mock_txbuf(int bus)
+{
+	SPI_DMA_STAT(spi_dma_stats[bus].cpu_bytes++);
+	return &txbuf[bus];
+}
+/*---------------------------------------------------------------------------*/
+unsigned char
+spi_mock_rxbuf(int bus)
+{
+	return reply_byte(bus);
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_init(void)
+{
+	spi_bus_t bus;
+	
+	for (bus = 0; bus < SPI_BUSES; bus++) {
+		reply[bus].len = 0;
+	}
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_read(spi_bus_t bus, u8_t *buf, u16_t len)
+{
+	transfer(bus, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_write(spi_bus_t bus, const u8_t *buf, u16_t len)
+{
+	transfer(bus, NULL, len);
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+spi_dma_transfer_async(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len,
+											 spi_dma_callback_t done, void *ptr)
+{
+	if (len == 0) {
+		return 0;
+	}
+	SPI_DMA_STAT(spi_dma_stats[bus].dma_bytes += len);
+	clock_in(bus, rx, len);
+	if (done != NULL) {
+		done(ptr);
+	}
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+spi_dma_busy(void)
+{
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_wait(void)
+{
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,23 @@
+/**
+ * \file		spi_mock.h
+ *
+ * \brief		Scripting of the SPI mock of the native (host) build (see 
+ * 					dev/spi_dma.c). The bytes moved on each bus are counted in 
+ * 					spi_dma_stats, when built with SPI_DMA_CONF_STATISTICS.
+ */
+
+#ifndef SPI_MOCK_H_
+#define SPI_MOCK_H_
+
+#include "dev/spi_dma.h"
+
+/*
+ * Sets the bytes the chip on a bus answers with, one per byte clocked by the
+ * CPU or the DMA, in order. Zeroes are answered once they are exhausted.
+ */
+void spi_mock_reply(spi_bus_t bus, const u8_t *buf, u16_t len);
+
+/* Bytes of the reply not clocked out yet */
+u16_t spi_mock_reply_left(spi_bus_t bus);
+
+#endif /* SPI_MOCK_H_ */
@@ -0,0 +1,24 @@
+/**
+ * \file		intrinsics.h
+ *
+ * \brief		Host stand-in for the IAR intrinsics (see msp430f5435a.h). The
+ * 					host has no interrupts nor low power modes: they do nothing.
+ */
+
+#ifndef INTRINSICS_H_
+#define INTRINSICS_H_
+
+typedef unsigned short istate_t;
+
+#define _disable_interrupts()				do { } while (0)
+#define _enable_interrupts()				do { } while (0)
+#define __get_interrupt_state()				((istate_t)0)
+#define __set_interrupt_state(s)			((void)(s))
+#define __bis_SR_register(x)				do { } while (0)
+#define __bic_SR_register(x)				do { } while (0)
+#define __bis_SR_register_on_exit(x)		do { } while (0)
+#define __bic_SR_register_on_exit(x)		do { } while (0)
+#define __delay_cycles(x)					do { } while (0)
+#define _nop()								do { } while (0)
+
+#endif /* INTRINSICS_H_ */
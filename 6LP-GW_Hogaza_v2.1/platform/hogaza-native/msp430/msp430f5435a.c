@@ -0,0 +1,20 @@
+/*
+ * Registers and TI HAL routines of msp430f5435a.h. The SPI ones are in
+ * dev/spi_dma.c.
+ */
+#include "msp430f5435a.h"
+
+volatile unsigned char P1IN, P1OUT, P1DIR, P1SEL, P1IE, P1IES, P1IFG;
+volatile unsigned char P2IN, P2OUT, P2DIR, P2SEL, P2IE, P2IES, P2IFG;
+volatile unsigned char P3IN, P3OUT, P3DIR, P3SEL;
+volatile unsigned char P5IN, P5OUT, P5DIR, P5SEL;
+
+volatile unsigned char UCB0CTL0, UCB0CTL1, UCB0BR0, UCB0BR1;
+volatile unsigned char UCA1CTL0, UCA1CTL1, UCA1BR0, UCA1BR1;
+
+/*---------------------------------------------------------------------------*/
+void
+halMcuWaitUs(unsigned int usec)
+{
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,69 @@
+/**
+ * \file		msp430f5435a.h
+ *
+ * \brief		Host stand-in for the IAR device header, so that the ENC28J60 and
+ * 					CC2520 drivers of platform/hogaza/dev can be built natively
+ * 					(see tests/spi_bus.c).
+ *
+ * 					GPIO and USCI set-up registers are plain variables. The SPI
+ * 					data and flag registers of UCB0 (ENC28J60) and UCA1 (CC2520)
+ * 					go through the SPI mock (dev/spi_dma.c): the flags always read 
+ * 					as ready, each write to TXBUF counts one byte moved by the CPU
+ * 					and RXBUF returns the next byte the chip answers with. Only
+ * 					what the drivers use is defined.
+ */
+
+#ifndef MSP430F5435A_H_
+#define MSP430F5435A_H_
+
+#define BIT0	0x01
+#define BIT1	0x02
+#define BIT2	0x04
+#define BIT3	0x08
+#define BIT4	0x10
+#define BIT5	0x20
+#define BIT6	0x40
+#define BIT7	0x80
+
+/* From the TI HAL (hal_defs.h, hal_mcu.h) on the board */
+#define BV(n)	(1 << (n))
+void halMcuWaitUs(unsigned int usec);
+
+/* Ports */
+extern volatile unsigned char P1IN, P1OUT, P1DIR, P1SEL, P1IE, P1IES, P1IFG;
+extern volatile unsigned char P2IN, P2OUT, P2DIR, P2SEL, P2IE, P2IES, P2IFG;
+extern volatile unsigned char P3IN, P3OUT, P3DIR, P3SEL;
+extern volatile unsigned char P5IN, P5OUT, P5DIR, P5SEL;
+
+/* USCI set-up */
+extern volatile unsigned char UCB0CTL0, UCB0CTL1, UCB0BR0, UCB0BR1;
+extern volatile unsigned char UCA1CTL0, UCA1CTL1, UCA1BR0, UCA1BR1;
+
+#define UCSWRST		0x01
+#define UCSSEL_2	0x80
+#define UCSYNC		0x01
+#define UCMST		0x08
+#define UCMSB		0x20
+#define UCCKPH		0x80
+
+/* SPI data and flags, indexed by spi_bus_t */
+volatile unsigned char *spi_mock_ifg(int bus);
+volatile unsigned char *spi_mock_txbuf(int bus);
+unsigned char spi_mock_rxbuf(int bus);
+
+#define UCRXIFG		0x01
+#define UCTXIFG		0x02
+
+#define UCB0IFG		(*spi_mock_ifg(0))
+#define UCB0TXBUF	(*spi_mock_txbuf(0))
+#define UCB0RXBUF	(spi_mock_rxbuf(0))
+#define UCA1IFG		(*spi_mock_ifg(1))
+#define UCA1TXBUF	(*spi_mock_txbuf(1))
+#define UCA1RXBUF	(spi_mock_rxbuf(1))
+
+/* Status register */
+#define GIE			0x0008
+#define LPM0_bits	0x0010
+#define LPM4_bits	0x00f0
+
+#endif /* MSP430F5435A_H_ */
@@ -0,0 +1,18 @@
+/**
+ * \file		rtimer-arch.h
+ *
+ * \brief		rtimer definitions of the native (host) build of the 6LP-GW.
+ * 					rtimers are not used by the 6LP-GW; they tick with the clock.
+ */
+
+#ifndef __RTIMER_ARCH_H__
+#define __RTIMER_ARCH_H__
+
+#include "sys/rtimer.h"
+#include "sys/clock.h"
+
+#define RTIMER_ARCH_SECOND CLOCK_SECOND
+
+#define rtimer_arch_now() ((rtimer_clock_t)clock_time())
+
+#endif /* __RTIMER_ARCH_H__ */
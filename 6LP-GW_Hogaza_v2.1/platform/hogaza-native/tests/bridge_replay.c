@@ -0,0 +1,394 @@
+/**
+ * \file		bridge_replay.c
+ *
+ * \brief		Trace-replay benchmark of the bridge cache.
+ *
+ * 					Replays the source and destination MAC addresses of captured
+ * 					(or synthetic) traffic through the hashed LRU bridge cache of
+ * 					pgw_fwd.c and through the linear table with random eviction
+ * 					it replaced, and prints for both the lookups per second and
+ * 					the flood rate (unicast frames whose destination was not in
+ * 					the cache, and were therefore sent to every interface).
+ *
+ * 					The clock follows the trace timestamps, so that the new cache
+ * 					ages entries out as it does on the board. Both caches start
+ * 					empty (but for the local address) on every loop.
+ *
+ * 					Built like the native gateway (see
+ * 					contiki-hogaza-native-6lp-gw-main.c), with this file instead
+ * 					of the main file and without net/p-gw/pgw_fwd.c, which is
+ * 					included below to reach the bridge input.
+ *
+ * 					  -e file     Ethernet capture (DLT_EN10MB)
+ * 					  -r file     802.15.4 capture (DLT_IEEE802_15_4[_NOFCS])
+ * 					  -s n:f      Synthetic trace of f frames between n stations
+ * 					              (default 200:100000 without captures)
+ * 					  -l loops    Times the trace is replayed (default 10)
+ *
+ * 					Output (CSV): "bridge", the cache ("hash" or "linear"),
+ * 					frames, unicast lookups, floods, flood rate (%) and lookups/s.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "net/p-gw/pgw_fwd.c"
+#include "dev/native_link.h"
+
+/* A frame of the trace, reduced to what the bridge looks at */
+typedef struct {
+	clock_time_t time;
+	interface_t interface;
+	eui64_t src;
+	eui64_t dst;
+} trace_frame_t;
+
+static trace_frame_t *trace;
+static u32_t trace_len, trace_size;
+
+/* The linear bridge table of the baseline 6LP-GW */
+typedef struct {
+	interface_t interface;
+	eui64_t addr;
+} linear_entry_t;
+
+static struct {
+	linear_entry_t table[MAX_BRIDGE_ENTRIES];
+	u8_t elems;
+} linear_table;
+
+/*---------------------------------------------------------------------------*/
+static void
+linear_addr_add(eui64_t *addr, interface_t interface)
+{
+	int index;
+
+	if (linear_table.elems != MAX_BRIDGE_ENTRIES) {
+		index = linear_table.elems;
+		linear_table.elems++;
+	} else {
+		/* pick victim randomly */
+		index = rand() % MAX_BRIDGE_ENTRIES;
+	}
+	linear_table.table[index].interface = interface;
+	eui64_copy(&linear_table.table[index].addr, addr);
+}
+/*---------------------------------------------------------------------------*/
+static linear_entry_t *
+linear_addr_lookup(eui64_t *addr)
+{
+	int i;
+
+	for (i = 0; i < linear_table.elems; i++) {
+		if (eui64_cmp(addr, &(linear_table.table[i].addr))) {
+			return &(linear_table.table[i]);
+		}
+	}
+	return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+linear_init(void)
+{
+	linear_table.elems = 0;
+	linear_addr_add(&rimeaddr_node_addr, LOCAL);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Bridge input of the baseline: learns the source and looks the destination
+ * up. Returns 1 if the frame is flooded.
+ */
+static u8_t
+linear_input(trace_frame_t *f)
+{
+	if (linear_addr_lookup(&f->src) == NULL) {
+		linear_addr_add(&f->src, f->interface);
+	}
+	if (is_multicast_lladdr(&f->dst)) {
+		return 0;
+	}
+	return linear_addr_lookup(&f->dst) == NULL;
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+hash_input(trace_frame_t *f)
+{
+	incoming_if = f->interface;
+	eui64_copy(&src_eui64, &f->src);
+	eui64_copy(&dst_eui64, &f->dst);
+	bridge_input();
+	return outgoing_if == UNDEFINED && !is_multicast_lladdr(&f->dst);
+}
+/*---------------------------------------------------------------------------*/
+static void
+trace_add(clock_time_t time, interface_t interface, eui64_t *src, eui64_t *dst)
+{
+	if (trace_len == trace_size) {
+		trace_size = trace_size ? 2 * trace_size : 4096;
+		trace = realloc(trace, trace_size * sizeof(trace_frame_t));
+		if (trace == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	trace[trace_len].time = time;
+	trace[trace_len].interface = interface;
+	eui64_copy(&trace[trace_len].src, src);
+	eui64_copy(&trace[trace_len].dst, dst);
+	trace_len++;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Stores in addr the address at frame[*off] in addressing mode mode of an
+ * IEEE 802.15.4 frame. Short addresses take the last two bytes, and the
+ * broadcast address is rimeaddr_null (multicast for the bridge).
+ */
+static u8_t
+radio_addr(const u8_t *frame, u16_t len, u16_t *off, u8_t mode, eui64_t *addr)
+{
+	u8_t i;
+
+	memset(addr, 0, sizeof(eui64_t));
+	if (mode == 2) {
+		if (*off + 2 > len) {
+			return 0;
+		}
+		if (frame[*off] != 0xff || frame[*off + 1] != 0xff) {
+			addr->u8[6] = frame[*off + 1];
+			addr->u8[7] = frame[*off];
+		}
+		*off += 2;
+	} else if (mode == 3) {
+		if (*off + 8 > len) {
+			return 0;
+		}
+		/* Sent in reverse byte order */
+		for (i = 0; i < 8; i++) {
+			addr->u8[i] = frame[*off + 7 - i];
+		}
+		*off += 8;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+trace_add_radio(clock_time_t time, const u8_t *frame, u16_t len)
+{
+	eui64_t src, dst;
+	u16_t fcf, off = 3;
+
+	if (len < 3) {
+		return;
+	}
+	fcf = frame[0] | (frame[1] << 8);
+	/* Data frames only */
+	if ((fcf & 7) != 1) {
+		return;
+	}
+	off += 2;		/* Destination PAN ID */
+	if (!radio_addr(frame, len, &off, (fcf >> 10) & 3, &dst)) {
+		return;
+	}
+	if (!(fcf & (1 << 6))) {
+		off += 2;	/* Source PAN ID, not compressed */
+	}
+	if (!radio_addr(frame, len, &off, (fcf >> 14) & 3, &src)) {
+		return;
+	}
+	trace_add(time, IEEE_802_15_4, &src, &dst);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the frames of a capture file into the trace. Frame times are relative
+ * to the first frame of the capture.
+ */
+static int
+trace_read(const char *path, u8_t radio)
+{
+	native_link_t link;
+	clock_time_t t;
+	u8_t *frame;
+	u16_t len;
+
+	if (!native_link_open_read(&link, path)) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 0;
+	}
+	while (native_link_next_time(&link, &t)) {
+		clock_advance(t);
+		if ((frame = native_link_next(&link, &len)) == NULL) {
+			continue;
+		}
+		if (radio) {
+			trace_add_radio(t, frame, len);
+		} else if (len >= UIP_LLH_LEN) {
+			/* Addresses as get_lladdr() derives them */
+			memcpy(uip_buf, frame, UIP_LLH_LEN);
+			incoming_if = IEEE_802_3;
+			get_lladdr(&src_eui64, &dst_eui64);
+			trace_add(t, IEEE_802_3, &src_eui64, &dst_eui64);
+		}
+		native_link_release(&link);
+	}
+	native_link_close(&link);
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+station_addr(u32_t i, eui64_t *addr)
+{
+	memset(addr, 0, sizeof(eui64_t));
+	addr->u8[0] = 0x02;
+	addr->u8[3] = 0xff;
+	addr->u8[4] = 0xfe;
+	addr->u8[5] = i >> 16;
+	addr->u8[6] = i >> 8;
+	addr->u8[7] = i;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Synthetic trace: frames one ms apart between n stations, half of them on
+ * each segment. Stations are picked with a skewed distribution (a few
+ * talk a lot), and one frame in 20 is multicast.
+ */
+static void
+trace_synthetic(u32_t n, u32_t frames)
+{
+	eui64_t src, dst;
+	double u;
+	u32_t i, s;
+
+	for (i = 0; i < frames; i++) {
+		u = (double)rand() / ((double)RAND_MAX + 1);
+		s = (u32_t)(n * u * u * u);
+		station_addr(s, &src);
+		if (rand() % 20 == 0) {
+			eui64_copy(&dst, &rimeaddr_null);
+		} else {
+			u = (double)rand() / ((double)RAND_MAX + 1);
+			station_addr((u32_t)(n * u * u * u), &dst);
+		}
+		trace_add(i, s < n / 2 ? IEEE_802_3 : IEEE_802_15_4, &src, &dst);
+	}
+}
+/*---------------------------------------------------------------------------*/
+static int
+trace_cmp(const void *a, const void *b)
+{
+	const trace_frame_t *fa = a, *fb = b;
+
+	return fa->time < fb->time ? -1 : fa->time > fb->time;
+}
+/*---------------------------------------------------------------------------*/
+static double
+now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Replays the trace loops times through the cache (hash or linear) and
+ * prints its results.
+ */
+static void
+replay(u8_t hash, u32_t loops)
+{
+	clock_time_t base, last;
+	u32_t lookups = 0, floods = 0, i, l;
+	double elapsed = 0, start;
+
+	base = clock_time();
+	for (l = 0; l < loops; l++) {
+		if (hash) {
+			pgw_fwd_init();
+		} else {
+			linear_init();
+		}
+		last = base;
+		start = now_s();
+		for (i = 0; i < trace_len; i++) {
+			clock_advance(base + trace[i].time);
+			if (hash && (clock_time_t)(clock_time() - last) >= CLOCK_SECOND) {
+				/* The periodic ageing of the gateway, once per second */
+				last = clock_time();
+				pgw_fwd_periodic();
+			}
+			if (!is_multicast_lladdr(&trace[i].dst)) {
+				lookups++;
+			}
+			floods += hash ? hash_input(&trace[i]) : linear_input(&trace[i]);
+		}
+		elapsed += now_s() - start;
+		/* Next loop after the end of this one */
+		base += trace[trace_len - 1].time + CLOCK_SECOND;
+		clock_advance(base);
+	}
+	printf("bridge,%s,%lu,%lu,%lu,%.2f,%.0f\n", hash ? "hash" : "linear",
+			(unsigned long)trace_len * loops, (unsigned long)lookups,
+			(unsigned long)floods, lookups ? 100.0 * floods / lookups : 0.0,
+			elapsed > 0 ? lookups / elapsed : 0.0);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+	const char *eth_in = NULL, *radio_in = NULL;
+	unsigned int stations = 0, frames = 100000, loops = 10;
+	int c;
+
+	while ((c = getopt(argc, argv, "e:r:s:l:")) != -1) {
+		switch (c) {
+		case 'e': eth_in = optarg; break;
+		case 'r': radio_in = optarg; break;
+		case 's':
+			if (sscanf(optarg, "%u:%u", &stations, &frames) < 1 || stations == 0) {
+				stations = 0;
+			}
+			break;
+		case 'l': loops = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-e eth.pcap] [-r radio.pcap] "
+					"[-s stations:frames] [-l loops]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (eth_in == NULL && radio_in == NULL && stations == 0) {
+		stations = 200;
+	}
+
+	clock_init();
+	clock_set_virtual(1);
+	rimeaddr_node_addr.u8[0] = NODE_BASE_ADDR0;
+	rimeaddr_node_addr.u8[1] = NODE_BASE_ADDR1;
+	rimeaddr_node_addr.u8[2] = NODE_BASE_ADDR2;
+	rimeaddr_node_addr.u8[3] = NODE_BASE_ADDR3;
+	rimeaddr_node_addr.u8[4] = NODE_BASE_ADDR4;
+	rimeaddr_node_addr.u8[7] = 0x01;
+
+	srand(1);
+	if ((eth_in != NULL && !trace_read(eth_in, 0)) ||
+			(radio_in != NULL && !trace_read(radio_in, 1))) {
+		return 1;
+	}
+	if (stations > 0) {
+		trace_synthetic(stations, frames);
+	}
+	if (trace_len == 0) {
+		fprintf(stderr, "%s: empty trace\n", argv[0]);
+		return 1;
+	}
+	/* Frames of both links in the order they were captured */
+	qsort(trace, trace_len, sizeof(trace_frame_t), trace_cmp);
+
+	replay(0, loops);
+	replay(1, loops);
+	return 0;
+}
+/*---------------------------------------------------------------------------*/
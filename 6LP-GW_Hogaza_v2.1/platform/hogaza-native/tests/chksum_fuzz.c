@@ -0,0 +1,214 @@
+/**
+ * \file		chksum_fuzz.c
+ *
+ * \brief		Host fuzz test of the incremental ICMPv6 checksum.
+ *
+ * 					Random ICMPv6 packets get random sequences of the rewrites the
+ * 					proxy does (bytes overwritten, options inserted or removed,
+ * 					addresses of the IPv6 header changed), with the checksum
+ * 					updated incrementally by pgw_chksum_begin() ...
+ * 					pgw_chksum_end() as in translate_icmp_lladdr() or the RA
+ * 					fan-out. After each update the checksum is compared with a full
+ * 					recompute (pgw_update_icmp_checksum()). 0x0000 and 0xffff are
+ * 					the same checksum (RFC 1624), so they are not told apart.
+ *
+ * 					Built like the native gateway (see
+ * 					contiki-hogaza-native-6lp-gw-main.c), with this file instead
+ * 					of the main file.
+ *
+ * 					  -n packets  Random packets (default 100000)
+ * 					  -s seed     Seed of the generator (default 1)
+ *
+ * 					Output (CSV): "chksum", packets, updates, edits, mismatches.
+ * 					Each mismatch is printed to the standard error with the seed,
+ * 					packet and update it happened at. The exit status is not 0 if
+ * 					there was any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "contiki-net.h"
+#include "net/p-gw/pgw.h"
+
+#define UIP_IP_BUF		((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF	((struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define PKT				(&uip_buf[UIP_LLH_LEN])
+
+/* Offset of the addresses, and of the first byte after the ICMPv6 checksum */
+#define ADDRS			8
+#define BODY			(UIP_IPH_LEN + UIP_ICMPH_LEN)
+#define MAX_LEN			(UIP_BUFSIZE - UIP_LLH_LEN)
+
+/* Updates per packet and edits per update */
+#define MAX_UPDATES		3
+#define MAX_EDITS		8
+/* Longest overwrite, and longest option inserted or removed (an LLAO is 16) */
+#define MAX_OVERWRITE	32
+#define MAX_OPTION		24
+
+/* Edits */
+#define EDIT_BODY		0		/* Bytes of the message overwritten */
+#define EDIT_ADDR		1		/* Bytes of the source or destination address */
+#define EDIT_INSERT		2		/* Bytes inserted */
+#define EDIT_REMOVE		3		/* Bytes removed */
+#define EDITS			4
+
+static unsigned long edits;
+
+/*---------------------------------------------------------------------------*/
+/* An even number in [from, to), from being even */
+static u16_t
+even_in(u16_t from, u16_t to)
+{
+	return from + 2 * (rand() % ((to - from + 1) / 2));
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(u8_t *p, u16_t len)
+{
+	while (len--) {
+		*p++ = rand();
+	}
+}
+/*---------------------------------------------------------------------------*/
+/* Writes the upper-layer length, which the full recompute takes from there */
+static void
+set_len(void)
+{
+	UIP_IP_BUF->len[0] = (u8_t)((uip_len - UIP_IPH_LEN) >> 8);
+	UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * A random ICMPv6 message with a valid checksum. Some are all zeroes or all
+ * ones, whose sums are the corner cases of one's complement arithmetic.
+ */
+static void
+random_packet(void)
+{
+	uip_len = BODY + rand() % (MAX_LEN - BODY + 1);
+	switch (rand() % 8) {
+	case 0:
+		memset(PKT, 0, uip_len);
+		break;
+	case 1:
+		memset(PKT, 0xff, uip_len);
+		break;
+	default:
+		fill(PKT, uip_len);
+		break;
+	}
+	UIP_IP_BUF->vtc = 0x60;
+	UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+	uip_ext_len = 0;
+	set_len();
+	pgw_update_icmp_checksum();
+}
+/*---------------------------------------------------------------------------*/
+/* One random edit of the packet, accounted for in c */
+static void
+edit(pgw_chksum_t *c)
+{
+	u16_t off, len;
+
+	switch (rand() % EDITS) {
+	case EDIT_BODY:
+		if (uip_len <= BODY) {
+			return;
+		}
+		off = even_in(BODY, uip_len);
+		len = 1 + rand() % (uip_len - off < MAX_OVERWRITE ? uip_len - off : MAX_OVERWRITE);
+		pgw_chksum_remove(c, PKT + off, len);
+		fill(PKT + off, len);
+		pgw_chksum_insert(c, PKT + off, len);
+		break;
+	case EDIT_ADDR:
+		off = even_in(ADDRS, UIP_IPH_LEN);
+		len = even_in(2, UIP_IPH_LEN - off + 1);
+		pgw_chksum_remove(c, PKT + off, len);
+		fill(PKT + off, len);
+		pgw_chksum_insert(c, PKT + off, len);
+		break;
+	case EDIT_INSERT:
+		len = even_in(2, MAX_OPTION + 1);
+		if (uip_len + len > MAX_LEN) {
+			return;
+		}
+		/* Anywhere in the message, after its last byte if it ends evenly */
+		off = even_in(BODY, uip_len + 1);
+		memmove(PKT + off + len, PKT + off, uip_len - off);
+		fill(PKT + off, len);
+		uip_len += len;
+		pgw_chksum_insert(c, PKT + off, len);
+		break;
+	case EDIT_REMOVE:
+		if (uip_len < BODY + 2) {
+			return;
+		}
+		off = even_in(BODY, uip_len - 1);
+		len = even_in(2, (uip_len - off < MAX_OPTION ? uip_len - off : MAX_OPTION) + 1);
+		pgw_chksum_remove(c, PKT + off, len);
+		memmove(PKT + off, PKT + off + len, uip_len - off - len);
+		uip_len -= len;
+		break;
+	}
+	edits++;
+}
+/*---------------------------------------------------------------------------*/
+/* Whether a and b (network byte order) are the same checksum */
+static u8_t
+same(u16_t a, u16_t b)
+{
+	return a == b || ((a == 0 || a == 0xffff) && (b == 0 || b == 0xffff));
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+	unsigned long packets = 100000, p, updates = 0, mismatches = 0;
+	unsigned int seed = 1;
+	pgw_chksum_t c;
+	u16_t incremental, full;
+	u8_t u, n, e;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n': packets = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n packets] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srand(seed);
+	for (p = 0; p < packets; p++) {
+		random_packet();
+		n = 1 + rand() % MAX_UPDATES;
+		for (u = 0; u < n; u++) {
+			pgw_chksum_begin(&c);
+			for (e = rand() % (MAX_EDITS + 1); e > 0; e--) {
+				edit(&c);
+			}
+			set_len();
+			pgw_chksum_end(&c);
+			incremental = UIP_ICMP_BUF->icmpchksum;
+			pgw_update_icmp_checksum();
+			full = UIP_ICMP_BUF->icmpchksum;
+			if (!same(incremental, full)) {
+				fprintf(stderr, "mismatch: seed %u packet %lu update %u length %u: "
+						"incremental 0x%04x full 0x%04x\n", seed, p, u, uip_len,
+						uip_ntohs(incremental), uip_ntohs(full));
+				mismatches++;
+			}
+			updates++;
+		}
+	}
+	printf("chksum,%lu,%lu,%lu,%lu\n", packets, updates, edits, mismatches);
+	return mismatches != 0;
+}
+/*---------------------------------------------------------------------------*/
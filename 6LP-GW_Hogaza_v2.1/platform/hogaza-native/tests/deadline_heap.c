@@ -0,0 +1,179 @@
+/**
+ * \file		deadline_heap.c
+ *
+ * \brief		Host test of the deadline heap of the neighbor cache.
+ *
+ * 					Registers neighbor caches of growing size and runs pgw_periodic()
+ * 					every 100 ms (the period of the baseline 6LP-GW) for a minute of
+ * 					virtual time, while a fixed number of 6LNs re-register every
+ * 					second. It prints the CPU time of a call next to that of the
+ * 					walk over the whole cache the baseline did on every call: the
+ * 					former must not grow with the number of NCEs. It then lets
+ * 					every registration expire and checks that one call removes
+ * 					them all and that the heap is left consistent.
+ *
+ * 					Built like the native gateway (see
+ * 					contiki-hogaza-native-6lp-gw-main.c), with this file instead
+ * 					of the main file and without net/p-gw/pgw_nd.c, which is
+ * 					included below to reach the heap. Every file is built with
+ * 					-DMAX_6LOWPAN_NEIGHBORS=4000 -DPGW_CONF_NBR_HASH_SIZE=8192.
+ *
+ * 					Output (CSV): "heap", NCEs, calls, mean ns per call of
+ * 					pgw_periodic() and of the full walk. The exit status is not 0
+ * 					if a check failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "net/p-gw/pgw_nd.c"
+
+/* Virtual time run, call period and re-registrations per second */
+#define RUN_TIME		(60 * CLOCK_SECOND)
+#define CALL_PERIOD		(CLOCK_SECOND / 10)
+#define CHURN			10
+/* Registration lifetime (s), longer than RUN_TIME */
+#define LIFETIME		600
+
+static u8_t failed;
+
+/*---------------------------------------------------------------------------*/
+static void
+check(u8_t ok, const char *what, unsigned int nces)
+{
+	if (!ok) {
+		fprintf(stderr, "FAIL: %s (%u NCEs)\n", what, nces);
+		failed = 1;
+	}
+}
+/*---------------------------------------------------------------------------*/
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The walk of the baseline pgw_periodic(): every NCE in use is checked for
+ * expiry. Returns the number expired, so that it is not optimized away.
+ */
+static u16_t
+linear_periodic(void)
+{
+	pgw_nbr_t *n;
+	u16_t expired = 0;
+
+	for (n = pgw_6ln_cache; n < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; n++) {
+		if (n->isused && (stimer_expired(&n->reachable) ||
+				(n->dadstate == PGW_DAD_PROBING && timer_expired(&n->dadtimer)))) {
+			expired++;
+		}
+	}
+	return expired;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks the heap property and the position index */
+static u8_t
+heap_ok(void)
+{
+	pgw_nbr_idx_t i;
+
+	for (i = 0; i < pgw_heap_len; i++) {
+		if (pgw_heap_pos[pgw_heap[i].obj] != i ||
+				(i > 0 && deadline_before(pgw_heap[i].deadline,
+						pgw_heap[(i - 1) / 2].deadline))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+register_nce(pgw_nbr_t *nbr)
+{
+	stimer_set(&nbr->reachable, LIFETIME);
+	pgw_nbr_schedule(nbr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(unsigned int nces)
+{
+	uip_ipaddr_t ipaddr;
+	uip_lladdr_t lladdr;
+	pgw_nbr_t *nbr;
+	clock_time_t start, t;
+	double heap_ns = 0, linear_ns = 0, t0;
+	u32_t calls = 0, churned = 0;
+	unsigned int i;
+	u16_t expired = 0;
+
+	pgw_nd_init();
+	for (i = 0; i < nces; i++) {
+		uip_ip6addr(&ipaddr, 0x2001, 0xdb8, 0, 0, 0, 0, i >> 16, i & 0xffff);
+		memset(&lladdr, 0, sizeof(lladdr));
+		lladdr.addr[6] = i >> 8;
+		lladdr.addr[7] = i;
+		nbr = pgw_nbr_add(&ipaddr, &lladdr, 0, PGW_REGISTERED);
+		check(nbr != NULL, "pgw_nbr_add", nces);
+		if (nbr != NULL) {
+			register_nce(nbr);
+		}
+	}
+	check(pgw_heap_len == nces, "every NCE in the heap", nces);
+
+	start = clock_time();
+	for (t = CALL_PERIOD; t <= RUN_TIME; t += CALL_PERIOD) {
+		clock_advance(start + t);
+		if (t % CLOCK_SECOND == 0) {
+			/* Some 6LNs refresh their registration */
+			for (i = 0; i < CHURN; i++) {
+				nbr = &pgw_6ln_cache[churned++ % nces];
+				register_nce(nbr);
+			}
+		}
+		t0 = now_ns();
+		pgw_periodic();
+		heap_ns += now_ns() - t0;
+		t0 = now_ns();
+		expired += linear_periodic();
+		linear_ns += now_ns() - t0;
+		calls++;
+	}
+	check(expired == 0 && pgw_heap_len == nces, "no NCE expired early", nces);
+	check(heap_ok(), "heap consistent", nces);
+	printf("heap,%u,%lu,%.0f,%.0f\n", nces, (unsigned long)calls,
+			heap_ns / calls, linear_ns / calls);
+
+	/* Every registration expires */
+	clock_advance(clock_time() + (LIFETIME + 1) * CLOCK_SECOND);
+	pgw_periodic();
+	check(pgw_heap_len == 0, "every expired NCE removed", nces);
+	for (i = 0; i < MAX_6LOWPAN_NEIGHBORS; i++) {
+		check(!pgw_6ln_cache[i].isused, "cache empty", nces);
+	}
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+	static const unsigned int sizes[] = { 100, 500, 1000, 2000, 4000 };
+	unsigned int i;
+
+	clock_init();
+	clock_set_virtual(1);
+	process_init();
+	process_start(&etimer_process, NULL);
+	pgw_fwd_init();
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (sizes[i] <= MAX_6LOWPAN_NEIGHBORS) {
+			run(sizes[i]);
+		}
+	}
+	return failed;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,340 @@
+/**
+ * \file		frag_replay.c
+ *
+ * \brief		Host test of the 6LoWPAN reassembly.
+ *
+ * 					Many 6LNs send fragmented datagrams of random size (uncompressed
+ * 					IPv6, 88-byte fragments) at the same time, and the fragments are
+ * 					fed to the 6LoWPAN input in virtual time with, depending on the
+ * 					scenario, fragments out of order, duplicated, lost (so that the
+ * 					datagram times out) or overlapping (the first copy of the 
+ * 					datagram, cut in 80-byte fragments, is cut short and the
+ * 					datagram is sent again with the same tag, which restarts the
+ * 					reassembly). Every datagram delivered is checked byte by byte.
+ *
+ * 					Built like the native gateway (see
+ * 					contiki-hogaza-native-6lp-gw-main.c), with this file instead
+ * 					of the main file and without net/p-gw/pgw_sicslowpan.c, which
+ * 					is included below to reach the reassembly. The pool of the
+ * 					board is used unless SICSLOWPAN_CONF_REASS_BUF_SIZE is given
+ * 					(e.g. -DSICSLOWPAN_CONF_REASS_BUF_SIZE=5120 for every file).
+ *
+ * 					Output (CSV): "frag", scenario, senders, datagrams sent,
+ * 					completed, corrupted, completion rate (%), then the expected
+ * 					rate (that of the datagrams not damaged on purpose). The exit
+ * 					status is not 0 if a datagram was corrupted, if a sequential
+ * 					scenario missed a datagram it should have completed, or if
+ * 					pool blocks leaked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "net/pgw_netstack.h"
+
+/* Datagrams reassembled are checked here instead of entering the 6LP-GW */
+static void frag_replay_input(void);
+static const struct pgw_driver frag_replay_sink;
+#undef NETSTACK_6LPGW
+#define NETSTACK_6LPGW	frag_replay_sink
+
+#include "net/p-gw/pgw_sicslowpan.c"
+
+/* Fragment payloads: FRAG1 carries the IPv6 header and 48 bytes */
+#define FRAG_LEN			88
+/* Fragments of the first, cut short, copy of an overlapping datagram */
+#define FRAG_LEN_SHORT		80
+#define FRAG_GAP			(CLOCK_SECOND / 100)	/* Between two fragments */
+#define DATAGRAM_GAP		(CLOCK_SECOND / 5)		/* Between two datagrams of a 6LN */
+#define MIN_SIZE			100
+#define MAX_SIZE			SICSLOWPAN_REASS_MAX_LEN
+
+#define MAX_EVENTS			200000
+#define MAX_FRAME			(SICSLOWPAN_FRAGN_HDR_LEN + FRAG_LEN)
+
+/* Impairments */
+#define REORDER			0x01
+#define DUPLICATE		0x02
+#define LOSS			0x04
+#define OVERLAP			0x08
+
+/* A fragment, due at time */
+typedef struct {
+	clock_time_t time;
+	u32_t seq;
+	u8_t sender;
+	u8_t len;
+	u8_t frame[MAX_FRAME];
+} event_t;
+
+static event_t *events;
+static u32_t nevents;
+
+static u32_t completed, corrupted;
+static u8_t failed;
+
+/*---------------------------------------------------------------------------*/
+static void
+sender_addr(u8_t sender, rimeaddr_t *addr)
+{
+	memset(addr, 0, sizeof(rimeaddr_t));
+	addr->u8[0] = 0x02;
+	addr->u8[7] = sender + 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Byte at offset i of the datagram of size bytes and tag from sender: an
+ * IPv6 header carrying the tag in its flow label, then a pattern.
+ */
+static u8_t
+datagram_byte(u8_t sender, u16_t tag, u16_t size, u16_t i)
+{
+	switch (i) {
+	case 0: return 0x60;
+	case 2: return tag >> 8;
+	case 3: return tag;
+	case 4: return (size - UIP_IPH_LEN) >> 8;
+	case 5: return size - UIP_IPH_LEN;
+	case 6: return UIP_PROTO_NONE;
+	case 7: return 64;
+	case 23: return sender + 1;
+	}
+	if (i < UIP_IPH_LEN) {
+		return 0;
+	}
+	return (u8_t)(tag * 31 + i * 7 + sender);
+}
+/*---------------------------------------------------------------------------*/
+static void
+frag_replay_input(void)
+{
+	const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+	u8_t *ip = (u8_t *)UIP_IP_BUF;
+	u16_t tag = (ip[2] << 8) | ip[3];
+	u16_t i;
+
+	for (i = 0; i < uip_len; i++) {
+		if (ip[i] != datagram_byte(sender->u8[7] - 1, tag, uip_len, i)) {
+			corrupted++;
+			return;
+		}
+	}
+	completed++;
+}
+
+static const struct pgw_driver frag_replay_sink = {
+	"frag_replay",
+	NULL,
+	frag_replay_input,
+	NULL
+};
+/*---------------------------------------------------------------------------*/
+static event_t *
+event_add(clock_time_t time, u8_t sender)
+{
+	if (nevents == MAX_EVENTS) {
+		fprintf(stderr, "too many fragments\n");
+		exit(1);
+	}
+	events[nevents].time = time;
+	events[nevents].seq = nevents;
+	events[nevents].sender = sender;
+	return &events[nevents++];
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Queues the fragments of a datagram, frag bytes each, starting at time. Only
+ * the first count fragments are sent. Returns the time after the last one.
+ */
+static clock_time_t
+datagram_add(clock_time_t time, u8_t sender, u16_t tag, u16_t size, u16_t frag,
+		u8_t flags, u16_t count)
+{
+	event_t *e, *first, *dup;
+	u16_t pos, len, i, n = 0;
+	u8_t *p;
+
+	first = &events[nevents];
+	for (pos = 0; pos < size && n < count; pos += len, n++) {
+		len = size - pos < frag ? size - pos : frag;
+		if (flags & LOSS && n == 1) {
+			/* The second fragment is lost: the datagram times out */
+			continue;
+		}
+		e = event_add(time + n * FRAG_GAP, sender);
+		p = e->frame;
+		if (pos == 0) {
+			/* FRAG1, then the IPv6 dispatch and header, uncompressed */
+			SET16(p, RIME_FRAG_DISPATCH_SIZE, (SICSLOWPAN_DISPATCH_FRAG1 << 8) | size);
+			SET16(p, RIME_FRAG_TAG, tag);
+			p += SICSLOWPAN_FRAG1_HDR_LEN;
+			*p++ = SICSLOWPAN_DISPATCH_IPV6;
+		} else {
+			SET16(p, RIME_FRAG_DISPATCH_SIZE, (SICSLOWPAN_DISPATCH_FRAGN << 8) | size);
+			SET16(p, RIME_FRAG_TAG, tag);
+			p[RIME_FRAG_OFFSET] = pos >> 3;
+			p += SICSLOWPAN_FRAGN_HDR_LEN;
+		}
+		for (i = 0; i < len; i++) {
+			*p++ = datagram_byte(sender, tag, size, pos + i);
+		}
+		e->len = p - e->frame;
+		/* 
+		 * A duplicate (e.g. a MAC retransmission) follows the original. The last
+		 * fragment is not duplicated: after the datagram is complete, its copy 
+		 * would start a new reassembly, which RFC 4944 cannot tell apart.
+		 */
+		if (flags & DUPLICATE && pos + len < size && rand() % 4 == 0) {
+			dup = event_add(e->time + FRAG_GAP / 2, sender);
+			dup->len = e->len;
+			memcpy(dup->frame, e->frame, e->len);
+		}
+	}
+	if (flags & REORDER && &events[nevents] - first > 1) {
+		/* Send the first fragment last, and swap two others */
+		first->time = time + n * FRAG_GAP;
+		i = 1 + rand() % (&events[nevents] - first - 1);
+		e = &first[i];
+		e->time += FRAG_GAP;
+		if (i + 1 < &events[nevents] - first) {
+			first[i + 1].time -= FRAG_GAP;
+		}
+	}
+	return time + (n + 4) * FRAG_GAP;
+}
+/*---------------------------------------------------------------------------*/
+static int
+event_cmp(const void *a, const void *b)
+{
+	const event_t *ea = a, *eb = b;
+
+	if (ea->time != eb->time) {
+		return (s32_t)(ea->time - eb->time) < 0 ? -1 : 1;
+	}
+	return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+/*---------------------------------------------------------------------------*/
+static void
+replay(clock_time_t base)
+{
+	rimeaddr_t sender;
+	u32_t i;
+
+	qsort(events, nevents, sizeof(event_t), event_cmp);
+	for (i = 0; i < nevents; i++) {
+		clock_advance(base + events[i].time);
+		sender_addr(events[i].sender, &sender);
+		packetbuf_clear();
+		packetbuf_copyfrom(events[i].frame, events[i].len);
+		packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &sender);
+		input();
+	}
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Runs a scenario: each of the senders sends datagrams datagrams, one after
+ * the other, with the given impairments. Every datagram but those lost on
+ * purpose should complete if the contexts and pool were large enough.
+ */
+static void
+scenario(const char *name, u8_t senders, u16_t datagrams, u8_t flags)
+{
+	clock_time_t t, base;
+	u32_t sent = 0, expected = 0;
+	u16_t size, d, tag;
+	u8_t s, f;
+
+	sicslowpan_init();
+	nevents = 0;
+	completed = corrupted = 0;
+	for (s = 0; s < senders; s++) {
+		t = rand() % CLOCK_SECOND;
+		for (d = 0; d < datagrams; d++) {
+			size = MIN_SIZE + rand() % (MAX_SIZE - MIN_SIZE + 1);
+			tag = (s << 8) + d;
+			/* Impair a datagram in three */
+			f = rand() % 3 == 0 ? flags : 0;
+			if (f & OVERLAP) {
+				/* 
+				 * Only the first fragment of the first copy is sent. The second copy
+				 * is sent whole and in order, so that its first fragment restarts the
+				 * reassembly.
+				 */
+				t = datagram_add(t, s, tag, size, FRAG_LEN_SHORT, 0, 1);
+				t = datagram_add(t, s, tag, size, FRAG_LEN, 0, 0xffff);
+				f = 0;
+			} else {
+				t = datagram_add(t, s, tag, size, FRAG_LEN, f, 0xffff);
+			}
+			if (f & LOSS) {
+				/* Wait for it to time out before reusing the context */
+				t += SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND;
+			} else {
+				expected++;
+			}
+			sent++;
+			t += DATAGRAM_GAP;
+		}
+	}
+	base = clock_time();
+	replay(base);
+
+	printf("frag,%s,%u,%lu,%lu,%lu,%.1f,%.1f\n", name, senders, (unsigned long)sent,
+			(unsigned long)completed, (unsigned long)corrupted,
+			100.0 * completed / sent, 100.0 * expected / sent);
+	if (corrupted > 0) {
+		fprintf(stderr, "FAIL: %s: corrupted datagrams\n", name);
+		failed = 1;
+	}
+	if (senders == 1 && completed != expected) {
+		fprintf(stderr, "FAIL: %s: %lu of %lu datagrams completed\n", name,
+				(unsigned long)completed, (unsigned long)expected);
+		failed = 1;
+	}
+
+	/* Once every reassembly has timed out, all the blocks are back */
+	clock_advance(clock_time() + (SICSLOWPAN_REASS_MAXAGE + 1) * CLOCK_SECOND);
+	nevents = 0;
+	completed = 0;
+	datagram_add(0, 0, 0xffff, MAX_SIZE, FRAG_LEN, 0, 0xffff);
+	replay(clock_time());
+	if (completed != 1 || reass_nfree != SICSLOWPAN_REASS_BLOCKS) {
+		fprintf(stderr, "FAIL: %s: reassembly pool leaked\n", name);
+		failed = 1;
+	}
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+	static const struct {
+		const char *name;
+		u8_t flags;
+	} impairments[] = {
+		{ "clean", 0 },
+		{ "reorder", REORDER },
+		{ "duplicate", DUPLICATE },
+		{ "loss", LOSS },
+		{ "overlap", OVERLAP },
+		{ "mixed", REORDER | DUPLICATE | LOSS | OVERLAP },
+	};
+	static const u8_t senders[] = { 1, 4, 16, 64 };
+	unsigned int i, j;
+
+	clock_init();
+	clock_set_virtual(1);
+	events = malloc(MAX_EVENTS * sizeof(event_t));
+	if (events == NULL) {
+		return 1;
+	}
+	srand(1);
+
+	for (i = 0; i < sizeof(impairments) / sizeof(impairments[0]); i++) {
+		for (j = 0; j < sizeof(senders); j++) {
+			scenario(impairments[i].name, senders[j], 4096 / senders[j] > 100 ? 100 :
+					4096 / senders[j], impairments[i].flags);
+		}
+	}
+	return failed;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,170 @@
+/**
+ * \file		spi_bus.c
+ *
+ * \brief		Host test of the SPI traffic of the ENC28J60 and CC2520 drivers.
+ *
+ * 					The drivers of platform/hogaza/dev run against the SPI mock
+ * 					(dev/spi_dma.c, msp430/msp430f5435a.h), which counts the bytes
+ * 					moved on each bus by the CPU and by DMA. It checks that frame
+ * 					payloads go by DMA and only to their own bus, that the
+ * 					asynchronous read of the rest of a frame moves the same bytes
+ * 					as the blocking one and calls back once, and that the bytes
+ * 					the chip answers with end up in the frame.
+ *
+ * 					Built from the two drivers and the mocks only, with
+ * 					-Imsp430 -DSPI_DMA_CONF_STATISTICS=1.
+ *
+ * 					Output (CSV): "spi", bus, bytes moved by the CPU and by DMA,
+ * 					one line per bus. Each failed check is printed to the standard
+ * 					error. The exit status is not 0 if there was any.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dev/enc28j60.h"
+#include "dev/hal_cc2520.h"
+#include "dev/spi_mock.h"
+
+/* Peeked headers, as by the Ethernet driver */
+#define HDR_LEN		54
+/*
+ * A chip answering 0x02 to everything has 2 frames pending, the next one at
+ * 0x0202 and 0x0202 bytes long (CRC included)
+ */
+#define REPLY_BYTE	0x02
+#define FRAME_LEN	0x0202
+
+static u8_t reply[2048];
+static u8_t frame[1518];
+static unsigned int failures;
+static unsigned int callbacks;
+
+#define CHECK(c) do { 																\
+		if (!(c)) { 																			\
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+			failures++; 																		\
+		} 																								\
+	} while (0)
+
+/*---------------------------------------------------------------------------*/
+/* Board routines the drivers use */
+void
+register_port1IntHandler(int i, void (*f)(void))
+{
+}
+void
+register_port2IntHandler(int i, void (*f)(void))
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_done(void *ptr)
+{
+	callbacks++;
+	CHECK(ptr == frame);
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+all(const u8_t *buf, u16_t len, u8_t c)
+{
+	while (len--) {
+		if (*buf++ != c) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Peeks a frame and reads the rest of it, by DMA in the background if async.
+ * Leaves the bytes moved by the read in s.
+ */
+static void
+receive(u8_t async, spi_dma_stats_t *s)
+{
+	unsigned int len;
+
+	memset(reply, REPLY_BYTE, sizeof(reply));
+	spi_mock_reply(SPI_BUS_ENC28J60, reply, sizeof(reply));
+	memset(frame, 0, sizeof(frame));
+	memset(spi_dma_stats, 0, sizeof(spi_dma_stats));
+
+	CHECK(enc28j60PacketPeek(HDR_LEN, frame) == FRAME_LEN);
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].dma_bytes == HDR_LEN);
+	if (async) {
+		callbacks = 0;
+		len = enc28j60PacketReadRestAsync(HDR_LEN, sizeof(frame), frame,
+																			read_done, frame);
+		spi_dma_wait();
+		enc28j60PacketReadEnd();
+		CHECK(callbacks == 1);
+	} else {
+		len = enc28j60PacketReadRest(HDR_LEN, sizeof(frame), frame);
+	}
+	CHECK(len == FRAME_LEN);
+	CHECK(all(frame, FRAME_LEN, REPLY_BYTE));
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].dma_bytes == FRAME_LEN);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].cpu_bytes == 0);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].dma_bytes == 0);
+	*s = spi_dma_stats[SPI_BUS_ENC28J60];
+
+	/* A frame too short for the asynchronous read is left to the caller */
+	if (async) {
+		CHECK(enc28j60PacketReadRestAsync(FRAME_LEN, sizeof(frame), frame,
+																			read_done, frame) == 0);
+		CHECK(callbacks == 1);
+	}
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+	spi_dma_stats_t blocking, async;
+	spi_bus_t bus;
+	u8_t data[100];
+
+	spi_dma_init();
+
+	/* Ethernet egress: the frame goes by DMA, the commands by the CPU */
+	memset(spi_dma_stats, 0, sizeof(spi_dma_stats));
+	enc28j60PacketSend(sizeof(frame), frame);
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].dma_bytes == sizeof(frame));
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].cpu_bytes > 0);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].cpu_bytes == 0);
+
+	/* Ethernet ingress, blocking and asynchronous */
+	receive(0, &blocking);
+	receive(1, &async);
+	CHECK(async.cpu_bytes == blocking.cpu_bytes);
+	CHECK(async.dma_bytes == blocking.dma_bytes);
+
+	/* Radio: instruction by the CPU, frame by DMA */
+	memset(spi_dma_stats, 0, sizeof(spi_dma_stats));
+	memset(data, 0xaa, sizeof(data));
+	CC2520_TXBUF(sizeof(data), data);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].cpu_bytes == 1);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].dma_bytes == sizeof(data));
+
+	/* The status byte, then the frame */
+	memset(reply, 0x55, sizeof(data) + 1);
+	reply[0] = 0x80;
+	spi_mock_reply(SPI_BUS_CC2520, reply, sizeof(data) + 1);
+	memset(data, 0, sizeof(data));
+	CHECK(CC2520_RXBUF(sizeof(data), data) == 0x80);
+	CHECK(all(data, sizeof(data), 0x55));
+	CHECK(spi_mock_reply_left(SPI_BUS_CC2520) == 0);
+
+	/* Short reads stay on the CPU */
+	CC2520_RXBUF16();
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].cpu_bytes == 5);
+	CHECK(spi_dma_stats[SPI_BUS_CC2520].dma_bytes == 2 * sizeof(data));
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].cpu_bytes == 0);
+	CHECK(spi_dma_stats[SPI_BUS_ENC28J60].dma_bytes == 0);
+
+	for (bus = 0; bus < SPI_BUSES; bus++) {
+		printf("spi,%u,%lu,%lu\n", bus, (unsigned long)spi_dma_stats[bus].cpu_bytes,
+					 (unsigned long)spi_dma_stats[bus].dma_bytes);
+	}
+	return failures != 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * \file		random.c
+ *
+ * \brief		Pseudo-random numbers of the native (host) build of the 6LP-GW.
+ * 					A fixed-seed generator replaces the CC2520 random generator, 
+ * 					so that replays are reproducible.
+ */
+
+#include "contiki.h"
+
+static u32_t state = 1;
+
+/*---------------------------------------------------------------------------*/
+void
+random_init(unsigned short seed)
+{
+  state = seed ? seed : 1;
+}
+
+/*---------------------------------------------------------------------------*/
+u16_t
+random_rand(void)
+{
+  state = state * 1103515245UL + 12345;
+  return (u16_t)(state >> 16);
+}
+/*---------------------------------------------------------------------------*/
@@ -7,14 +7,27 @@
  */
 
 #include "clock_arch.h"
+#include "dev/msp430_arch.h"
+#if CLOCK_SLEEP_STATS
+#include <stdio.h>
+#endif /* CLOCK_SLEEP_STATS */
 /**
  * Static variables 
  */ 
 /*---------------------------------------------------------------------------*/
 static volatile clock_time_t ticks;
 static volatile u32_t seconds = 0;
-/* last_tar is used for calculating clock_fine */
+/* TA0R at the last tick, used for calculating clock_fine */
 static u16_t last_tar = 0;
+#if CLOCK_SLEEP_STATS
+/* TimerA counts spent asleep since stats_start */
+static u32_t sleep_counts;
+static u32_t stats_start;
+#endif /* CLOCK_SLEEP_STATS */
+#if PGW_CONF_PROFILE
+/* Upper half of the cycle counter, incremented on TimerB overflows */
+static volatile u16_t cycles_hi;
+#endif /* PGW_CONF_PROFILE */
 /*---------------------------------------------------------------------------*/
 
 /**
@@ -23,19 +36,54 @@ static u16_t last_tar = 0;
 /*---------------------------------------------------------------------------*/
 void timer_interrupt(void);
 
+/*
+ * TimerA is sourced from ACLK, which is asynchronous to MCLK, so TA0R is read
+ * until two reads agree.
+ */
+static u16_t
+read_tar(void)
+{
+    u16_t t;
+
+    do {
+        t = TA0R;
+    } while(t != TA0R);
+    return t;
+}
+
+/*
+ * Accounts for every tick elapsed since last_tar. Called with interrupts
+ * disabled. It is one tick per interrupt unless the interrupt was put off
+ * by clock_arch_idle().
+ */
+static void
+clock_update(void)
+{
+    while((u16_t)(read_tar() - last_tar) >= INTERVAL) {
+        last_tar += INTERVAL;
+        ++ticks;
+        if(0 == (ticks % CLOCK_CONF_SECOND)){
+            ++seconds;
+        }
+    }
+}
+
 #pragma vector = TIMER0_A0_VECTOR
 interrupt void
 timer_interrupt(void)
 {
-	++ticks;
-    if(0 == (ticks % CLOCK_CONF_SECOND)){
-		++seconds;
-	}
-    last_tar = TA0R;
+    clock_update();
+    /* Next tick */
+    TA0CCR0 = last_tar + INTERVAL;
     /* If there are Event timers pending, notify the event timer module */
     if(etimer_pending()){
         etimer_request_poll();
+        MSP430_WAKEUP_ON_EXIT();
     }
+#if CLOCK_TICKLESS
+    /* Back to clock_arch_idle(), which programs the next wake-up */
+    MSP430_WAKEUP_ON_EXIT();
+#endif /* CLOCK_TICKLESS */
 }
 /*---------------------------------------------------------------------------*/
 
@@ -62,12 +110,22 @@ clock_init(void)
 	TA0CCTL0 = CCIE;
 
 	/* Interrupt after X ms. */
-	TA0CCR0 = INTERVAL - 1;
+	TA0CCR0 = INTERVAL;
 
-	/* Select ACLK 32768Hz clock, divide by 8. TimerA in Up Mode */
-	TA0CTL |= TASSEL_1 | ID_3 | MC_1;
+	/* Select ACLK 32768Hz clock, divide by 8. TimerA in Continuous Mode, so
+	 * that TA0R is free running (see rtimer-arch.h) and ticks can be skipped
+	 * (see clock_arch_idle()) */
+	TA0CTL |= TASSEL_1 | ID_3 | MC_2;
 
 	ticks = 0;
+	last_tar = 0;
+
+#if PGW_CONF_PROFILE
+	/* TimerB sourced from SMCLK with no divider, in continuous mode, with the
+	 * overflow interrupt extending it to 32 bits */
+	TB0CTL = TBSSEL_2 | MC_2 | TBCLR | TBIE;
+	cycles_hi = 0;
+#endif /* PGW_CONF_PROFILE */
 
 	/* Enable interrupts. */
 	_enable_interrupts();
@@ -84,7 +142,18 @@ clock_init(void)
 clock_time_t
 clock_time(void)
 {
-    return ticks;
+    clock_time_t t;
+    istate_t state;
+
+    /* ticks is not read atomically */
+    state = __get_interrupt_state();
+    _disable_interrupts();
+#if CLOCK_TICKLESS
+    clock_update();
+#endif /* CLOCK_TICKLESS */
+    t = ticks;
+    __set_interrupt_state(state);
+    return t;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -113,7 +182,17 @@ clock_delay(unsigned int i)
 u32_t
 clock_seconds(void)
 {
-    return seconds;
+    u32_t s;
+    istate_t state;
+
+    state = __get_interrupt_state();
+    _disable_interrupts();
+#if CLOCK_TICKLESS
+    clock_update();
+#endif /* CLOCK_TICKLESS */
+    s = seconds;
+    __set_interrupt_state(state);
+    return s;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -136,11 +215,150 @@ unsigned short
 clock_fine(void)
 {
     u16_t t;
+#if CLOCK_TICKLESS
+    istate_t state;
+
+    /* Skipped ticks must be accounted for first */
+    state = __get_interrupt_state();
+    _disable_interrupts();
+    clock_update();
+    __set_interrupt_state(state);
+#endif /* CLOCK_TICKLESS */
 
     /* Assign last_tar to a local variable so that it cannot be changed by the
      * interrupt ISR */
     t = last_tar;
     /* perform calc based on t, TAR will not be changed during interrupt */
-    return (u16_t) (TA0R - t);
+    return (u16_t) (read_tar() - t);
+}
+/*---------------------------------------------------------------------------*/
+
+#if CLOCK_SLEEP_STATS
+/*
+ * TimerA counts elapsed since clock_init(). Called with interrupts disabled.
+ */
+static u32_t
+clock_counts(void)
+{
+    clock_update();
+    return (u32_t)ticks * INTERVAL + (u16_t)(read_tar() - last_tar);
+}
+#endif /* CLOCK_SLEEP_STATS */
+/*---------------------------------------------------------------------------*/
+
+/**
+ * Puts the CPU to sleep until an interrupt wakes it up. Called from the main
+ * loop with interrupts disabled when no process is runnable; interrupts are
+ * enabled on return.
+ * LPM3 is used unless SMCLK is needed (by the cycle counter). In tickless
+ * mode, the timer interrupt is put off until the next etimer expiration (at
+ * most CLOCK_TICKLESS_MAX ticks away).
+ */
+/*---------------------------------------------------------------------------*/
+void
+clock_arch_idle(void)
+{
+    u16_t lpm;
+#if CLOCK_TICKLESS
+    clock_time_t next;
+#endif /* CLOCK_TICKLESS */
+#if CLOCK_SLEEP_STATS
+    u32_t start, now;
+#endif /* CLOCK_SLEEP_STATS */
+
+#if CLOCK_TICKLESS
+    clock_update();
+    if(etimer_pending()) {
+        next = etimer_next_expiration_time() - ticks;
+        if((s32_t)next <= 0) {
+            /* Expired while the system was busy, and the interrupt was put
+             * off by the previous sleep */
+            etimer_request_poll();
+            _enable_interrupts();
+            return;
+        }
+        if(next > CLOCK_TICKLESS_MAX) {
+            next = CLOCK_TICKLESS_MAX;
+        }
+    } else {
+        next = CLOCK_TICKLESS_MAX;
+    }
+    /* At least one tick ahead of TA0R when clock_update() returned */
+    TA0CCR0 = last_tar + (u16_t)next * INTERVAL;
+    /*
+     * The compare only fires when TA0R equals TA0CCR0: if TA0R went past it 
+     * while it was being computed and written, the interrupt would only come
+     * after a whole TA0R wrap. Do not sleep then; the next call accounts for
+     * the tick and programs the compare again.
+     */
+    if((u16_t)(read_tar() - last_tar) >= (u16_t)next * INTERVAL) {
+        _enable_interrupts();
+        return;
+    }
+#endif /* CLOCK_TICKLESS */
+
+#if PGW_CONF_PROFILE
+    lpm = LPM0_bits;
+#else
+    lpm = LPM3_bits;
+#endif /* PGW_CONF_PROFILE */
+
+#if CLOCK_SLEEP_STATS
+    start = clock_counts();
+#endif /* CLOCK_SLEEP_STATS */
+    __bis_SR_register(lpm + GIE);
+#if CLOCK_SLEEP_STATS
+    _disable_interrupts();
+    now = clock_counts();
+    sleep_counts += now - start;
+    if(now - stats_start >=
+       (u32_t)CLOCK_SLEEP_STATS * CLOCK_CONF_SECOND * INTERVAL) {
+        _enable_interrupts();
+        printf("sleep,%lu%%\n", sleep_counts / ((now - stats_start) / 100));
+        _disable_interrupts();
+        sleep_counts = 0;
+        stats_start = now;
+    }
+    _enable_interrupts();
+#endif /* CLOCK_SLEEP_STATS */
+}
+/*---------------------------------------------------------------------------*/
+
+/**
+ * Returns the number of CPU cycles elapsed since clock_init(), modulo 2^32.
+ * Always 0 unless PGW_CONF_PROFILE is set.
+ */
+/*---------------------------------------------------------------------------*/
+u32_t
+clock_cycles(void)
+{
+#if PGW_CONF_PROFILE
+    u16_t hi, lo;
+
+    /* Read again if TimerB overflowed in between */
+    do {
+        hi = cycles_hi;
+        lo = TB0R;
+    } while (hi != cycles_hi);
+    return ((u32_t)hi << 16) | lo;
+#else
+    return 0;
+#endif /* PGW_CONF_PROFILE */
+}
+/*---------------------------------------------------------------------------*/
+
+#if PGW_CONF_PROFILE
+/**
+ * TimerB0 overflow interrupt handler
+ */
+/*---------------------------------------------------------------------------*/
+#pragma vector = TIMER0_B1_VECTOR
+interrupt void
+cycles_interrupt(void)
+{
+    if (TB0IV == TB0IV_TB0IFG) {
+        ++cycles_hi;
+    }
 }
+#endif /* PGW_CONF_PROFILE */
 /*---------------------------------------------------------------------------*/
@@ -25,6 +25,45 @@
  */
 #define CLOCK_CONF_SECOND 16
 
+/**
+ * Frequency of clock_cycles(). TimerB counts SMCLK, which runs at the MCLK
+ * frequency, so the count is in CPU cycles.
+ */
+#define CLOCK_CYCLES_HZ 16000000UL
+
+/**
+ * Tickless mode. When the system goes idle, the TimerA interrupt is put off
+ * until the next etimer expiration instead of firing every tick. The ticks
+ * skipped are accounted for from TA0R on wake-up or when the clock is read.
+ */
+#ifdef CLOCK_CONF_TICKLESS
+#define CLOCK_TICKLESS CLOCK_CONF_TICKLESS
+#else
+#define CLOCK_TICKLESS 0
+#endif /* CLOCK_CONF_TICKLESS */
+
+/**
+ * Longest tickless sleep, in ticks. It must be shorter than a TA0R wrap
+ * (65536 / INTERVAL = 256 ticks).
+ */
+#define CLOCK_TICKLESS_MAX 128
+
+/**
+ * Print the percentage of time spent asleep every CLOCK_SLEEP_STATS seconds
+ * (0 for never).
+ */
+#ifdef CLOCK_CONF_SLEEP_STATS
+#define CLOCK_SLEEP_STATS CLOCK_CONF_SLEEP_STATS
+#else
+#define CLOCK_SLEEP_STATS 0
+#endif /* CLOCK_CONF_SLEEP_STATS */
+
+/* Free-running cycle counter, started by clock_init() when PGW_CONF_PROFILE
+ * is set (the overflow interrupt is not wanted otherwise) */
+u32_t clock_cycles(void);
+
+/* Sleeps until an interrupt; called with interrupts disabled when idle */
+void clock_arch_idle(void);
 
 #endif /* __CLOCK_ARCH_H__ */
 
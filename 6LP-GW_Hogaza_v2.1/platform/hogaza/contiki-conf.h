@@ -63,6 +63,19 @@ typedef signed long s32_t;
 
 typedef u32_t clock_time_t;
 
+/*
+ * Put off the clock interrupt while idle, and print the percentage of time
+ * spent asleep every CLOCK_CONF_SLEEP_STATS seconds? (see clock_arch.h)
+ */
+#define CLOCK_CONF_TICKLESS		1
+#define CLOCK_CONF_SLEEP_STATS	0
+
+/*
+ * Receive Ethernet frames on the ENC28J60 interrupt? The MCU only sleeps if
+ * so, since otherwise the Ethernet driver polls itself (see eth_driver.h).
+ */
+#define ETH_DRIVER_CONF_RX_INT	0
+
 #include "clock_arch.h"
 
 /*
@@ -183,7 +196,16 @@ typedef unsigned int uip_stats_t;
 /*
  * 6LoWPAN fragmentation support
  */
-#define SICSLOWPAN_CONF_FRAG                    0
+#define SICSLOWPAN_CONF_FRAG                    1
+/*
+ * Concurrent reassemblies and the memory (bytes) they share. The 16 KB of
+ * RAM do not leave room for a full-size (1280-byte) datagram per context:
+ * one such datagram takes the whole pool, and the 4 contexts can only be
+ * used at once by datagrams of up to 320 bytes (5 blocks of 64 bytes). A
+ * fragment that finds the pool exhausted drops its datagram.
+ */
+#define SICSLOWPAN_CONF_REASS_CONTEXTS          4
+#define SICSLOWPAN_CONF_REASS_BUF_SIZE          1280
 
 /*
  * Does the local-host behave as router?
@@ -239,5 +261,24 @@ typedef unsigned int uip_stats_t;
  */
 #define MAX_6LOWPAN_NEIGHBORS	25
 
+/*
+ * Bridge cache size and number of slots of its hash index (power of two)
+ */
+#define PGW_CONF_BRIDGE_ENTRIES		30
+#define PGW_CONF_BRIDGE_HASH_SIZE	64
+
+/*
+ * Keep 6LP-GW statistics?
+ */
+#define PGW_CONF_STATISTICS		0
+
+/*
+ * Time the processing of each kind of message (see pgw.h), and run the ND
+ * benchmark (see pgw_bench.c) at start-up? The benchmark prints through the
+ * debugger's terminal I/O.
+ */
+#define PGW_CONF_PROFILE		0
+#define PGW_CONF_BENCH			0
+
 
 #endif /* CONTIKI_CONF_H */
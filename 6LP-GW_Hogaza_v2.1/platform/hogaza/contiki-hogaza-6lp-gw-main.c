@@ -14,9 +14,15 @@
 #include "sys/procinit.h"
 #include "contiki-net.h"
 #include "dev/leds_hogaza.h"
+#include "dev/buttons.h"
 #include "dev/msp430_arch.h"
+#include "dev/spi_dma.h"
+#include "dev/radio_driver.h"
 #include "clock_arch.h"
+#include "net/pgw_netstack.h"
 #include "net/p-gw/pgw.h"
+#include "net/p-gw/pgw_bench.h"
+#include "net/p-gw/pgw_nd.h"
 #include "net/uipv4/uipv4.h"
 #include "dhcpc/dhcp-client.h"
 
@@ -24,6 +30,33 @@
 #define 	WAFERIPOSX		0x01A0E
 #define 	WAFERIPOSY		0x01A10
 
+#if PGW_STATISTICS
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints the statistics of the 6LP-GW through the debugger's terminal I/O
+ * when button 1 is pressed: link quality of each 6LN, registration latency,
+ * egress of each interface and packet buffers.
+ */
+PROCESS(pgw_stats_process, "6LP-GW statistics");
+
+PROCESS_THREAD(pgw_stats_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  buttons_register(&pgw_stats_process);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_MSG &&
+                             ((buttons_message_t *)data)->button == BUTTON1);
+    pgw_nbr_link_print();
+    pgw_dad_print();
+    pgw_txq_print("radio", &radio_tx_queue.stats);
+    pgw_txq_print("eth", &eth_tx_stats);
+    pgw_pbuf_print();
+  }
+
+  PROCESS_END();
+}
+#endif /* PGW_STATISTICS */
 /*---------------------------------------------------------------------------*/
 #pragma FUNC_NEVER_RETURNS(main);
 void
@@ -32,6 +65,7 @@ main(void)
 
   msp430_init();
   clock_init();
+  spi_dma_init();
 
   /* initialize uip variables */
   memset(uip_buf, 0, UIP_CONF_BUFFER_SIZE);
@@ -82,13 +116,34 @@ main(void)
   /* Initialize stack protocols */
   pgw_netstack_init();
 
+#if PGW_BENCH
+  /* Measure the 6LP-GW before it sees any real traffic */
+  pgw_bench_run(PGW_BENCH_NODES, PGW_BENCH_ROUNDS);
+#endif /* PGW_BENCH */
+
   /* Initialice the DHCP client */
   process_start(&dhcp_process, NULL);
 
+#if PGW_STATISTICS
+  process_start(&pgw_stats_process, NULL);
+#endif /* PGW_STATISTICS */
+
   /* Enter main loop */
   while(1) {
-	/* poll every running process which has requested to be polled */
-	process_run();
-	/* etimer_request_poll() called in timer interrupt routine */
+	/* run every process which has been polled or has events pending */
+	while(process_run() > 0);
+	/*
+	 * Nothing to do: sleep until an interrupt polls a process (the drivers
+	 * are polled from the ENC28J60 and CC2520 interrupts, and etimers from
+	 * the timer interrupt, see MSP430_WAKEUP_ON_EXIT()). The check is done
+	 * with interrupts disabled and the low power mode is entered setting GIE
+	 * at the same time, so that a wake-up cannot be missed.
+	 */
+	_disable_interrupts();
+	if(process_nevents() == 0) {
+	  clock_arch_idle();
+	} else {
+	  _enable_interrupts();
+	}
   }
 }
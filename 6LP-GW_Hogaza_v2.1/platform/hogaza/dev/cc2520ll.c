@@ -9,15 +9,30 @@
  */
 
 #include "dev/cc2520ll.h"
+#include <string.h>
 
 /*----------------------------------------------------------------------------*/
 /**
  * LOCAL VARIABLES
  */
 static cc2520ll_cfg_t pConfig;
-static u8_t rxMpdu[128];
-static ringbuf_t rxBuffer;
-static u8_t buffer[CC2520_BUF_LEN];
+/* Frames completed in the RX FIFO, counted by cc2520ll_packetReceivedISR() */
+static volatile u8_t rxFrames;
+/* Frames moved out of the RX FIFO by cc2520ll_packetReceivedISR() */
+static framering_t rxRing;
+static u8_t rxRingBuf[CC2520_BUF_LEN];
+/* Times the RX FIFO overflowed (the frames in it were lost) */
+static u16_t rxOverflows;
+/* Status word of the last frame read: RSSI and correlation value (LQI) */
+static s8_t rxRssi;
+static u8_t rxLqi;
+/* Sequence number of the last acknowledgment read, if rxAckValid */
+static volatile u8_t rxAckSeq;
+static volatile u8_t rxAckValid;
+/* Called from cc2520ll_txDoneISR() when a frame has been sent */
+static void (* txDoneHandler)(void);
+/* Called from cc2520ll_packetReceivedISR() when a frame has been received */
+static void (* rxHandler)(void);
 
 /*
  * Recommended register settings which differ from the data sheet
@@ -343,8 +358,8 @@ cc2520ll_init()
   	return FAILED;
   }
 
-  /* initialize the ring buffer */
-  ringbuf_init(&rxBuffer, buffer, sizeof(buffer));
+  rxFrames = 0;
+  framering_init(&rxRing, rxRingBuf, sizeof(rxRingBuf));
 
   _disable_interrupts();
 
@@ -468,6 +483,106 @@ cc2520ll_transmit()
 }
 /*----------------------------------------------------------------------------*/
 
+/**
+ * @fn      cc2520ll_txStart
+ *
+ * @brief   Non-blocking version of cc2520ll_transmit(). Tries once to start
+ *          the transmission of the frame in the TX FIFO with Clear Channel
+ *          Assessment. If the channel is clear, cc2520ll_txDoneISR() fires when
+ *          the frame has been sent. Otherwise, the caller shall retry later or
+ *          give up with cc2520ll_txAbort().
+ *
+ * @param   none
+ *
+ * @return  SUCCESS if the transmission has begun, FAILED otherwise
+ */
+/*----------------------------------------------------------------------------*/
+u16_t
+cc2520ll_txStart(void)
+{
+  if (!CC2520_RSSI_VALID_PIN) {
+    return FAILED;
+  }
+
+  /* Reuse GPIO2 for TX_FRM_DONE exception */
+  _disable_interrupts();
+  CC2520_CFG_GPIO_OUT(2, 1 + CC2520_EXC_TX_FRM_DONE);
+  CC2520_INS_STROBE(CC2520_INS_STXONCCA);
+  _enable_interrupts();
+
+  if (!CC2520_SAMPLED_CCA_PIN) {
+    /* Channel busy */
+    _disable_interrupts();
+    CC2520_CFG_GPIO_OUT(2, CC2520_GPIO_RSSI_VALID);
+    _enable_interrupts();
+    return FAILED;
+  }
+
+  /* Interrupt on the rising edge of TX_FRM_DONE */
+  P2IES &= ~BIT2;
+  P2IFG &= ~BIT2;
+  P2IE |= BIT2;
+  return SUCCESS;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      cc2520ll_txAbort
+ *
+ * @brief   Discards the frame in the TX FIFO.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+/*----------------------------------------------------------------------------*/
+void
+cc2520ll_txAbort(void)
+{
+  _disable_interrupts();
+  CC2520_INS_STROBE(CC2520_INS_SFLUSHTX);
+  CC2520_CFG_GPIO_OUT(2, CC2520_GPIO_RSSI_VALID);
+  _enable_interrupts();
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      cc2520ll_setTxDoneHandler
+ *
+ * @brief   Sets the function to be called (in interrupt context) when a frame
+ *          started with cc2520ll_txStart() has been sent.
+ *
+ * @param   f - the handler
+ *
+ * @return  none
+ */
+/*----------------------------------------------------------------------------*/
+void
+cc2520ll_setTxDoneHandler(void (* f)(void))
+{
+  txDoneHandler = f;
+  register_port2IntHandler(2, cc2520ll_txDoneISR);
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      cc2520ll_setRxHandler
+ *
+ * @brief   Sets the function to be called (in interrupt context) when a frame
+ *          has been received in the RX FIFO.
+ *
+ * @param   f - the handler
+ *
+ * @return  none
+ */
+/*----------------------------------------------------------------------------*/
+void
+cc2520ll_setRxHandler(void (* f)(void))
+{
+  rxHandler = f;
+}
+/*----------------------------------------------------------------------------*/
+
 /**
  * @fn      cc2520ll_packetSend
  *
@@ -517,6 +632,8 @@ cc2520ll_prepare(const void *packet, unsigned short len)
 	len += 2;
 	cc2520ll_writeTxBuf(&len, 1);
 	cc2520ll_writeTxBuf(packet, len-2);
+	/* Only acknowledgments read from now on are for this frame */
+	rxAckValid = 0;
 	
 	/* Turn on RX frame done interrupt for ACK reception */
 	cc2520ll_enableRxInterrupt();
@@ -569,54 +686,253 @@ cc2520ll_rxtx_packet()
 }
 /*----------------------------------------------------------------------------*/
 
+/**
+ * @fn          cc2520ll_maskInterrupts
+ *
+ * @brief       Masks the RX and TX done interrupts, so that their routines do
+ *              not use the SPI interface while a frame is read from the RX
+ *              FIFO. Edges are still latched, and served by
+ *              cc2520ll_unmaskInterrupts().
+ *
+ * @return      u8_t - the interrupts that were enabled
+ */
+/*----------------------------------------------------------------------------*/
+static u8_t
+cc2520ll_maskInterrupts(void)
+{
+  u8_t ie;
+
+  _disable_interrupts();
+  ie = P2IE & ((1 << CC2520_INT_PIN) | BIT2);
+  P2IE &= ~ie;
+  _enable_interrupts();
+  return ie;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_unmaskInterrupts
+ *
+ * @brief       Enables again the interrupts masked by cc2520ll_maskInterrupts()
+ *
+ * @param       ie - the value returned by cc2520ll_maskInterrupts()
+ *
+ * @return      none
+ */
+/*----------------------------------------------------------------------------*/
+static void
+cc2520ll_unmaskInterrupts(u8_t ie)
+{
+  P2IE |= ie;
+}
+/*----------------------------------------------------------------------------*/
+
 /**
  * @fn          cc2520ll_pending_packet
  *
- * @brief       Returns true if there is data to be read in the receive buffer.
+ * @brief       Returns true if there is a complete frame in the receive ring
+ *              or in the RX FIFO. The RX frame done exception is cleared when
+ *              sending (see cc2520ll_prepare()), so besides the frames counted
+ *              by the ISR, any byte in the FIFO while no frame is being
+ *              received belongs to a complete frame.
  * @return      u8_t - a number != 0 if there isnew data to be read, 0 otherwise.
  */
 /*----------------------------------------------------------------------------*/
 u16_t
 cc2520ll_pending_packet(void)
 {
-  return ringbuf_length(&rxBuffer);
+  u8_t ie;
+  u8_t count;
+  u8_t *pFrame;
+
+  if (framering_peek(&rxRing, &pFrame) > 0) {
+    return 1;
+  }
+  if (rxFrames > 0) {
+    return rxFrames;
+  }
+  if (cc2520ll_rxtx_packet()) {
+    return 0;
+  }
+  ie = cc2520ll_maskInterrupts();
+  count = CC2520_REGRD8(CC2520_RXFIFOCNT);
+  cc2520ll_unmaskInterrupts(ie);
+  return count;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_fifoRead
+ *
+ * @brief       Reads the oldest frame in the RX FIFO into a buffer. The
+ *              CC2520 interrupts must be masked, or this be called from them.
+ *
+ * @param       packet - pointer to data buffer to fill
+ *              maxlen - Maximum number of bytes to read from buffer
+ *
+ * @return      u8_t - number of bytes copied into buffer (FCS included), 0 if
+ *              the frame was dropped (acknowledgment, bad CRC or too long).
+ *              The sequence number of an acknowledgment is kept for
+ *              cc2520ll_ackReceived().
+ */
+/*----------------------------------------------------------------------------*/
+static u8_t
+cc2520ll_fifoRead(u8_t* packet, u8_t maxlen)
+{
+  u8_t len;
+  u8_t *pStatusWord;
+
+  if (CC2520_REGRD8(CC2520_EXCFLAG0) & (1 << CC2520_EXC_RX_OVERFLOW)) {
+    /* Reception stopped and the frames in the FIFO are lost */
+    CC2520_SFLUSHRX();
+    CC2520_SFLUSHRX();
+    CC2520_CLEAR_EXC(CC2520_EXC_RX_OVERFLOW);
+    rxFrames = 0;
+    rxOverflows++;
+    return 0;
+  }
+  /* Read payload length. Ignore MSB */
+  len = CC2520_RXBUF8() & CC2520_PLD_LEN_MASK;
+  if (len > maxlen || len < 2) {
+    /* It cannot be skipped: drop everything in the FIFO */
+    CC2520_SFLUSHRX();
+    CC2520_SFLUSHRX();
+    rxFrames = 0;
+    return 0;
+  }
+  cc2520ll_readRxBuf(packet, len);
+  if (rxFrames > 0) {
+    rxFrames--;
+  }
+  /* The FCS is replaced by the RSSI and the CRC_OK bit and correlation */
+  pStatusWord = packet + len - 2;
+  if (!(pStatusWord[1] & CC2520_CRC_OK_BM)) {
+    return 0;
+  }
+  if (len == CC2520_ACK_PACKET_SIZE) {
+    /* Only ack packets may be 5 bytes in total: FCF, DSN and FCS */
+    rxAckSeq = packet[2];
+    rxAckValid = 1;
+    return 0;
+  }
+  return len;
 }
 /*----------------------------------------------------------------------------*/
 
 /**
  * @fn          cc2520ll_packetReceive
  *
- * @brief       Copies the payload of the last incoming packet into a buffer
+ * @brief       Reads the oldest received frame into a buffer, and keeps its
+ *              RSSI and LQI (see cc2520ll_rssi()). Frames moved to the
+ *              receive ring by the ISR are older than those left in the RX
+ *              FIFO, which are read from it straight into the buffer. Only
+ *              call it if cc2520ll_pending_packet() is true.
  *
  * @param       packet - pointer to data buffer to fill. This buffer must be
  *                        allocated by higher layer.
  *              maxlen - Maximum number of bytes to read from buffer
  *
- * @return      u8_t - number of bytes actually copied into buffer
+ * @return      u8_t - number of bytes copied into buffer (FCS included), 0 if
+ *              the frame was dropped (acknowledgment, bad CRC or too long).
  */
 /*----------------------------------------------------------------------------*/
 u16_t
 cc2520ll_packetReceive(u8_t* packet, u8_t maxlen)
 {
-  u8_t len = 0;
-	
-  _disable_interrupts();
-  if(ringbuf_length(&rxBuffer)) {
-    ringbuf_get(&rxBuffer, &len, 1);
-    /* The first byte in the packet is the packet's length */
-    /* but it does not count the length field itself */
+  u8_t ie;
+  u8_t len;
+  u8_t *pFrame;
+
+  /* The ISR must not move a frame to the ring between both checks */
+  ie = cc2520ll_maskInterrupts();
+  len = framering_peek(&rxRing, &pFrame);
+  if (len > 0) {
     if (len > maxlen) {
-      ringbuf_flush(&rxBuffer);
       len = 0;
     } else {
-      len = ringbuf_get(&rxBuffer, packet, len);
+      memcpy(packet, pFrame, len);
     }
+    framering_release(&rxRing);
+  } else {
+    len = cc2520ll_fifoRead(packet, maxlen);
+  }
+  cc2520ll_unmaskInterrupts(ie);
+  if (len > 0) {
+    /* The status word replaces the FCS: RSSI, and CRC_OK bit and correlation */
+    rxRssi = (s8_t)packet[len - 2];
+    rxLqi = packet[len - 1] & ~CC2520_CRC_OK_BM;
   }
-  _enable_interrupts();
   return len;
 }
 /*----------------------------------------------------------------------------*/
 
+/**
+ * @fn          cc2520ll_ackReceived
+ *
+ * @brief       Tells whether the acknowledgment of the frame with sequence
+ *              number seq has been read from the RX FIFO since the frame was
+ *              prepared with cc2520ll_prepare()
+ *
+ * @param       seq - the data sequence number of the frame
+ *
+ * @return      u8_t - 1 if so, 0 otherwise
+ */
+/*----------------------------------------------------------------------------*/
+u8_t
+cc2520ll_ackReceived(u8_t seq)
+{
+  return rxAckValid && rxAckSeq == seq;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_rssi
+ *
+ * @brief       Returns the RSSI of the last frame read by
+ *              cc2520ll_packetReceive()
+ *
+ * @return      s8_t - the RSSI, in dBm plus the CC2520 offset (76)
+ */
+/*----------------------------------------------------------------------------*/
+s8_t
+cc2520ll_rssi(void)
+{
+  return rxRssi;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_lqi
+ *
+ * @brief       Returns the correlation value of the last frame read by
+ *              cc2520ll_packetReceive(), used as its LQI
+ *
+ * @return      u8_t - the correlation value (0 to 127)
+ */
+/*----------------------------------------------------------------------------*/
+u8_t
+cc2520ll_lqi(void)
+{
+  return rxLqi;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_rxOverflows
+ *
+ * @brief       Returns the number of times the RX FIFO overflowed, losing the
+ *              packets in it.
+ *
+ * @return      u16_t - the number of overflows
+ */
+/*----------------------------------------------------------------------------*/
+u16_t
+cc2520ll_rxOverflows(void)
+{
+  return rxOverflows;
+}
+/*----------------------------------------------------------------------------*/
+
 /**
  * @fn      cc2520ll_receiveOn
  *
@@ -702,39 +1018,50 @@ cc2520ll_enableRxInterrupt()
 static void
 cc2520ll_packetReceivedISR(void)
 {
-  cc2520ll_packetHdr_t *pHdr;
-  u8_t *pStatusWord;
-    
-  /* Map header to packet buffer */
-  pHdr = (cc2520ll_packetHdr_t*)rxMpdu;
-  /* Clear interrupt and disable new RX frame done interrupt */
-  cc2520ll_disableRxInterrupt();
-  /* Read payload length. */
-  cc2520ll_readRxBuf(rxMpdu, 1);
-  /* Ignore MSB */
-  rxMpdu[0] &= CC2520_PLD_LEN_MASK;
-  pHdr->packetLength = rxMpdu[0];
-
-  /* Is this an acknowledgment packet? */
-  /* Only ack packets may be 5 bytes in total. */
-  if (pHdr->packetLength != CC2520_ACK_PACKET_SIZE) {
-    /* It is assumed that the radio rejects packets with invalid length.
-     * Subtract the number of bytes in the frame overhead to get actual
-     * payload */
-    cc2520ll_readRxBuf(&rxMpdu[1], pHdr->packetLength);
-    /* Read the FCS to get the RSSI and CRC */
-    pStatusWord = rxMpdu + pHdr->packetLength + 1 - 2;
-    /* Notify the application about the received data packet if the CRC is OK */
-    if(pStatusWord[1] & CC2520_CRC_OK_BM) {
-      /* All ok; copy received frame to ring buffer */
-	  ringbuf_put(&rxBuffer, rxMpdu, rxMpdu[0] + 1);
+  u8_t *pFrame;
+  u8_t len;
+
+  /* Clear interrupt and exception */
+  P2IFG &= ~(1 << CC2520_INT_PIN);
+  CLEAR_EXC_RX_FRM_DONE();
+  rxFrames++;
+  /* 
+   * Move the complete frames to the receive ring, so that the 128-byte FIFO
+   * has room for the next ones (back-to-back fragments would overflow it).
+   * While the ring is full, they stay in the FIFO until the radio process
+   * reads them with cc2520ll_packetReceive().
+   */
+  while (rxFrames > 0 &&
+         (pFrame = framering_reserve(&rxRing, MAX_802154_PACKET_SIZE)) != NULL) {
+    len = cc2520ll_fifoRead(pFrame, MAX_802154_PACKET_SIZE);
+    if (len > 0) {
+      framering_commit(&rxRing, len);
     }
-    /* Flush the cc2520 rx buffer to prevent residual data */
-      CC2520_SFLUSHRX();
   }
-  /* Enable RX frame done interrupt again */
-  cc2520ll_enableRxInterrupt();
-  /* Clear interrupt flag */
-  P2IFG &= ~(1 << CC2520_INT_PIN);
+  if (rxHandler != 0) {
+    rxHandler();
+  }
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn          cc2520ll_txDoneISR
+ *
+ * @brief       Interrupt service routine for TX_FRM_DONE
+ *
+ * @return      none
+ */
+/*----------------------------------------------------------------------------*/
+void
+cc2520ll_txDoneISR(void)
+{
+  P2IE &= ~BIT2;
+  P2IFG &= ~BIT2;
+  CC2520_CLEAR_EXC(CC2520_EXC_TX_FRM_DONE);
+  /* Reconfigure GPIO2 */
+  CC2520_CFG_GPIO_OUT(2, CC2520_GPIO_RSSI_VALID);
+  if (txDoneHandler != 0) {
+    txDoneHandler();
+  }
 }
 /*----------------------------------------------------------------------------*/
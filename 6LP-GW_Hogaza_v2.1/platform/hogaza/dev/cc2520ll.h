@@ -7,7 +7,7 @@
 #include "dev/hal_cc2520.h"
 #include "contiki.h"
 #include "net/rime/rimeaddr.h"
-#include "utils/ringbuf.h"
+#include "utils/framering.h"
 
 
 /* peripheral interface pin definitions */
@@ -26,8 +26,11 @@
 #define MSP430_USECOND			16
 /* A milisecond in msp430 cycles at 16MHz */
 #define MSP430_MSECOND			16000
-/* Ring buffer length */
-#define CC2520_BUF_LEN					512
+/* 
+ * Receive frame ring length. It holds the frames moved out of the 128-byte
+ * RX FIFO by the receive ISR: two full-size frames at any ring position.
+ */
+#define CC2520_BUF_LEN					384
 /* Startup time values (in microseconds) */
 #define CC2520_XOSC_MAX_STARTUP_TIME        300
 #define CC2520_VREG_MAX_STARTUP_TIME        200
@@ -212,7 +215,16 @@ u16_t cc2520ll_init();
 u16_t cc2520ll_prepare(const void *packet, unsigned short len);
 u16_t cc2520ll_transmit(void);
 u16_t cc2520ll_packetSend(const void* packet, unsigned short len);
+u16_t cc2520ll_txStart(void);
+void cc2520ll_txAbort(void);
+void cc2520ll_setTxDoneHandler(void (* f)(void));
+void cc2520ll_setRxHandler(void (* f)(void));
+u16_t cc2520ll_rxtx_packet(void);
 u16_t cc2520ll_packetReceive(u8_t * packet, u8_t  maxlen);
+u8_t cc2520ll_ackReceived(u8_t seq);
+s8_t cc2520ll_rssi(void);
+u8_t cc2520ll_lqi(void);
+u16_t cc2520ll_rxOverflows(void);
 u16_t cc2520ll_pending_packet(void);
 void cc2520ll_receiveOn(void);
 void cc2520ll_receiveOff(void);
@@ -221,5 +233,6 @@ void cc2520ll_enableRxInterrupt(void);
 
 // Interrupt handler routines
 void cc2520ll_packetReceivedISR(void);
+void cc2520ll_txDoneISR(void);
 
 #endif /*CC2520_H_*/
@@ -1,10 +1,16 @@
 // enc28j60.c: device driver for the ENC28J60 chip.
 
 #include "enc28j60.h"
+#include "spi_dma.h"
+#include "msp430_arch.h"
 #include <msp430f5435a.h>
 
 unsigned char Enc28j60Bank;
 unsigned int NextPacketPtr;
+// length (including CRC) of the frame being read, see enc28j60PacketPeek()
+static unsigned int CurrentPacketLen;
+// called from the INT pin interrupt, see enc28j60SetRxHandler()
+static void (* RxHandler)(void);
 
 void _enc28j60Delay(unsigned x){
 	for(x; x > 0; x--){
@@ -83,9 +89,7 @@ void enc28j60ReadBuffer(unsigned int len, unsigned char* data) {
 	assertCS();
 
 	spi_rw_byte(ENC28J60_READ_BUF_MEM);		// issue read command
-	while(len--) {
-		*data++ = spi_rw_byte(0);
-	}
+	spi_dma_read(SPI_BUS_ENC28J60, data, len);
 	releaseCS();
 }
 
@@ -94,9 +98,7 @@ void enc28j60WriteBuffer(unsigned int len, unsigned char* data) {
 	assertCS();
 
 	spi_rw_byte(ENC28J60_WRITE_BUF_MEM);		// issue write command
-	while(len--) {
-		spi_rw_byte(*data++);
-	}
+	spi_dma_write(SPI_BUS_ENC28J60, data, len);
 	releaseCS();
 }
 
@@ -187,8 +189,9 @@ int enc28j60_init(void) {
 	enc28j60Write(ETXNDH, TXEND_INIT>>8);
 	// disable filter out of multicast packets
 	//enc28j60Write(ERXFCON, 0xA3);	
-	// All packet with a valid CRC will be accepted.	
-	enc28j60Write(ERXFCON, 0x20);
+	// All packet with a valid CRC will be accepted, until upper layers
+	// install a filter with enc28j60SetRxFilter()
+	enc28j60Write(ERXFCON, ERXFCON_CRCEN);
 	
 	// do bank 2 stuff
 	// enable MAC receive
@@ -229,6 +232,12 @@ int enc28j60_init(void) {
 
 
 void enc28j60PacketSend(unsigned int len, unsigned char* packet) {
+	enc28j60PacketSendBegin(len);
+	enc28j60PacketSendData(len, packet);
+	enc28j60PacketSendEnd();
+}
+
+void enc28j60PacketSendBegin(unsigned int len) {
 
 	// Set the write pointer to start of transmit buffer area
 	enc28j60Write(EWRPTL, TXSTART_INIT&0xFF);
@@ -240,10 +249,15 @@ void enc28j60PacketSend(unsigned int len, unsigned char* packet) {
 
 	// write per-packet control byte
 	enc28j60WriteOp(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
+}
 
-	// copy the packet into the transmit buffer
-	enc28j60WriteBuffer(len, packet);
+void enc28j60PacketSendData(unsigned int len, unsigned char* data) {
+	// copy the piece into the transmit buffer, right after the previous one
+	// (the write pointer is auto-incremented)
+	enc28j60WriteBuffer(len, data);
+}
 
+void enc28j60PacketSendEnd(void) {
 	// workaround due to errata#10
 	// perform transmit only reset
 	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
@@ -264,13 +278,39 @@ void enc28j60PacketSend(unsigned int len, unsigned char* packet) {
 #endif
 }
 
+static void enc28j60RxISR(void) {
+	ENC_INT_IFG &= ~(1<<ENC_INT);
+	if (RxHandler != 0) {
+		RxHandler();
+	}
+}
+
+void enc28j60SetRxHandler(void (* f)(void)) {
+	_disable_interrupts();
+	RxHandler = f;
+	// INT as input, interrupt on the Hi/Lo edge
+	ENC_INT_SEL &= ~(1<<ENC_INT);
+	ENC_INT_DIR &= ~(1<<ENC_INT);
+	ENC_INT_IES |= (1<<ENC_INT);
+	ENC_INT_IFG &= ~(1<<ENC_INT);
+	register_port1IntHandler(ENC_INT, enc28j60RxISR);
+	ENC_INT_IE |= (1<<ENC_INT);
+	// assert INT while there are frames pending (EIR.PKTIF)
+	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE|EIE_PKTIE);
+	_enable_interrupts();
+}
+
 int enc28j60_pending_packet() {
 	return enc28j60Read(EPKTCNT);
 }
 
-unsigned int enc28j60PacketReceive(unsigned int maxlen, unsigned char* packet) {
+// Reads the receive status vector of the next frame and its first hdrlen
+// bytes into hdr, leaving the frame in the controller's buffer. The frame
+// must then be either read with enc28j60PacketReadRest() or dropped with
+// enc28j60PacketSkip(). Returns the frame length (including CRC), or 0 if
+// there is no frame.
+unsigned int enc28j60PacketPeek(unsigned int hdrlen, unsigned char* hdr) {
 	unsigned int rxstat;
-	unsigned int len;
 
 	// check if a packet has been received and buffered
 	if(!enc28j60Read(EPKTCNT)){
@@ -284,20 +324,64 @@ unsigned int enc28j60PacketReceive(unsigned int maxlen, unsigned char* packet) {
 	NextPacketPtr  = enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0);
 	NextPacketPtr |= enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0)<<8;
 
-	//debug
 	// read the packet length
-	len  = enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0);
-	len |= enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0)<<8;
+	CurrentPacketLen  = enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0);
+	CurrentPacketLen |= enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0)<<8;
 	// read the receive status
 	rxstat  = enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0);
 	rxstat |= enc28j60ReadOp(ENC28J60_READ_BUF_MEM, 0)<<8;
 
+	// copy the header from the receive buffer. ERDPT wraps around the end
+	// of the receive buffer by itself
+	enc28j60ReadBuffer(MIN(hdrlen, CurrentPacketLen), hdr);
+
+	return CurrentPacketLen;
+}
+
+// Reads the rest of a frame whose first hdrlen bytes were already read by
+// enc28j60PacketPeek() into packet, and releases it. Returns the number of
+// bytes of the frame in packet.
+unsigned int enc28j60PacketReadRest(unsigned int hdrlen, unsigned int maxlen, unsigned char* packet) {
+	unsigned int len;
+
 	// limit retrieve length
-	len = MIN(len, maxlen);
+	len = MIN(CurrentPacketLen, maxlen);
+
+	// copy the rest of the packet from the receive buffer
+	if (len > hdrlen) {
+		enc28j60ReadBuffer(len - hdrlen, packet + hdrlen);
+	}
+	enc28j60PacketSkip();
+
+	return len;
+}
+
+// Same as enc28j60PacketReadRest(), but the rest of the frame is read by DMA
+// in the background. CS stays asserted until enc28j60PacketReadEnd().
+unsigned int enc28j60PacketReadRestAsync(unsigned int hdrlen, unsigned int maxlen, unsigned char* packet, spi_dma_callback_t done, void *ptr) {
+	unsigned int len;
 
-	// copy the packet from the receive buffer
-	enc28j60ReadBuffer(len, packet);
+	len = MIN(CurrentPacketLen, maxlen);
+	if (len <= hdrlen) {
+		return 0;
+	}
+	assertCS();
+	spi_rw_byte(ENC28J60_READ_BUF_MEM);		// issue read command
+	if (!spi_dma_transfer_async(SPI_BUS_ENC28J60, NULL, packet + hdrlen,
+															len - hdrlen, done, ptr)) {
+		releaseCS();
+		return 0;
+	}
+	return len;
+}
+
+void enc28j60PacketReadEnd(void) {
+	releaseCS();
+	enc28j60PacketSkip();
+}
 
+// Releases the frame being read, without copying the rest of it.
+void enc28j60PacketSkip(void) {
 	// Move the RX read pointer to the start of the next received packet
 	// This frees the memory we just read out
 	// (workaround is needed due to errata #11)
@@ -312,8 +396,52 @@ unsigned int enc28j60PacketReceive(unsigned int maxlen, unsigned char* packet) {
 
 		// decrement the packet counter indicate we are done with this packet
 	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PKTDEC);
+}
 
-	return len;
+unsigned int enc28j60PacketReceive(unsigned int maxlen, unsigned char* packet) {
+	if (!enc28j60PacketPeek(0, packet)) {
+		return 0;
+	}
+	return enc28j60PacketReadRest(0, maxlen, packet);
+}
+
+void enc28j60HashAdd(unsigned char* table, const unsigned char* addr) {
+	unsigned long crc = 0xFFFFFFFF;
+	unsigned char i, j, b;
+
+	// CRC-32 of the destination address, as computed by the MAC for the FCS
+	// (bytes in transmission order, least significant bit first)
+	for(i = 0; i < 6; i++){
+		b = addr[i];
+		for(j = 0; j < 8; j++){
+			if(((crc >> 31) ^ b) & 0x01){
+				crc = (crc << 1) ^ 0x04C11DB7;
+			} else {
+				crc <<= 1;
+			}
+			b >>= 1;
+		}
+	}
+	// bits 28:23 point to the hash table bit: 28:26 select the EHTn register
+	// and 25:23 the bit inside it
+	i = (crc >> 23) & 0x3F;
+	table[i >> 3] |= 1 << (i & 0x07);
+}
+
+void enc28j60SetRxFilter(const unsigned char* table) {
+	unsigned char i;
+
+	if(!table){
+		enc28j60Write(ERXFCON, ERXFCON_CRCEN);
+		return;
+	}
+	// disable the hash filter while the table is not consistent
+	enc28j60Write(ERXFCON, ERXFCON_CRCEN|ERXFCON_BCEN);
+	for(i = 0; i < 8; i++){
+		enc28j60Write(EHT0 + i, table[i]);
+	}
+	// OR mode: a frame is accepted if it matches any of the enabled filters
+	enc28j60Write(ERXFCON, ERXFCON_CRCEN|ERXFCON_HTEN|ERXFCON_BCEN);
 }
 
 unsigned long int enc28j60BlinkLeds(unsigned long int interval, unsigned char times){
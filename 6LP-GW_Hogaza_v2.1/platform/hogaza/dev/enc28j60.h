@@ -2,6 +2,7 @@
 #define __ENC28J60_H__
 
 #include "contiki.h"
+#include "dev/spi_dma.h"
 
 
 /*! \file enc28j60.h \brief Microchip ENC28J60 Ethernet Interface Driver. */
@@ -53,6 +54,17 @@
 // reset pin is in port 3, pin 3 and is low active
 #define ENC_RESET_PORT		P1OUT
 #define ENC_RESET			3
+// ENC28J60 interrupt pin
+// INT is taken to be in port 1, pin 2, which has not been checked against the
+// board schematic: it is only used with ETH_DRIVER_CONF_RX_INT (see
+// eth_driver.h). INT is low active and asserted while received frames are
+// pending (EIE.PKTIE), see enc28j60SetRxHandler()
+#define ENC_INT_DIR			P1DIR
+#define ENC_INT_SEL			P1SEL
+#define ENC_INT_IES			P1IES
+#define ENC_INT_IFG			P1IFG
+#define ENC_INT_IE			P1IE
+#define ENC_INT				2
 
 // ENC28J60 Control Registers
 // Control register definitions are a combination of address,
@@ -198,6 +210,15 @@
 #define	ECON1_RXEN		0x04
 #define ECON1_BSEL1		0x02
 #define ECON1_BSEL0		0x01
+// ENC28J60 ERXFCON Register Bit Definitions
+#define ERXFCON_UCEN	0x80
+#define ERXFCON_ANDOR	0x40
+#define ERXFCON_CRCEN	0x20
+#define ERXFCON_PMEN	0x10
+#define ERXFCON_MPEN	0x08
+#define ERXFCON_HTEN	0x04
+#define ERXFCON_MCEN	0x02
+#define ERXFCON_BCEN	0x01
 // ENC28J60 MACON1 Register Bit Definitions
 #define MACON1_TXPAUS	0x08
 #define MACON1_RXPAUS	0x04
@@ -340,6 +361,25 @@ int enc28j60_init(void);
 /// \param packet	Pointer to packet data.
 void enc28j60PacketSend(unsigned int len, unsigned char* packet);
 
+//! Segmented packet transmit functions.
+/// Send a packet given in several pieces: enc28j60PacketSendBegin() with the
+/// total length, enc28j60PacketSendData() for each piece, in order, and
+/// enc28j60PacketSendEnd() to transmit it. The pieces are streamed to the
+/// controller's transmit buffer as they come.
+/// \param len		Length of the whole packet (Begin) or of the piece (Data).
+/// \param data	Pointer to the piece.
+void enc28j60PacketSendBegin(unsigned int len);
+void enc28j60PacketSendData(unsigned int len, unsigned char* data);
+void enc28j60PacketSendEnd(void);
+
+//! Receive interrupt.
+/// Enables the packet pending interrupt. f is called in interrupt context
+/// when INT is asserted, i.e. when a frame arrives and no other frame was
+/// pending. Frames must then be read until EPKTCNT is 0 for INT to be
+/// asserted again.
+/// \param f		The handler.
+void enc28j60SetRxHandler(void (* f)(void));
+
 //! Packet receive function.
 /// Gets a packet from the network receive buffer, if one is available.
 /// The packet will by headed by an ethernet header.
@@ -348,8 +388,57 @@ void enc28j60PacketSend(unsigned int len, unsigned char* packet);
 /// \return Packet length in bytes if a packet was retrieved, zero otherwise.
 unsigned int enc28j60PacketReceive(unsigned int maxlen, unsigned char* packet);
 
+//! Packet header peek function.
+/// Gets the first bytes of the next packet in the network receive buffer, if
+/// one is available, leaving the packet in the buffer. It must be followed by
+/// a call to enc28j60PacketReadRest() or enc28j60PacketSkip().
+/// \param	hdrlen	Number of bytes to retrieve.
+/// \param	hdr		Pointer where the header bytes should be stored.
+/// \return Packet length in bytes (including CRC) if a packet is available, zero otherwise.
+unsigned int enc28j60PacketPeek(unsigned int hdrlen, unsigned char* hdr);
+
+//! Packet completion function.
+/// Gets the remainder of the packet peeked by enc28j60PacketPeek() and frees it
+/// from the network receive buffer.
+/// \param	hdrlen	Number of bytes already retrieved by enc28j60PacketPeek().
+/// \param	maxlen	The maximum acceptable length of a retrieved packet.
+/// \param	packet	Pointer to the packet data, header included.
+/// \return Packet length in bytes.
+unsigned int enc28j60PacketReadRest(unsigned int hdrlen, unsigned int maxlen, unsigned char* packet);
+
+//! Background packet completion function.
+/// Starts reading the remainder of the packet peeked by enc28j60PacketPeek()
+/// by DMA. done(ptr) is called from the DMA interrupt once it is in, and the
+/// packet must then be freed with enc28j60PacketReadEnd(). The controller
+/// must not be used in between.
+/// \param	hdrlen	Number of bytes already retrieved by enc28j60PacketPeek().
+/// \param	maxlen	The maximum acceptable length of a retrieved packet.
+/// \param	packet	Pointer to the packet data, header included.
+/// \return Packet length in bytes, or zero if the DMA is busy or there is
+///			nothing left to read (enc28j60PacketReadRest() must be used instead).
+unsigned int enc28j60PacketReadRestAsync(unsigned int hdrlen, unsigned int maxlen, unsigned char* packet, spi_dma_callback_t done, void *ptr);
+
+//! Frees the packet read by enc28j60PacketReadRestAsync().
+void enc28j60PacketReadEnd(void);
+
+//! Packet discard function.
+/// Frees the packet peeked by enc28j60PacketPeek() without retrieving it.
+void enc28j60PacketSkip(void);
+
 int enc28j60_pending_packet();
 
+//! Hash table filter entry function.
+/// Sets the bit of a destination address in a hash table image.
+/// \param	table	8-byte hash table image (EHT0 first).
+/// \param	addr	6-byte destination MAC address.
+void enc28j60HashAdd(unsigned char* table, const unsigned char* addr);
+
+//! Receive filter function.
+/// Accepts only broadcast frames and frames whose destination address is in
+/// the hash table, or every frame if table is NULL.
+/// \param	table	8-byte hash table image (EHT0 first), or NULL.
+void enc28j60SetRxFilter(const unsigned char* table);
+
 unsigned long int enc28j60BlinkLeds(unsigned long int interval, unsigned char times);
 
 void read_TSV(unsigned char *tsv);
@@ -25,9 +25,23 @@
 /* The driver state */
 static eth_driver_state_t eth_state = ETH_DRIVER_OFF;
 
+/* Length of the frame being read (CRC excluded), see peek() */
+static int rx_len;
+
+#if ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD
+/* Periodic check of EPKTCNT, in case a PKTIF interrupt was missed */
+static struct etimer rx_check_timer;
+#endif /* ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD */
+
 static void init(void);
-static void send(const void *payload, unsigned short payload_len);
+static int send(const void *payload, unsigned short payload_len);
+static int sendv(const eth_segment_t *seg, unsigned char count);
 static int read(const void *payload, unsigned short payload_len);
+static int peek(const void *payload, unsigned short peek_len);
+static int read_rest(const void *payload, unsigned short peek_len, unsigned short payload_len);
+static void drop(void);
+static void filter_add(unsigned char *table, const void *addr);
+static void set_filter(const unsigned char *table);
 static int pending_packet(void);
 static void on(void);
 static void on(void);
@@ -44,27 +58,86 @@ PROCESS(eth_driver_process, "eth_driver_process");
  * This is the poll handler function in the process below. This poll handler
  * function checks for incoming packets and forwards them to the right 
  * interface or delivers them to the TCP/IP stack.
+ * Only the headers are read first, so that frames the MAC layer is not 
+ * interested in are dropped in the controller without copying their payload.
+ * Up to ETH_DRIVER_RX_BATCH of the frames counted by EPKTCNT are handled per
+ * poll, instead of going round the scheduler after each of them.
+ * With ETH_DRIVER_RX_INT, the process is polled by the ENC28J60 interrupt 
+ * when a frame arrives, see rx_handler(), and every ETH_DRIVER_RX_CHECK_PERIOD
+ * by rx_check_timer while frames keep arriving. Otherwise it polls itself.
  */
 static void
 pollhandler(void)
 {
-	if (pending_packet()) {
+	int pending;
+	u8_t n;
+	
+	pending = pending_packet();
+#if ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD
+	if (pending > 0) {
+		/* Check again in a while, in case the next interrupt is missed */
+		etimer_set(&rx_check_timer, ETH_DRIVER_RX_CHECK_PERIOD);
+	}
+#endif /* ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD */
+	if (pending > ETH_DRIVER_RX_BATCH) {
+		pending = ETH_DRIVER_RX_BATCH;
+	}
+	for (n = 0; n < pending; n++) {
 		/* Set current incoming interface */
 		incoming_if = IEEE_802_3;
-		/* Read packet */
-		uip_len = read(uip_buf, UIP_BUFSIZE);
-		/* 
-   	 * Forward the packet to the upper level in the stack
-   	 */
-  	NETSTACK_MAC_ETH.input();
+		/* Read the headers */
+		if (peek(uip_buf, ETH_DRIVER_PEEK_LEN) < ETH_DRIVER_PEEK_LEN ||
+				NETSTACK_MAC_ETH.filter()) {
+			/* Runt or unwanted frame */
+			drop();
+		} else {
+			/* Read the rest of the packet */
+			uip_len = read_rest(uip_buf, ETH_DRIVER_PEEK_LEN, UIP_BUFSIZE);
+			/* 
+	   	 * Forward the packet to the upper level in the stack
+	   	 */
+	  	NETSTACK_MAC_ETH.input();
+		}
+	}
+	PGW_STAT(pgw_fwd_rx_batch(&eth_rx_stats, n, ETH_DRIVER_RX_BATCH));
+#if ETH_DRIVER_RX_INT
+	/*
+   * The interrupt is only asserted again once EPKTCNT has dropped to 0, so
+   * if frames are left (or arrived meanwhile) we poll ourselves again.
+   */
+	if (pending_packet() > 0) {
+  	process_poll(&eth_driver_process);
 	}
+#else
 	/*
    * Now we'll make sure that the poll handler is executed repeatedly.
    * We do this by calling process_poll() with this process as its
    * argument.
    */
   process_poll(&eth_driver_process);
+#endif /* ETH_DRIVER_RX_INT */
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Called from the DMA interrupt when the rest of a frame has been read by
+ * read_rest(). Frames may have arrived meanwhile.
+ */
+static void
+rx_dma_done(void *ptr)
+{
+	process_poll(&eth_driver_process);
 }
+#if ETH_DRIVER_RX_INT
+/*---------------------------------------------------------------------------*/
+/*
+ * Called from the ENC28J60 interrupt when a frame arrives.
+ */
+static void
+rx_handler(void)
+{
+	process_poll(&eth_driver_process);
+}
+#endif /* ETH_DRIVER_RX_INT */
 /*---------------------------------------------------------------------------*/
 /*
  * Finally, we define the process that does the work. 
@@ -91,15 +164,28 @@ PROCESS_THREAD(eth_driver_process, ev, data)
   PROCESS_BEGIN();
 
   /*
-   * Now we'll make sure that the poll handler is executed initially. We do
-   * this by calling process_poll() with this process as its argument.
+   * Now we'll make sure that the poll handler is executed initially, to read
+   * any frame received before the interrupt was enabled.
    */
   process_poll(&eth_driver_process);
 
   /*
-   * And we wait for the process to exit.
+   * And we wait for the process to exit, checking for frames left pending
+   * without an interrupt meanwhile. The poll handler sets the timer again
+   * if it finds any.
    */
-	PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_EXIT);
+	while (1) {
+		PROCESS_WAIT_EVENT();
+		if (ev == PROCESS_EVENT_EXIT) {
+			break;
+		}
+#if ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD
+		if (ev == PROCESS_EVENT_TIMER && data == &rx_check_timer &&
+				pending_packet() > 0) {
+			process_poll(&eth_driver_process);
+		}
+#endif /* ETH_DRIVER_RX_INT && ETH_DRIVER_RX_CHECK_PERIOD */
+	}
 
   /*
    * Here ends the process.
@@ -113,15 +199,41 @@ init() {
 	enc28j60_init();
 	on();
 	process_start(&eth_driver_process, NULL);
+#if ETH_DRIVER_RX_INT
+	enc28j60SetRxHandler(rx_handler);
+#endif /* ETH_DRIVER_RX_INT */
 }
 
 /*---------------------------------------------------------------------------*/
-static void
+static int
 send(const void *payload, unsigned short payload_len)
 {
 	if (eth_state == ETH_DRIVER_ON) {
 		enc28j60PacketSend(payload_len, (unsigned char*)payload);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+sendv(const eth_segment_t *seg, unsigned char count)
+{
+	unsigned short len = 0;
+	unsigned char i;
+	
+	if (eth_state == ETH_DRIVER_ON) {
+		for (i = 0; i < count; i++) {
+			len += seg[i].len;
+		}
+		/* Stream the segments straight into the controller's transmit buffer */
+		enc28j60PacketSendBegin(len);
+		for (i = 0; i < count; i++) {
+			enc28j60PacketSendData(seg[i].len, (unsigned char*)seg[i].data);
+		}
+		enc28j60PacketSendEnd();
+		return 1;
 	}
+	return 0;
 }
 
 static int
@@ -135,6 +247,61 @@ read(const void *payload, unsigned short payload_len)
 	}
 }
 
+static int
+peek(const void *payload, unsigned short peek_len)
+{
+	if (eth_state == ETH_DRIVER_ON) {
+		/* Returns the whole frame length, CRC excluded */
+		rx_len = enc28j60PacketPeek(peek_len, (unsigned char*)payload) - 4;
+		return rx_len;
+	} else {
+		return 0;
+	}
+}
+
+static int
+read_rest(const void *payload, unsigned short peek_len, unsigned short payload_len)
+{
+	unsigned int len;
+	
+	if (rx_len >= peek_len + ETH_DRIVER_RX_ASYNC_LEN &&
+			(len = enc28j60PacketReadRestAsync(peek_len, payload_len, 
+																				 (unsigned char*)payload, 
+																				 rx_dma_done, NULL)) > 0) {
+		/* 
+		 * Sleep until the DMA interrupt. Other interrupts are served meanwhile,
+		 * but no process may run: payload (uip_buf) and the controller belong to
+		 * this frame until it is complete.
+		 */
+		spi_dma_wait();
+		enc28j60PacketReadEnd();
+	} else {
+		len = enc28j60PacketReadRest(peek_len, payload_len, (unsigned char*)payload);
+	}
+	/* substract the 4-byte CRC */
+	return len - 4;
+}
+
+static void
+drop()
+{
+	enc28j60PacketSkip();
+}
+
+static void
+filter_add(unsigned char *table, const void *addr)
+{
+	enc28j60HashAdd(table, (const unsigned char*)addr);
+}
+
+static void
+set_filter(const unsigned char *table)
+{
+	if (eth_state == ETH_DRIVER_ON) {
+		enc28j60SetRxFilter(table);
+	}
+}
+
 static int
 pending_packet()
 {
@@ -162,7 +329,13 @@ const eth_driver_t eth_driver =
   {
   	init,
   	send,
+  	sendv,
   	read,
+  	peek,
+  	read_rest,
+  	drop,
+  	filter_add,
+  	set_filter,
   	pending_packet,
   	on,
   	off
@@ -2,6 +2,70 @@
 #define ETH_DRIVER_H_
 
 #include "sys/process.h"
+#include "contiki-net.h"
+
+/* 
+ * Number of bytes of a received frame that are read before deciding whether
+ * the frame is worth copying into uip_buf: the Ethernet header and the fixed
+ * part of the IPv4/IPv6 header up to the next header field.
+ */
+#ifdef ETH_DRIVER_CONF_PEEK_LEN
+#define ETH_DRIVER_PEEK_LEN ETH_DRIVER_CONF_PEEK_LEN
+#else
+#define ETH_DRIVER_PEEK_LEN (UIP_LLH_LEN + 8)
+#endif /* ETH_DRIVER_CONF_PEEK_LEN */
+
+/* 
+ * Maximum number of frames received per poll of the driver process. The 
+ * process is polled again afterwards, so that the radio driver gets its turn
+ * during bursts (see RADIO_RX_BATCH).
+ */
+#ifdef ETH_DRIVER_CONF_RX_BATCH
+#define ETH_DRIVER_RX_BATCH ETH_DRIVER_CONF_RX_BATCH
+#else
+#define ETH_DRIVER_RX_BATCH 4
+#endif /* ETH_DRIVER_CONF_RX_BATCH */
+
+/* 
+ * Receive on the ENC28J60 INT interrupt (see ENC_INT in enc28j60.h) instead
+ * of polling the controller on every pass of the main loop? The pin INT is
+ * wired to has not been verified against the board, so it is off by default.
+ */
+#ifdef ETH_DRIVER_CONF_RX_INT
+#define ETH_DRIVER_RX_INT ETH_DRIVER_CONF_RX_INT
+#else
+#define ETH_DRIVER_RX_INT 0
+#endif /* ETH_DRIVER_CONF_RX_INT */
+
+/* 
+ * Period of the EPKTCNT check done besides the interrupt, 0 for none. The 
+ * packet pending interrupt flag (PKTIF) is not reliable (ENC28J60 silicon 
+ * errata), so a frame whose interrupt was missed would otherwise wait for the
+ * next one. The check only runs while the last poll found frames pending, so
+ * an idle link does not wake the MCU up.
+ */
+#ifdef ETH_DRIVER_CONF_RX_CHECK_PERIOD
+#define ETH_DRIVER_RX_CHECK_PERIOD ETH_DRIVER_CONF_RX_CHECK_PERIOD
+#else
+#define ETH_DRIVER_RX_CHECK_PERIOD (CLOCK_SECOND / 4)
+#endif /* ETH_DRIVER_CONF_RX_CHECK_PERIOD */
+
+/* 
+ * Frames with at least this many bytes left after the peeked headers are read
+ * by DMA in the background, the CPU sleeping until the DMA interrupt (see 
+ * spi_dma.h). Shorter ones are not worth the interrupt.
+ */
+#ifdef ETH_DRIVER_CONF_RX_ASYNC_LEN
+#define ETH_DRIVER_RX_ASYNC_LEN ETH_DRIVER_CONF_RX_ASYNC_LEN
+#else
+#define ETH_DRIVER_RX_ASYNC_LEN 256
+#endif /* ETH_DRIVER_CONF_RX_ASYNC_LEN */
+
+/* A piece of an outgoing frame (see sendv) */
+typedef struct {
+	const void *data;
+	unsigned short len;
+} eth_segment_t;
 
 /* Driver state */
 typedef enum {
@@ -16,12 +80,30 @@ typedef struct {
 	/** Initialize the driver */
   void (* init)(void);
   
-  /** Send a packet. */
-  void (* send)(const void *payload, unsigned short payload_len);
+  /** Send a packet. Returns 0 if it was not sent (e.g. the driver is off) */
+  int (* send)(const void *payload, unsigned short payload_len);
+
+  /** Same, with the packet given as a list of segments, not gathered first */
+  int (* sendv)(const eth_segment_t *seg, unsigned char count);
 
   /** Read a received packet into a buffer. */
   int (* read)(const void *buf, unsigned short buf_len);
 
+  /** Read the first bytes of a received packet, leaving it in the controller */
+  int (* peek)(const void *buf, unsigned short peek_len);
+
+  /** Read the rest of a peeked packet into a buffer, past the peeked bytes */
+  int (* read_rest)(const void *buf, unsigned short peek_len, unsigned short buf_len);
+
+  /** Drop a peeked packet */
+  void (* drop)(void);
+
+  /** Add a destination address to a receive filter hash table (8 bytes) */
+  void (* filter_add)(unsigned char *table, const void *addr);
+
+  /** Install a receive filter hash table, or receive everything if NULL */
+  void (* set_filter)(const unsigned char *table);
+
     /** Check if the radio driver has just received a packet */
   int (* pending_packet)(void);
 
@@ -11,6 +11,7 @@
 */
 
 #include "hal_cc2520.h"
+#include "spi_dma.h"
 
 /***********************************************************************************
 * CONSTANTS AND DEFINES
@@ -126,13 +127,7 @@ static void clearException(u32_t dwMap)
 */
 static void CC2520_INS_RD_ARRAY(u16_t count, u8_t  *pData)
 {
-    while (count--) {
-        CC2520_SPI_RX_NOT_READY(); 
-        CC2520_SPI_TX_REG = 0x00;
-        while (!CC2520_SPI_RX_IS_READY());
-        *pData = CC2520_SPI_RX();
-        pData++;
-    }
+    spi_dma_read(SPI_BUS_CC2520, pData, count);
 }
 
 
@@ -181,12 +176,7 @@ static u8_t CC2520_INS_MEMCP_COMMON(u8_t instr, u8_t pri, u16_t count, \
 */
 void CC2520_INS_WR_ARRAY(u16_t count, u8_t  *pData)
 {
-    while (count--) {
-        CC2520_SPI_RX_NOT_READY(); 
-        CC2520_SPI_TX_REG = *pData;
-        pData++;
-        while (!CC2520_SPI_RX_IS_READY());
-    }
+    spi_dma_write(SPI_BUS_CC2520, pData, count);
 }
 
 
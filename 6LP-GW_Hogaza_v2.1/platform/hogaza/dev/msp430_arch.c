@@ -81,6 +81,8 @@ interrupt void port1_interrupt(void) {
 			port1_vector[i]();
 		}
 	}
+	// handlers may have polled a process
+	MSP430_WAKEUP_ON_EXIT();
 }
 
 #pragma vector = PORT2_VECTOR
@@ -93,4 +95,6 @@ interrupt void port2_interrupt(void) {
 		}
 	}
 	P2IFG = 0x00; // clear flags
+	// handlers may have polled a process
+	MSP430_WAKEUP_ON_EXIT();
 }
@@ -1,6 +1,20 @@
 #ifndef _MSP430_ARCH_H_
 #define _MSP430_ARCH_H_
 
+#include <intrinsics.h>
+#include <msp430f5435a.h>
+
+/*
+ * Leaves the low power mode when returning from the current interrupt. To be
+ * used by every interrupt routine that polls a process or posts an event, so
+ * that the main loop runs it.
+ */
+#define MSP430_WAKEUP_ON_EXIT() __bic_SR_register_on_exit(LPM4_bits)
+
 void msp430_init(void);
 
+/* f is called from the port interrupt when pin i is flagged and enabled */
+void register_port1IntHandler(int i, void (*f)(void));
+void register_port2IntHandler(int i, void (*f)(void));
+
 #endif //__MSP430_ARCH_H_
@@ -1,6 +1,7 @@
 /*
  * This file implements the radio driver needed for the 6LP-GW
  */
+#include <string.h>
 #include "dev/radio_driver.h"
 /*
  * We include the "contiki-net.h" file to get all the network functions.
@@ -22,9 +23,43 @@ static int read(void *buf, unsigned short buf_len);
 static int pending_packet(void);
 static int on(void);
 static int off(void);
+static void tx_step(void);
+static void tx_done_handler(void);
+static void rx_handler(void);
 
 /* The driver state */
 static radio_driver_state_t radio_state = OFF;
+
+/* 
+ * Frames are transmitted from this queue by the radio process (ND messages
+ * first), so that senders do not have to wait for CCA and transmission to 
+ * complete. When it is full, frames are dropped instead.
+ */
+pgw_txq_t radio_tx_queue;
+
+/* The frame being transmitted, taken from the queue */
+static pgw_pbuf_t tx_frame = PGW_PBUF_NONE;
+
+/* State of tx_frame */
+static enum {
+	TX_IDLE,		/* No frame, or not loaded in the TX FIFO yet */
+	TX_CCA,			/* Loaded, waiting for a clear channel */
+	TX_BUSY,		/* Being transmitted */
+	TX_ACK			/* Sent, waiting for its acknowledgment */
+} tx_state = TX_IDLE;
+static struct timer tx_timer;
+/* 
+ * Wakes the process up if the frame being transmitted is never reported sent,
+ * or its acknowledgment does not come.
+ */
+static struct etimer tx_busy_timer;
+static volatile u8_t tx_done;
+/* Times tx_frame has been sent */
+static u8_t tx_transmissions;
+
+/* Whether a frame requests an acknowledgment (AR bit), and its sequence number */
+#define tx_ack_request(f)	(pgw_pbuf_data(f)[0] & 0x20)
+#define tx_seq(f)					(pgw_pbuf_data(f)[2])
 /*---------------------------------------------------------------------------*/
 /*
  * We declare the process that we use to register with the TCP/IP stack,
@@ -36,27 +71,52 @@ PROCESS(radio_driver_process, "radio_driver_process");
  * This is the poll handler function in the process below. This poll handler
  * function checks for incoming packets and forwards them to the right 
  * interface or delivers them to the TCP/IP stack.
+ * Up to RADIO_RX_BATCH frames are read per poll into the packetbuf, from the
+ * ring the receive ISR moves them to, or else straight from the CC2520 RX 
+ * FIFO (see cc2520ll_packetReceive()).
+ * The process is polled from the radio interrupts (see rx_handler() and
+ * tx_done_handler()) and when a frame is queued for transmission.
  */
 static void
 pollhandler(void)
 {
-	if (cc2520ll_pending_packet()) {
+	u8_t n;
+	int len;
+	
+	tx_step();
+	
+	for (n = 0; n < RADIO_RX_BATCH && cc2520ll_pending_packet(); n++) {
 		
 		incoming_if = IEEE_802_15_4;
 	
 		packetbuf_clear();
-    packetbuf_set_datalen(read(packetbuf_dataptr(), PACKETBUF_SIZE));
-		/* 
-	   * Forward the packet to the upper level in the stack
-	   */
-  	NESTACK_MAC_RADIO.input();
+		len = read(packetbuf_dataptr(), PACKETBUF_SIZE);
+		if (len > 0) {
+    	packetbuf_set_datalen(len);
+			/* Link quality of the frame, from its status word */
+			packetbuf_set_attr(PACKETBUF_ATTR_RSSI, (u8_t)cc2520ll_rssi());
+			packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, cc2520ll_lqi());
+			/* 
+	   	 * Forward the packet to the upper level in the stack
+	   	 */
+  		NESTACK_MAC_RADIO.input();
+		}
+	}
+	PGW_STAT(pgw_fwd_rx_batch(&radio_rx_stats, n, RADIO_RX_BATCH));
+	if (tx_state == TX_ACK) {
+		/* The acknowledgment may have been among the frames read */
+		tx_step();
 	}
   /*
-   * Now we'll make sure that the poll handler is executed repeatedly.
-   * We do this by calling process_poll() with this process as its
-   * argument.
+   * Poll ourselves again only if there is work left: buffered frames, or a
+   * frame waiting for the channel or to be sent again (a frame being 
+   * transmitted polls us when done, and its acknowledgment when received).
    */
-  process_poll(&radio_driver_process);
+	if (cc2520ll_pending_packet() || tx_state == TX_CCA ||
+			(tx_state == TX_IDLE && (tx_frame != PGW_PBUF_NONE || 
+															 !pgw_txq_empty(&radio_tx_queue)))) {
+  	process_poll(&radio_driver_process);
+	}
 }
 /*---------------------------------------------------------------------------*/
 /*
@@ -90,9 +150,17 @@ PROCESS_THREAD(radio_driver_process, ev, data)
   process_poll(&radio_driver_process);
 
  	/*
-   * And we wait for the process to exit.
+   * And we wait for the process to exit. tx_busy_timer is the only timer of
+   * the process: when it expires, the poll handler aborts the transmission.
    */
-	PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_EXIT);
+	while (1) {
+		PROCESS_WAIT_EVENT();
+		if (ev == PROCESS_EVENT_EXIT) {
+			break;
+		} else if (ev == PROCESS_EVENT_TIMER) {
+			process_poll(&radio_driver_process);
+		}
+	}
 
   /*
    * Here ends the process.
@@ -100,6 +168,156 @@ PROCESS_THREAD(radio_driver_process, ev, data)
   PROCESS_END();
 }
 
+/*---------------------------------------------------------------------------*/
+/*
+ * Called in interrupt context when the frame being transmitted has been sent.
+ */
+static void
+tx_done_handler(void)
+{
+	tx_done = 1;
+	process_poll(&radio_driver_process);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Called in interrupt context when a frame has been received.
+ */
+static void
+rx_handler(void)
+{
+	process_poll(&radio_driver_process);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Releases the buffer of the frame being transmitted and reports its status.
+ */
+static void
+tx_complete(int status)
+{
+	mac_callback_t sent = pgw_txq_frame(tx_frame)->sent;
+	void *ptr = pgw_txq_frame(tx_frame)->ptr;
+	
+	if (tx_state == TX_BUSY || tx_state == TX_ACK) {
+		etimer_stop(&tx_busy_timer);
+	}
+	pgw_pbuf_unref(tx_frame);
+	tx_frame = PGW_PBUF_NONE;
+	tx_state = TX_IDLE;
+	if (sent) {
+		sent(ptr, status, tx_transmissions);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Advances the transmission of the next frame of the TX queue. It never 
+ * waits for the radio: if the channel is busy, it is retried on the next 
+ * invocation until RADIO_TX_CCA_TIMEOUT expires. A frame that the radio has
+ * not reported sent after RADIO_TX_BUSY_TIMEOUT is aborted, so that a lost
+ * TX_FRM_DONE exception cannot stall the queue. A frame that requests an
+ * acknowledgment is sent again if none comes within RADIO_TX_ACK_TIMEOUT,
+ * up to the transmissions it was queued with.
+ */
+static void
+tx_step(void)
+{
+	switch (tx_state) {
+	case TX_IDLE:
+		if ((tx_frame == PGW_PBUF_NONE && pgw_txq_empty(&radio_tx_queue)) || 
+				cc2520ll_rxtx_packet()) {
+			/* Nothing to send, or a frame is being received */
+			return;
+		}
+		if (tx_frame == PGW_PBUF_NONE) {
+			tx_frame = pgw_txq_pop(&radio_tx_queue);
+			tx_transmissions = 0;
+		}
+		/* The frame is loaded again for each transmission */
+		tx_transmissions++;
+		if (cc2520ll_prepare(pgw_pbuf_data(tx_frame), 
+												 pgw_pbuf_len(tx_frame)) == FAILED) {
+			tx_complete(MAC_TX_ERR);
+			return;
+		}
+		timer_set(&tx_timer, RADIO_TX_CCA_TIMEOUT);
+		tx_done = 0;
+		tx_state = TX_CCA;
+		/* Fall through */
+	case TX_CCA:
+		if (cc2520ll_txStart() == SUCCESS) {
+			/* Called from the poll handler, so the timer belongs to this process */
+			etimer_set(&tx_busy_timer, RADIO_TX_BUSY_TIMEOUT);
+			tx_state = TX_BUSY;
+		} else if (timer_expired(&tx_timer)) {
+			cc2520ll_txAbort();
+			tx_complete(MAC_TX_COLLISION);
+		}
+		break;
+	case TX_BUSY:
+		if (tx_done) {
+			tx_done = 0;
+			if (tx_ack_request(tx_frame)) {
+				etimer_set(&tx_busy_timer, RADIO_TX_ACK_TIMEOUT);
+				tx_state = TX_ACK;
+			} else {
+				tx_complete(MAC_TX_OK);
+			}
+		} else if (etimer_expired(&tx_busy_timer)) {
+			cc2520ll_txAbort();
+			tx_complete(MAC_TX_ERR);
+		}
+		break;
+	case TX_ACK:
+		if (cc2520ll_ackReceived(tx_seq(tx_frame))) {
+			tx_complete(MAC_TX_OK);
+		} else if (etimer_expired(&tx_busy_timer)) {
+			if (tx_transmissions < pgw_txq_frame(tx_frame)->transmissions) {
+				/* Send it again on the next invocation */
+				tx_state = TX_IDLE;
+			} else {
+				tx_complete(MAC_TX_NOACK);
+			}
+		}
+		break;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Queues a frame of class pgw_txq_class for transmission. If the frame
+ * requests an acknowledgment, it is sent up to transmissions times (at least
+ * once) until one comes. sent (if not NULL) is called from the radio process
+ * once the frame has been sent, with the number of transmissions. If the 
+ * queue is full, the frame is dropped and RADIO_TX_ERR is returned.
+ */
+int
+radio_driver_send_async(const void *payload, unsigned short payload_len,
+                        u8_t transmissions, mac_callback_t sent, void *ptr)
+{
+	pgw_pbuf_t frame;
+	
+	if (radio_state != ON || payload_len > MAX_802154_PACKET_SIZE ||
+			(frame = pgw_txq_alloc(&radio_tx_queue, pgw_txq_class, 
+														 payload_len)) == PGW_PBUF_NONE) {
+		return RADIO_TX_ERR;
+	}
+	memcpy(pgw_pbuf_data(frame), payload, payload_len);
+	pgw_txq_frame(frame)->sent = sent;
+	pgw_txq_frame(frame)->ptr = ptr;
+	pgw_txq_frame(frame)->transmissions = transmissions;
+	pgw_txq_push(&radio_tx_queue, frame, pgw_txq_class);
+	process_poll(&radio_driver_process);
+	return RADIO_TX_OK;
+}
+
+u8_t
+radio_driver_tx_room(void)
+{
+	return pgw_txq_room(&radio_tx_queue, pgw_txq_class);
+}
+
 /*---------------------------------------------------------------------------*/
 static int 
 init()
@@ -107,6 +325,9 @@ init()
 	if (cc2520ll_init() == FAILED) {
 		return 0;
 	} else {
+		cc2520ll_setTxDoneHandler(tx_done_handler);
+		cc2520ll_setRxHandler(rx_handler);
+		pgw_txq_init(&radio_tx_queue, RADIO_TX_QUEUE_LEN);
 		on();
 		process_start(&radio_driver_process, NULL);
 		return 1;
@@ -117,18 +338,18 @@ init()
 static int
 send(const void *payload, unsigned short payload_len)
 {
-	if (radio_state == ON) {
-		return cc2520ll_packetSend(payload, payload_len);
-	}
-	return 0;
+	return radio_driver_send_async(payload, payload_len, 1, NULL, NULL);
 }
 
 static int 
 read(void *buf, unsigned short buf_len) 
 {
+	int len;
+	
 	if (radio_state == ON) {
-		/* substract CRC length */
-		return cc2520ll_packetReceive(buf, buf_len) - 2;
+		/* substract CRC length (0 if the frame was dropped) */
+		len = cc2520ll_packetReceive(buf, buf_len);
+		return len > 2 ? len - 2 : 0;
 	} else {
 		return 0;
 	}
@@ -2,6 +2,54 @@
 #define RADIO_DRIVER_H_
 
 #include "sys/process.h"
+#include "net/mac/mac.h"
+#include "net/p-gw/pgw_txq.h"
+
+/* 
+ * Number of frames that can be waiting for transmission. The default holds 
+ * all the fragments of a 1280-byte packet, besides the buffers reserved for
+ * ND messages (see pgw_txq.h).
+ */
+#ifdef RADIO_CONF_TX_QUEUE_LEN
+#define RADIO_TX_QUEUE_LEN RADIO_CONF_TX_QUEUE_LEN
+#else
+#define RADIO_TX_QUEUE_LEN PGW_PBUF_NUM
+#endif /* RADIO_CONF_TX_QUEUE_LEN */
+
+/* Time during which we retry CCA before reporting a collision */
+#ifdef RADIO_CONF_TX_CCA_TIMEOUT
+#define RADIO_TX_CCA_TIMEOUT RADIO_CONF_TX_CCA_TIMEOUT
+#else
+#define RADIO_TX_CCA_TIMEOUT (CLOCK_SECOND / 8)
+#endif /* RADIO_CONF_TX_CCA_TIMEOUT */
+
+/* 
+ * Time after which a frame being transmitted is aborted if the radio has not
+ * reported it sent (a 127-byte frame takes about 4 ms).
+ */
+#ifdef RADIO_CONF_TX_BUSY_TIMEOUT
+#define RADIO_TX_BUSY_TIMEOUT RADIO_CONF_TX_BUSY_TIMEOUT
+#else
+#define RADIO_TX_BUSY_TIMEOUT (CLOCK_SECOND / 8)
+#endif /* RADIO_CONF_TX_BUSY_TIMEOUT */
+
+/* 
+ * Time to wait for the acknowledgment of a frame that requests one before
+ * sending it again. An acknowledgment comes within 864 us, so the default is
+ * the shortest time the clock can measure.
+ */
+#ifdef RADIO_CONF_TX_ACK_TIMEOUT
+#define RADIO_TX_ACK_TIMEOUT RADIO_CONF_TX_ACK_TIMEOUT
+#else
+#define RADIO_TX_ACK_TIMEOUT 1
+#endif /* RADIO_CONF_TX_ACK_TIMEOUT */
+
+/* Maximum number of frames received per poll of the driver process */
+#ifdef RADIO_CONF_RX_BATCH
+#define RADIO_RX_BATCH RADIO_CONF_RX_BATCH
+#else
+#define RADIO_RX_BATCH 4
+#endif /* RADIO_CONF_RX_BATCH */
 
 /* Driver state */
 typedef enum {
@@ -10,6 +58,16 @@ typedef enum {
 
 extern const struct radio_driver radio_driver;
 
+/* Frames waiting for the radio */
+extern pgw_txq_t radio_tx_queue;
+
+int radio_driver_send_async(const void *payload, unsigned short payload_len,
+                            u8_t transmissions, mac_callback_t sent, 
+                            void *ptr);
+
+/* Number of frames of the class being sent (pgw_txq_class) that still fit */
+u8_t radio_driver_tx_room(void);
+
 PROCESS_NAME(radio_driver_process);
 
 #endif /*RADIO_DRIVER_H_*/
@@ -0,0 +1,226 @@
+/**
+ * \file		spi_dma.c
+ *
+ * \brief		DMA-backed bulk transfers for the SPI buses of the ENC28J60 and
+ * 					the CC2520.
+ */
+
+#include "dev/spi_dma.h"
+#include "dev/msp430_arch.h"
+#include <msp430f5435a.h>
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+/* DMA trigger sources (see the MSP430F543xA datasheet) */
+#define DMA_TRIG_UCB0RXIFG	18
+#define DMA_TRIG_UCB0TXIFG	19
+#define DMA_TRIG_UCA1RXIFG	20
+#define DMA_TRIG_UCA1TXIFG	21
+
+/* USCI registers and DMA triggers of a bus */
+typedef struct {
+	volatile unsigned char *ifg;
+	volatile unsigned char *rxbuf;
+	volatile unsigned char *txbuf;
+	u8_t rx_trigger;
+	u8_t tx_trigger;
+} spi_bus_regs_t;
+
+static const spi_bus_regs_t spi_bus_regs[SPI_BUSES] = {
+	/* SPI_BUS_ENC28J60 */
+	{ &UCB0IFG, &UCB0RXBUF, &UCB0TXBUF, DMA_TRIG_UCB0RXIFG, DMA_TRIG_UCB0TXIFG },
+	/* SPI_BUS_CC2520 */
+	{ &UCA1IFG, &UCA1RXBUF, &UCA1TXBUF, DMA_TRIG_UCA1RXIFG, DMA_TRIG_UCA1TXIFG },
+};
+
+/* Bus owning the DMA channels, or SPI_BUSES if they are free */
+static volatile u8_t dma_owner = SPI_BUSES;
+static spi_dma_callback_t dma_done;
+static void *dma_done_ptr;
+/* Source of the zeroes sent by reads and sink of the bytes received by writes */
+static const u8_t dma_zero = 0;
+static u8_t dma_sink;
+
+#if SPI_DMA_STATISTICS
+spi_dma_stats_t spi_dma_stats[SPI_BUSES];
+#define SPI_DMA_STAT(s) s
+#else
+#define SPI_DMA_STAT(s)
+#endif /* SPI_DMA_STATISTICS */
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Takes the DMA channels for a bus. Returns 0 if they are in use.
+ */
+static u8_t
+dma_acquire(spi_bus_t bus)
+{
+	istate_t state;
+	u8_t acquired = 0;
+	
+	state = __get_interrupt_state();
+	_disable_interrupts();
+	if (dma_owner == SPI_BUSES) {
+		dma_owner = bus;
+		acquired = 1;
+	}
+	__set_interrupt_state(state);
+	return acquired;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Arms channel 0 to move the received bytes and channel 1 to feed the 
+ * transmitter. Channel 0 has the highest priority, so a received byte is
+ * always read before the next one is shifted in.
+ */
+static void
+dma_start(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len, u8_t ie)
+{
+	const spi_bus_regs_t *regs = &spi_bus_regs[bus];
+	
+	DMA0CTL = 0;
+	DMA1CTL = 0;
+	DMACTL0 = ((u16_t)regs->tx_trigger << 8) | regs->rx_trigger;
+	
+	__data16_write_addr((unsigned short)&DMA0SA, (unsigned long)regs->rxbuf);
+	__data16_write_addr((unsigned short)&DMA0DA, 
+											(unsigned long)(rx != NULL ? rx : &dma_sink));
+	DMA0SZ = len;
+	DMA0CTL = DMADT_0 | DMASRCINCR_0 | (rx != NULL ? DMADSTINCR_3 : DMADSTINCR_0) |
+						DMASRCBYTE | DMADSTBYTE | (ie ? DMAIE : 0) | DMAEN;
+	
+	__data16_write_addr((unsigned short)&DMA1SA, 
+											(unsigned long)(tx != NULL ? tx : &dma_zero));
+	__data16_write_addr((unsigned short)&DMA1DA, (unsigned long)regs->txbuf);
+	DMA1SZ = len;
+	DMA1CTL = DMADT_0 | (tx != NULL ? DMASRCINCR_3 : DMASRCINCR_0) | DMADSTINCR_0 |
+						DMASRCBYTE | DMADSTBYTE | DMAEN;
+	
+	/* Triggers are edge sensitive and UCTXIFG is already set: toggle it */
+	*regs->ifg &= ~UCRXIFG;
+	*regs->ifg &= ~UCTXIFG;
+	*regs->ifg |= UCTXIFG;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Byte by byte transfer, for short transfers or if the DMA is busy.
+ */
+static void
+cpu_transfer(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len)
+{
+	const spi_bus_regs_t *regs = &spi_bus_regs[bus];
+	u8_t c;
+	
+	SPI_DMA_STAT(spi_dma_stats[bus].cpu_bytes += len);
+	while (len--) {
+		*regs->ifg &= ~UCRXIFG;
+		*regs->txbuf = (tx != NULL ? *tx++ : 0);
+		while (!(*regs->ifg & UCRXIFG));
+		c = *regs->rxbuf;
+		if (rx != NULL) {
+			*rx++ = c;
+		}
+	}
+}
+/*---------------------------------------------------------------------------*/
+static void
+transfer(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len)
+{
+	if (len < SPI_DMA_MIN_LEN) {
+		cpu_transfer(bus, tx, rx, len);
+		return;
+	}
+	if (!dma_acquire(bus)) {
+		SPI_DMA_STAT(spi_dma_stats[bus].contended++);
+		cpu_transfer(bus, tx, rx, len);
+		return;
+	}
+	SPI_DMA_STAT(spi_dma_stats[bus].dma_bytes += len);
+	dma_start(bus, tx, rx, len, 0);
+	/* The RX channel completes when the last byte has been clocked in */
+	while (!(DMA0CTL & DMAIFG));
+	DMA0CTL = 0;
+	DMA1CTL = 0;
+	dma_owner = SPI_BUSES;
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_init(void)
+{
+	/* Do not interrupt CPU read-modify-write operations */
+	DMACTL4 = DMARMWDIS;
+	DMA0CTL = 0;
+	DMA1CTL = 0;
+	dma_owner = SPI_BUSES;
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_read(spi_bus_t bus, u8_t *buf, u16_t len)
+{
+	transfer(bus, NULL, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_write(spi_bus_t bus, const u8_t *buf, u16_t len)
+{
+	transfer(bus, buf, NULL, len);
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+spi_dma_transfer_async(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len,
+											 spi_dma_callback_t done, void *ptr)
+{
+	if (len == 0 || !dma_acquire(bus)) {
+		return 0;
+	}
+	SPI_DMA_STAT(spi_dma_stats[bus].dma_bytes += len);
+	dma_done = done;
+	dma_done_ptr = ptr;
+	dma_start(bus, tx, rx, len, 1);
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+spi_dma_busy(void)
+{
+	return dma_owner != SPI_BUSES;
+}
+/*---------------------------------------------------------------------------*/
+void
+spi_dma_wait(void)
+{
+	/* Checked with interrupts disabled, so that the wake-up cannot be missed */
+	_disable_interrupts();
+	while (dma_owner != SPI_BUSES) {
+		/* SMCLK keeps clocking the bus in LPM0 */
+		__bis_SR_register(LPM0_bits + GIE);
+		_disable_interrupts();
+	}
+	_enable_interrupts();
+}
+/*---------------------------------------------------------------------------*/
+#pragma vector = DMA_VECTOR
+__interrupt void DMA_ISR(void)
+{
+	spi_dma_callback_t done;
+	
+	switch(__even_in_range(DMAIV, 16))
+	{
+	case 2:										// Vector 2: DMA0IFG, RX complete
+		DMA0CTL = 0;
+		DMA1CTL = 0;
+		done = dma_done;
+		dma_done = NULL;
+		dma_owner = SPI_BUSES;
+		if (done != NULL) {
+			done(dma_done_ptr);
+		}
+		/* Wake up spi_dma_wait(), or the main loop if a process was polled */
+		MSP430_WAKEUP_ON_EXIT();
+		break;
+	default: break;
+	}
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,91 @@
+/**
+ * \file		spi_dma.h
+ *
+ * \brief		DMA-backed bulk transfers for the SPI buses of the ENC28J60 and
+ * 					the CC2520.
+ *
+ * 					Both chips sit on their own USCI (UCB0 and UCA1) but share the
+ * 					DMA controller. A bulk transfer uses DMA channels 0 (RX) and 1
+ * 					(TX); if they are taken by a transfer on the other bus (e.g. the
+ * 					radio RX interrupt preempting an Ethernet read), the transfer is
+ * 					done by the CPU instead, so callers never wait for the other 
+ * 					chip. Chip select is left to the drivers.
+ *
+ * 					spi_dma_read() and spi_dma_write() are blocking: they wait for
+ * 					the RX channel to complete instead of polling the USCI for each
+ * 					byte. spi_dma_transfer_async() returns at once, and the DMA
+ * 					interrupt calls back the driver (which typically polls its
+ * 					process) when the last byte is in. spi_dma_wait() sleeps in
+ * 					LPM0 until then.
+ *
+ * 					The native build (platform/hogaza-native) has a mock of this
+ * 					layer that counts the bytes moved on each bus, so that the
+ * 					ENC28J60 and CC2520 code can be run on the host.
+ */
+
+#ifndef SPI_DMA_H_
+#define SPI_DMA_H_
+
+#include "contiki.h"
+
+/* Transfers shorter than this are done by the CPU (DMA set-up costs more) */
+#ifdef SPI_DMA_CONF_MIN_LEN
+#define SPI_DMA_MIN_LEN SPI_DMA_CONF_MIN_LEN
+#else
+#define SPI_DMA_MIN_LEN 8
+#endif /* SPI_DMA_CONF_MIN_LEN */
+
+/* Count the bytes moved on each bus by DMA and by the CPU */
+#ifdef SPI_DMA_CONF_STATISTICS
+#define SPI_DMA_STATISTICS SPI_DMA_CONF_STATISTICS
+#else
+#define SPI_DMA_STATISTICS 0
+#endif /* SPI_DMA_CONF_STATISTICS */
+
+/* SPI buses */
+typedef enum {
+	SPI_BUS_ENC28J60 = 0,
+	SPI_BUS_CC2520,
+	SPI_BUSES
+} spi_bus_t;
+
+/* Completion callback of asynchronous transfers. Called from the DMA ISR */
+typedef void (* spi_dma_callback_t)(void *ptr);
+
+#if SPI_DMA_STATISTICS
+typedef struct {
+	u32_t dma_bytes;	/* Bytes moved by DMA */
+	u32_t cpu_bytes;	/* Bytes moved by the CPU */
+	u16_t contended;	/* Bulk transfers done by the CPU because the DMA was busy */
+} spi_dma_stats_t;
+
+extern spi_dma_stats_t spi_dma_stats[SPI_BUSES];
+#endif /* SPI_DMA_STATISTICS */
+
+void spi_dma_init(void);
+
+/* Reads len bytes into buf, sending zeroes */
+void spi_dma_read(spi_bus_t bus, u8_t *buf, u16_t len);
+
+/* Sends len bytes from buf, discarding the received ones */
+void spi_dma_write(spi_bus_t bus, const u8_t *buf, u16_t len);
+
+/* 
+ * Starts a transfer in the background. Either buffer may be NULL (zeroes are 
+ * sent / received bytes are discarded). Returns 0 if the DMA is busy, in
+ * which case the caller must fall back to a blocking transfer. Otherwise 
+ * done(ptr) is called from the DMA ISR once the last byte has been received.
+ */
+u8_t spi_dma_transfer_async(spi_bus_t bus, const u8_t *tx, u8_t *rx, u16_t len,
+														spi_dma_callback_t done, void *ptr);
+
+/* Returns a value other than 0 while a transfer is using the DMA channels */
+u8_t spi_dma_busy(void);
+
+/* 
+ * Sleeps until the transfer using the DMA channels is complete. Interrupts are
+ * served meanwhile.
+ */
+void spi_dma_wait(void);
+
+#endif /*SPI_DMA_H_*/
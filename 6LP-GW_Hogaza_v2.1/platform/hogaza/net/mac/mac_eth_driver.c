@@ -12,6 +12,7 @@
 #include "net/uipv4/uipv4_arp.h"
 #include "contiki-net.h"
 #include "net/uipv4/uipv4.h"
+#include <string.h>
 
 #define ETH_BUF ((struct uip_eth_hdr *)&uip_buf[0])
 #define IPV4_BUF ((struct uipv4_ip_hdr *)&uip_buf[UIP_LLH_LEN])
@@ -20,6 +21,10 @@
 /* event timer to handle arp periodic invocations */
 struct etimer mac_eth_periodic;
 
+#if PGW_STATISTICS
+pgw_txq_stats_t eth_tx_stats;
+#endif /* PGW_STATISTICS */
+
 PROCESS(mac_eth_process, "mac_eth_process");
 
 PROCESS_THREAD(mac_eth_process, ev, data)
@@ -38,6 +43,20 @@ PROCESS_THREAD(mac_eth_process, ev, data)
   PROCESS_END();
 }
 
+/*---------------------------------------------------------------------------*/
+/* Sends a frame, accounting for it in eth_tx_stats */
+static void
+eth_send(const void *frame, unsigned short len)
+{
+#if PGW_STATISTICS
+	u32_t start = clock_cycles();
+	
+	pgw_txq_stats_send(&eth_tx_stats, pgw_txq_class,
+			NETSTACK_ETHERNET.send(frame, len), start);
+#else
+	NETSTACK_ETHERNET.send(frame, len);
+#endif /* PGW_STATISTICS */
+}
 /*---------------------------------------------------------------------------*/
 static void
 send_packet()
@@ -51,12 +70,12 @@ send_packet()
 		uipv4_arp_out();
 		/* And send the packet. Note that uipv4_arp_out() increases the value of
 		 * uip_len with the length of the Ethernet header! */
-		NETSTACK_ETHERNET.send(uip_buf, uip_len);
+		eth_send(uip_buf, uip_len);
 	} else if ((IPV6_BUF->vtc & 0xf0) == 0x60) {
 		/* The Ethernet header was already built by pgw; increase the value of 
 		 * uip_len and pass the packet to the lower layer */
 		uip_len += sizeof(struct uip_eth_hdr);
-		NETSTACK_ETHERNET.send(uip_buf, uip_len);
+		eth_send(uip_buf, uip_len);
 	} else {
 		/* Error? */
 		uip_len = 0;
@@ -65,6 +84,19 @@ send_packet()
 	}
 }
 
+/*---------------------------------------------------------------------------*/
+static void
+send_segments(const eth_segment_t *seg, u8_t count)
+{
+#if PGW_STATISTICS
+	u32_t start = clock_cycles();
+	
+	pgw_txq_stats_send(&eth_tx_stats, pgw_txq_class,
+			NETSTACK_ETHERNET.sendv(seg, count), start);
+#else
+	NETSTACK_ETHERNET.sendv(seg, count);
+#endif /* PGW_STATISTICS */
+}
 /*---------------------------------------------------------------------------*/
 static void
 input_packet(void)
@@ -84,7 +116,7 @@ input_packet(void)
 		uipv4_arp_arpin();
 		if(uip_len > 0) {
 			/* ARP generated an outgoing packet. Send it*/
-			NETSTACK_ETHERNET.send(uip_buf, uip_len);
+			eth_send(uip_buf, uip_len);
 			/* Clear uip_len */
 			uip_len = 0;
  		}
@@ -100,6 +132,31 @@ input_packet(void)
 	}
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Called by the Ethernet driver with only the headers of an incoming packet 
+ * in uip_buf. Returns a value other than 0 if the packet can be dropped 
+ * without reading the rest of it.
+ */
+static u8_t
+filter_packet(void)
+{
+	if ((ETH_BUF->type == UIP_HTONS(UIP_ETHTYPE_IPV6)) &&
+			((IPV6_BUF->vtc & 0xf0) == 0x60)) {
+		/* IPv6. Let the 6LP-GW decide according to the bridge cache */
+		return pgw_fwd_eth_filter();
+	} else if ((ETH_BUF->type == UIP_HTONS(UIP_ETHTYPE_IP)) && 
+			((IPV4_BUF->vhl & 0xf0) == 0x40)) {
+		/* IPv4 is only handled locally. The controller receives every frame, so 
+		 * drop unicast frames addressed to other stations */
+		return !(ETH_BUF->dest.addr[0] & 0x01) &&
+				memcmp(&ETH_BUF->dest, &uip_ethaddr, sizeof(struct uip_eth_addr));
+	} else if(ETH_BUF->type == UIP_HTONS(UIP_ETHTYPE_ARP)) {
+		return 0;
+	}
+	/* Crap */
+	return 1;
+}
+/*---------------------------------------------------------------------------*/
 static void
 on(void)
 {
@@ -123,7 +180,9 @@ const struct mac_eth_driver mac_eth_driver = {
   "mac_eth_driver",
   init,
   send_packet,
+  send_segments,
   input_packet,
+  filter_packet,
   on,
   off,
 };
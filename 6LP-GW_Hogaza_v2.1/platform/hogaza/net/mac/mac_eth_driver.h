@@ -2,6 +2,8 @@
 #define MAC_ETH_DRIVER_H_
 
 #include "contiki-net.h"
+#include "dev/eth_driver.h"
+#include "net/p-gw/pgw_txq.h"
 
 /**
  * The structure of an Ethernet MAC driver in Contiki.
@@ -15,9 +17,18 @@ struct mac_eth_driver {
   /** Send a packet from the uip_buf buffer  */
   void (* send)(void);
 
+  /** Send an IPv6 packet given as a list of segments, Ethernet header first */
+  void (* sendv)(const eth_segment_t *seg, u8_t count);
+
   /** Callback for getting notified of incoming packet. */
   void (* input)(void);
 
+  /** 
+   * Returns a value other than 0 if an incoming packet can be dropped by 
+   * looking only at its first ETH_DRIVER_PEEK_LEN bytes in uip_buf 
+   */
+  u8_t (* filter)(void);
+
   /** Turn the MAC layer on. */
   void (* on)(void);
 
@@ -28,6 +39,11 @@ struct mac_eth_driver {
 
 extern const struct mac_eth_driver mac_eth_driver;
 
+#if PGW_STATISTICS
+/* Frames sent to the Ethernet interface, which has no queue (see pgw_txq.h) */
+extern pgw_txq_stats_t eth_tx_stats;
+#endif /* PGW_STATISTICS */
+
 PROCESS_NAME(mac_eth_process);
 
 #endif /*MAC_ETH_DRIVER_H_*/
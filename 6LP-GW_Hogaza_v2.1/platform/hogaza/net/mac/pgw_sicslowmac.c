@@ -52,6 +52,7 @@
 #include "lib/random.h"
 #include "contiki-net.h"
 #include "net/rime.h"
+#include "dev/radio_driver.h"
 
 #define DEBUG 0
 
@@ -161,16 +162,13 @@ send_packet(mac_callback_t sent, void *ptr)
     PRINTADDR(params.dest_addr.u8);
     PRINTF("%u %u (%u)\n", len, packetbuf_datalen(), packetbuf_totlen());
 
-    ret = NETSTACK_RADIO.send(packetbuf_hdrptr(), packetbuf_totlen());
-    if(sent) {
-      switch(ret) {
-      case RADIO_TX_OK:
-        sent(ptr, MAC_TX_OK, 1);
-        break;
-      case RADIO_TX_ERR:
-        sent(ptr, MAC_TX_ERR, 1);
-        break;
-      }
+    /* The radio driver reports the result through sent once the frame
+     * has actually been transmitted (and acknowledged, if requested) */
+    ret = radio_driver_send_async(packetbuf_hdrptr(), packetbuf_totlen(),
+                     packetbuf_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS),
+                     sent, ptr);
+    if(ret != RADIO_TX_OK && sent) {
+      sent(ptr, MAC_TX_ERR, 1);
     }
   } else {
     PRINTF("6MAC-UT: too large header: %u\n", len);
@@ -203,7 +201,11 @@ input_packet(void)
     PRINTF("6MAC-IN: %2X", frame.fcf.frame_type);
     PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_SENDER));
     PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
-    PRINTF("%u\n", packetbuf_datalen());
+    /* The RSSI and LQI attributes set by the radio driver go up with the
+     * payload, see sicslowpan input() */
+    PRINTF("%u rssi %d lqi %u\n", packetbuf_datalen(),
+           (s8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI),
+           packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
 		NETSTACK_6LOWPAN.input();
   } else {
 	 	PRINTF("6MAC: failed to parse hdr\n");
@@ -13,6 +13,7 @@
 #include "contiki-net.h"
 #include "net/uip-icmp6.h"
 #include "net/uip-nd6.h"
+#include "net/uip_common.h"
 
 #define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define ETH_BUF 	((struct uip_eth_hdr *)&uip_buf[0])
@@ -43,10 +44,55 @@ static eui64_t aux_eui64;														/** \brief Auxiliar MAC addresses */
 static u8_t *pgw_opt_llao;   										/**  Pointer to llao option in uip_buf */
 static uip_nd6_opt_prefix_info *pgw_opt_prefix_info;/**  Pointer to PIO option in uip_buf */
 static uip_nd6_opt_aro *pgw_opt_aro;   							/**  Pointer to aro option in uip_buf */
-static u16_t pgw_len = 0;
-static uip_buf_t pgw_aligned_buf;
+/* 
+ * Edit log of the packet in the "do both" case (see PGW_EDIT_LOG_LEN): its
+ * headers, length and link-layer addresses, and the records of the changes 
+ * made to its ICMPv6 body. Each record is the bytes it saved, if any, followed
+ * by a pgw_edit_t, so that the log is undone from its end.
+ */
+#define PGW_EDIT_HDR_LEN	(UIP_IPH_LEN + UIP_ICMPH_LEN)
+
+#define PGW_EDIT_WRITE		0	/* Bytes overwritten, saved */
+#define PGW_EDIT_INSERT		1	/* Bytes inserted */
+#define PGW_EDIT_REMOVE		2	/* Bytes removed, saved */
+
+typedef struct {
+	u16_t off;			/* Offset in the IPv6 packet */
+	u16_t len;			/* Bytes written, inserted or removed */
+	u16_t pkt_len;	/* Packet length before the change */
+	u8_t op;
+} pgw_edit_t;
 
-#define pgw_buf (pgw_aligned_buf.u8)
+#define PGW_EDIT_OFF			0	/* Not recording */
+#define PGW_EDIT_ON				1
+#define PGW_EDIT_WHOLE		2	/* The body has been saved as a whole: nothing to record */
+#define PGW_EDIT_LOST			3	/* A change did not fit: the packet cannot be restored */
+
+static u8_t pgw_edit_state = PGW_EDIT_OFF;
+static u16_t pgw_edit_used;				/* Bytes of the log in use */
+static u16_t pgw_edit_len;				/* Packet length, as left by the recorded changes */
+static u16_t pgw_edit_orig_len;
+static u8_t pgw_edit_hdr[PGW_EDIT_HDR_LEN];
+static u8_t pgw_edit_log[PGW_EDIT_LOG_LEN];
+static eui64_t pgw_src_eui64, pgw_dst_eui64;
+/* RA template: the last RA from the RR with our options (see PGW_RA_HOLDDOWN) */
+static u16_t pgw_ra_len = 0;							/* Template length, 0 if there is none */
+static u16_t pgw_ra_rrlen;								/* Length of the RR's RA it was built from */
+static u8_t pgw_ra_contexts;							/* Contexts in use when it was built */
+static u8_t pgw_ra_template[PGW_RA_TEMPLATE_LEN];
+static eui64_t pgw_ra_src_eui64;
+static struct etimer pgw_ra_timer;				/* Hold-down of coalesced RAs */
+#if PGW_RA_CACHE
+static u16_t pgw_ra_pio;									/* Offset of its PIO, 0 if there is none */
+static unsigned long pgw_ra_time;					/* clock_seconds() when the RR last sent it */
+static u32_t pgw_ra_maxage;								/* Seconds it can be used for */
+#endif /* PGW_RA_CACHE */
+#if PGW_STATISTICS
+pgw_stats_t pgw_stats;
+#endif /* PGW_STATISTICS */
+#if PGW_PROFILE
+pgw_profile_t pgw_profile[PGW_PROF_TYPES];
+#endif /* PGW_PROFILE */
 
 
 /* 
@@ -61,12 +107,23 @@ static void proxy_rs_input(void);
 static void proxy_ra_input(void);
 static void proxy_redirect_input(void);
 static void pgw_registration_error(u8_t status);
+static u8_t pgw_ra_match(void);
+static u8_t pgw_ra_count_contexts(void);
+static void pgw_ra_save(u16_t rrlen);
+static void pgw_ra_restore(uip_ipaddr_t *dst);
+static void pgw_ra_clear_pending(void);
+static void pgw_ra_schedule(void);
+#if PGW_RA_CACHE
+static u8_t pgw_ra_answer(pgw_nbr_t *n);
+#endif /* PGW_RA_CACHE */
 
 /* 6LP-GW process functions */
 void pgw_init(void);
 void pgw_input(void);
 void local_node_output(uip_lladdr_t *localdest);
 static void pgw_packet_input(void);
+static void pgw_edit_begin(void);
+static u8_t pgw_edit_restore(void);
 static void pgw_output(void);
 static void pgw_eventhandler(process_event_t ev, process_data_t data);
 
@@ -79,16 +136,170 @@ void pgw_update_icmp_checksum(void);
 PROCESS(pgw_process, "6LP-GW process");
 
 /* 
- * Initialize the 6LP-GW data structures.
+ * Initialize the 6LP-GW data structures. It can be called again to forget
+ * every 6LN, context, bridge entry and the RR (see pgw_bench_run()).
  */
 void 
 pgw_init() 
 {
 	pgw_nd_init();
 	pgw_fwd_init();
+	memset(&rr_ipaddr, 0, sizeof(rr_ipaddr));
+	memset(&rr_lladdr, 0, sizeof(rr_lladdr));
+	ra_pending = 0;
+	context_chaged = 0;
+	pgw_ra_len = 0;
+	etimer_stop(&pgw_ra_timer);
 	process_start(&pgw_process, NULL);
 }
 
+/* 
+ * Starts recording the changes made to the IPv6 packet in uip_buf, and saves 
+ * its headers, length and link-layer addresses. The Ethernet header is not 
+ * saved: it is rebuilt from the addresses by the output functions.
+ */
+static void
+pgw_edit_begin()
+{
+	memcpy(pgw_edit_hdr, &uip_buf[UIP_LLH_LEN], PGW_EDIT_HDR_LEN);
+	pgw_edit_orig_len = pgw_edit_len = uip_len;
+	pgw_edit_used = 0;
+	pgw_edit_state = PGW_EDIT_ON;
+	eui64_copy(&pgw_src_eui64, &src_eui64);
+	eui64_copy(&pgw_dst_eui64, &dst_eui64);
+}
+
+/* 
+ * Appends a record of len bytes at off, saving them if save is not 0. Returns
+ * 0 if it does not fit.
+ */
+static u8_t
+pgw_edit_push(u8_t op, u16_t off, u16_t len, u8_t save)
+{
+	pgw_edit_t e;
+	u16_t size;
+	
+	size = (save ? len : 0) + sizeof(pgw_edit_t);
+	if (pgw_edit_used + size > PGW_EDIT_LOG_LEN) {
+		return 0;
+	}
+	if (save) {
+		memcpy(&pgw_edit_log[pgw_edit_used], &uip_buf[UIP_LLH_LEN + off], len);
+		pgw_edit_used += len;
+	}
+	e.off = off;
+	e.len = len;
+	e.pkt_len = pgw_edit_len;
+	e.op = op;
+	/* Records are not aligned */
+	memcpy(&pgw_edit_log[pgw_edit_used], &e, sizeof(pgw_edit_t));
+	pgw_edit_used += sizeof(pgw_edit_t);
+#if PGW_STATISTICS
+	if (pgw_edit_used > pgw_stats.edit_max) {
+		pgw_stats.edit_max = pgw_edit_used;
+	}
+#endif /* PGW_STATISTICS */
+	return 1;
+}
+
+/* Offset of p in the IPv6 packet in uip_buf */
+#define pgw_edit_off(p)	((u16_t)((const u8_t *)(p) - &uip_buf[UIP_LLH_LEN]))
+
+void
+pgw_edit_write(const void *p, u16_t len)
+{
+	if (pgw_edit_state == PGW_EDIT_ON &&
+			!pgw_edit_push(PGW_EDIT_WRITE, pgw_edit_off(p), len, 1)) {
+		pgw_edit_state = PGW_EDIT_LOST;
+	}
+}
+
+void
+pgw_edit_insert(const void *p, u16_t len)
+{
+	if (pgw_edit_state != PGW_EDIT_ON) {
+		return;
+	}
+	if (!pgw_edit_push(PGW_EDIT_INSERT, pgw_edit_off(p), len, 0)) {
+		pgw_edit_state = PGW_EDIT_LOST;
+		return;
+	}
+	pgw_edit_len += len;
+}
+
+u8_t
+pgw_edit_remove(const void *p, u16_t len)
+{
+	if (pgw_edit_state != PGW_EDIT_ON) {
+		return 1;
+	}
+	if (!pgw_edit_push(PGW_EDIT_REMOVE, pgw_edit_off(p), len, 1)) {
+		return 0;
+	}
+	pgw_edit_len -= len;
+	return 1;
+}
+
+/* 
+ * Saves the body as it is now, as the last record. Restoring it makes the 
+ * changes that follow irrelevant, so they are no longer recorded.
+ */
+void
+pgw_edit_rewrite()
+{
+	if (pgw_edit_state != PGW_EDIT_ON) {
+		return;
+	}
+	if (pgw_edit_len > PGW_EDIT_HDR_LEN &&
+			!pgw_edit_push(PGW_EDIT_WRITE, PGW_EDIT_HDR_LEN, 
+										 pgw_edit_len - PGW_EDIT_HDR_LEN, 1)) {
+		pgw_edit_state = PGW_EDIT_LOST;
+		return;
+	}
+	pgw_edit_state = PGW_EDIT_WHOLE;
+}
+
+/* 
+ * Undoes the recorded changes, last first, and restores the headers, length
+ * and link-layer addresses. Returns 0, with uip_buf unchanged, if a change 
+ * could not be recorded.
+ */
+static u8_t
+pgw_edit_restore()
+{
+	u8_t *pkt = &uip_buf[UIP_LLH_LEN];
+	pgw_edit_t e;
+	
+	if (pgw_edit_state == PGW_EDIT_LOST) {
+		pgw_edit_state = PGW_EDIT_OFF;
+		PGW_STAT(pgw_stats.edit_lost++);
+		return 0;
+	}
+	pgw_edit_state = PGW_EDIT_OFF;
+	while (pgw_edit_used > 0) {
+		pgw_edit_used -= sizeof(pgw_edit_t);
+		memcpy(&e, &pgw_edit_log[pgw_edit_used], sizeof(pgw_edit_t));
+		switch (e.op) {
+		case PGW_EDIT_INSERT:
+			memmove(&pkt[e.off], &pkt[e.off + e.len], e.pkt_len - e.off);
+			break;
+		case PGW_EDIT_REMOVE:
+			memmove(&pkt[e.off + e.len], &pkt[e.off], e.pkt_len - e.len - e.off);
+			/* And put the removed bytes back */
+		case PGW_EDIT_WRITE:
+			pgw_edit_used -= e.len;
+			memcpy(&pkt[e.off], &pgw_edit_log[pgw_edit_used], e.len);
+			break;
+		}
+	}
+	memcpy(pkt, pgw_edit_hdr, PGW_EDIT_HDR_LEN);
+	uip_len = pgw_edit_orig_len;
+	eui64_copy(&src_eui64, &pgw_src_eui64);
+	eui64_copy(&dst_eui64, &pgw_dst_eui64);
+	PGW_STAT(pgw_stats.undone++);
+	return 1;
+}
+
 static void 
 pgw_packet_input()
 {
@@ -120,41 +331,46 @@ pgw_packet_input()
 			return;
 		} else if (outgoing_if == UNDEFINED) {
 			/* Do both (Since the proxy operation may end up sending out a different packet,
-			 * we need to keep a copy uip_buf and uip_len). Note that reverting the order
-			 * does not eliminates the need of a copy either, since the local node may also
+			 * we need to get the packet back). Note that reverting the order
+			 * does not eliminates the need of it either, since the local node may also
 			 * overwrite uip_buf if it generates a packet in response.
+			 * Rather than a copy of the packet, which may be as large as uip_buf
+			 * (e.g. a RA with several PIOs or RIOs), the changes made by the proxy
+			 * and by the output to the first interface are recorded and undone.
+			 * Should they not fit in the log, the packet is not sent to the second 
+			 * interface rather than forwarded as it is, which would let an ND 
+			 * message through the gateway without being proxied.
 			 */
-			pgw_len = uip_len;
-			memcpy(pgw_buf, uip_buf, UIP_LLH_LEN + uip_len);
-			
+			pgw_edit_begin();
 			if (incoming_if == LOCAL) {
 				outgoing_if = IEEE_802_15_4;
 				proxy_input();
 				pgw_output();
-				/* Restore */
-				memcpy(uip_buf, pgw_buf, UIP_LLH_LEN + pgw_len);
-				uip_len = pgw_len;
+				if (!pgw_edit_restore()) {
+					goto discard;
+				}
 				outgoing_if = IEEE_802_3;
 			} else if (incoming_if == IEEE_802_3) {
 				outgoing_if = IEEE_802_15_4;
 				proxy_input();
 				pgw_output();
-				/* Restore */
-				memcpy(uip_buf, pgw_buf, UIP_LLH_LEN + pgw_len);
-				uip_len = pgw_len;
+				if (!pgw_edit_restore()) {
+					goto discard;
+				}
 				outgoing_if = LOCAL;
 			} else if (incoming_if == IEEE_802_15_4) {
 				/* In this particular case, proxy twice!*/
 				outgoing_if = IEEE_802_3;
 				proxy_input();
 				pgw_output();
-				/* Restore */
-				memcpy(uip_buf, pgw_buf, UIP_LLH_LEN + pgw_len);
-				uip_len = pgw_len;
+				if (!pgw_edit_restore()) {
+					goto discard;
+				}
 				outgoing_if = LOCAL;
 				proxy_input();
 			} else {
 				/* This should never happen */
+				pgw_edit_restore();
 				goto discard;
 			}
 		} else {
@@ -215,63 +431,71 @@ proxy_ns_input()
 		 * the same interface they they came */
 		outgoing_if = incoming_if;
 		
-		for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
-			if (nbr->isused) {
-				if (uip_is_addr_linklocal((uip_ipaddr_t *)(&UIP_ND6_NS_BUF->tgtipaddr))) {
-					create_eui64_based_ipaddr(&fipaddr, &nbr->lladdr);
-					ipaddr = &fipaddr;
-				} else {
-					ipaddr = &nbr->ipaddr;
-				}
-				if(uip_ipaddr_cmp(ipaddr, (uip_ipaddr_t *)(&UIP_ND6_NS_BUF->tgtipaddr))) {
-					/* We'll probably have to reply this packet */
-					if (nbr->state == PGW_REGISTERED) {
-						if (!uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-							/* message sent for AR. Respond on behalf of 6LN */
-							pgw_create_na(ipaddr, &UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr,
-														UIP_ND6_NA_FLAG_OVERRIDE | UIP_ND6_NA_FLAG_SOLICITED);
-							/* Set dst. MAC address */
-							eui64_copy(&dst_eui64, &src_eui64);
-						} else {
-							/* 
-							 * Message sent for DAD. There is a IEEE 802.3 node trying to 
-							 * configure an address that is in use. Inform the IEEE 802.3 node
-							 * that the address is in use 
-							 */
-						 	uip_create_linklocal_allnodes_mcast(&fipaddr);
-							pgw_create_na(ipaddr, &fipaddr, &UIP_ND6_NS_BUF->tgtipaddr,
-														UIP_ND6_NA_FLAG_OVERRIDE);
-							/* Set dst. MAC address */
-							eui64_copy(&dst_eui64, &rimeaddr_null);
-						}
-						/* include TLLAO option */
-						pgw_append_icmp_opt(UIP_ND6_OPT_TLLAO, &nbr->lladdr, 0, 0);
-						/* Compute checksum */
-						pgw_update_icmp_checksum();
-						/* Set src MAC address */
-						eui64_copy(&src_eui64, &nbr->lladdr);
-					} else if (nbr->state == PGW_TENTATIVE) {
-						if (uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-							/* 
-							 * message sent for DAD. There is a IEEE 802.3 node trying to 
-							 * configure an address that is duplicated in the IEEE 802.15.4 
-							 * segment. DAD failed and the tentative address should not be used. 
-							 */
-							pgw_dad_failed(nbr);
-						} else {
-							/* message sent for AR. As the address is in TENTATIVE state, discard */
-							goto discard;
-						}
-					} else {
-						goto discard;
-					}
-					/* There can be 1 matching NCE at most. If we've found it, break the loop! */
-					break;
-				} 
+		/* NS sent to a solicited-node group none of our 6LNs has joined */
+		if (uip_is_addr_solicited_node(&UIP_IP_BUF->destipaddr) &&
+				(pgw_nbr_lookup_by_snma(&UIP_IP_BUF->destipaddr) == NULL)) {
+			goto discard;
+		}
+		
+		/* 
+		 * Find the target's NCE. Link-local targets are derived from the 6LN's 
+		 * EUI-64, so they are looked up by interface ID.
+		 */
+		if (uip_is_addr_linklocal((uip_ipaddr_t *)(&UIP_ND6_NS_BUF->tgtipaddr))) {
+			nbr = pgw_nbr_lookup_by_iid((uip_ipaddr_t *)(&UIP_ND6_NS_BUF->tgtipaddr));
+			if (nbr == NULL) {
+				/* We did not find the destination */
+				goto discard;
+			}
+			create_eui64_based_ipaddr(&fipaddr, &nbr->lladdr);
+			ipaddr = &fipaddr;
+		} else {
+			nbr = pgw_nbr_lookup((uip_ipaddr_t *)(&UIP_ND6_NS_BUF->tgtipaddr));
+			if (nbr == NULL) {
+				/* We did not find the destination */
+				goto discard;
 			}
+			ipaddr = &nbr->ipaddr;
 		}
-		if (ipaddr == NULL) {
-			/* We did not find the destination */
+		/* We'll probably have to reply this packet */
+		if (nbr->state == PGW_REGISTERED) {
+			if (!uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+				/* message sent for AR. Respond on behalf of 6LN */
+				pgw_create_na(ipaddr, &UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr,
+											UIP_ND6_NA_FLAG_OVERRIDE | UIP_ND6_NA_FLAG_SOLICITED);
+				/* Set dst. MAC address */
+				eui64_copy(&dst_eui64, &src_eui64);
+			} else {
+				/* 
+				 * Message sent for DAD. There is a IEEE 802.3 node trying to 
+				 * configure an address that is in use. Inform the IEEE 802.3 node
+				 * that the address is in use 
+				 */
+			 	uip_create_linklocal_allnodes_mcast(&fipaddr);
+				pgw_create_na(ipaddr, &fipaddr, &UIP_ND6_NS_BUF->tgtipaddr,
+											UIP_ND6_NA_FLAG_OVERRIDE);
+				/* Set dst. MAC address */
+				eui64_copy(&dst_eui64, &rimeaddr_null);
+			}
+			/* include TLLAO option */
+			pgw_append_icmp_opt(UIP_ND6_OPT_TLLAO, &nbr->lladdr, 0, 0);
+			/* Compute checksum */
+			pgw_update_icmp_checksum();
+			/* Set src MAC address */
+			eui64_copy(&src_eui64, &nbr->lladdr);
+		} else if (nbr->state == PGW_TENTATIVE) {
+			if (uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+				/* 
+				 * message sent for DAD. There is a IEEE 802.3 node trying to 
+				 * configure an address that is duplicated in the IEEE 802.15.4 
+				 * segment. DAD failed and the tentative address should not be used. 
+				 */
+				pgw_dad_failed(nbr);
+			} else {
+				/* message sent for AR. As the address is in TENTATIVE state, discard */
+				goto discard;
+			}
+		} else {
 			goto discard;
 		}
 		break;
@@ -363,8 +587,9 @@ proxy_ns_input()
 				 * registered or deleted.
 				 */
 				stimer_set(&(nbr->reachable), uip_ntohs(pgw_opt_aro->lifetime) * 60);
-				/* Perform DAD on behalf of 6LN */
-				pgw_dad(nbr);
+				pgw_nbr_schedule(nbr);
+				/* Perform DAD on behalf of 6LN, as soon as the DAD scheduler allows */
+				pgw_dad_start(nbr);
 			}
     } else { /* nbr != NULL */
      	/* 
@@ -389,6 +614,7 @@ proxy_ns_input()
 				 	 * to restart it just before responding the NA in response 
 				 	 */
           stimer_set(&(nbr->reachable), uip_ntohs(pgw_opt_aro->lifetime) * 60); 
+          pgw_nbr_schedule(nbr);
           nbr->aro_pending = 1;
         } else if (nbr->state == PGW_TENTATIVE){
         	/* 
@@ -469,6 +695,7 @@ proxy_na_input()
 					pgw_update_icmp_checksum();
 					/* Reset the timer */
 					stimer_restart(&(nbr->reachable));
+					pgw_nbr_schedule(nbr);
 				} else if (nbr->state == PGW_REGISTERED){
 					goto forward;
 				} else {
@@ -543,6 +770,16 @@ proxy_rs_input()
 										0, PGW_TENTATIVE));
     } 
 		if (nbr != NULL) {
+#if PGW_RA_CACHE
+			if (outgoing_if == LOCAL && uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+				/* Second pass of a multicast RS: the first one has handled the 6LN */
+				break;
+			}
+			if (pgw_ra_answer(nbr)) {
+				/* Answered from the template, the RR need not see the RS */
+				goto discard;
+			}
+#endif /* PGW_RA_CACHE */
     	nbr->ra_pending = 1;
     	/* Set also global ra_pending flag */
     	ra_pending = 1;
@@ -559,7 +796,9 @@ discard:
 static void
 proxy_ra_input()
 {
-	u8_t aux_len;
+	pgw_chksum_t chksum;
+	u16_t opt_start;
+	u8_t matched;
 	
 	switch (incoming_if) {
 	case IEEE_802_3:
@@ -572,6 +811,7 @@ proxy_ra_input()
 		 * - The 'L' on-link flag in the PIO option is clear.
 		 */
 		pgw_opt_llao = NULL;
+		pgw_opt_prefix_info = NULL;
 		pgw_opt_offset = UIP_ND6_RA_LEN;
   	while(uip_l3_icmp_hdr_len + pgw_opt_offset < uip_len) {
 			if(UIP_PGW_OPT_HDR_BUF->len == 0) {
@@ -584,9 +824,14 @@ proxy_ra_input()
     	}
     	pgw_opt_offset += CURRENT_OPT_LENGTH;
   	}
+		/* The RA is only modified in a few places: update its checksum as we go */
+		pgw_chksum_begin(&chksum);
 		if (pgw_opt_prefix_info != NULL) {
 			/* If there is a PIO option, make sure the 'L' on-link flag is clear */
+			pgw_chksum_remove(&chksum, &pgw_opt_prefix_info->preflen, 2);
+			pgw_edit_write(&pgw_opt_prefix_info->flagsreserved1, 1);
 			pgw_opt_prefix_info->flagsreserved1 &= ~UIP_ND6_RA_FLAG_ONLINK;
+			pgw_chksum_insert(&chksum, &pgw_opt_prefix_info->preflen, 2);
 			/* Also use the network prefix to create/update a context entry. If at some
 			 * point the network prefix announced in RA messages changes, the corresponding
 			 * context will eventually expire with no hazards */
@@ -600,47 +845,58 @@ proxy_ra_input()
 			} else if (context->state == IN_USE_COMPRESS) {
 				/* Reset timer */
 				stimer_reset(&context->vlifetime);
+				pgw_context_schedule(context);
 			} else if (context->state == EXPIRED) {
 				/* Set timer and return to IN_USE_COMPRESS state */
 				context->state = IN_USE_COMPRESS;
 				stimer_set(&context->vlifetime, PGW_CONTEXT_LIFETIME);
+				pgw_context_schedule(context);
 				context_chaged = 1;
 			}
 		}
+		/* The RA is kept as template even if no 6LN is waiting for it */
+		matched = pgw_ra_match();
+		if (!matched) {
+			/* The options are appended at the end of the RA */
+			opt_start = uip_len;
+			if (pgw_opt_llao == NULL) {
+				/* If there is no SLLAO option, append it */
+				pgw_append_icmp_opt(UIP_ND6_OPT_SLLAO, &src_eui64, 0, 0);
+			}
+			/* Always append a 6CO option per context in use */
+			for(context = pgw_addr_context_table;
+	      context < pgw_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; context++) {
+	      if (context->state != NOT_IN_USE) {
+					pgw_append_icmp_opt(UIP_ND6_OPT_6CO, context, 0, 0);
+	      }
+			}
+			pgw_chksum_insert(&chksum, &uip_buf[UIP_LLH_LEN + opt_start], 
+												uip_len - opt_start);
+			pgw_chksum_end(&chksum);
+			pgw_ra_save(opt_start);
+		}
+#if PGW_RA_CACHE
+		pgw_ra_time = clock_seconds();
+#endif /* PGW_RA_CACHE */
 		/* After handling contexts and RR's addresses check whether continueing 
 		 * is needed. */
 		if (!ra_pending && !context_chaged) {
 			goto discard;
 		}
 		/* This RA will be forwarded */
-		
-		if (pgw_opt_llao == NULL) {
-			/* If there is no SLLAO option, append it */
-			pgw_append_icmp_opt(UIP_ND6_OPT_SLLAO, &src_eui64, 0, 0);
+		if (matched) {
+			/* The RR repeats itself: reuse the template, only the destination differs */
+			uip_ipaddr_copy(&fipaddr, &UIP_IP_BUF->destipaddr);
+			pgw_ra_restore(&fipaddr);
+			PGW_STAT(pgw_stats.ra_reused++);
 		}
-		/* Always append a 6CO option per context in use */
-		for(context = pgw_addr_context_table;
-      context < pgw_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; context++) {
-      if (context->state != NOT_IN_USE) {
-				pgw_append_icmp_opt(UIP_ND6_OPT_6CO, context, 0, 0);
-      }
-		}
-		/* The most likely situation is that there is going to be at least one
-		 * context, so always update checksum */
-		pgw_update_icmp_checksum();
-		
 		
 		if (context_chaged) {
 			/* We are going to send out a multicast RA */
 			if(ra_pending) {
 				/* Since all 6LNs are going to receive a RA, we must clear the 
 				 * RA-pending flag for every NCE*/
-				for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
-					if(nbr->isused && nbr->ra_pending) {
-						nbr->ra_pending = 0;
-					}
-				}	 
-				ra_pending = 0;  
+				pgw_ra_clear_pending();
 			}
 			if (!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
 				/* Set destination IPv6 address*/
@@ -654,25 +910,16 @@ proxy_ra_input()
 			 * choose to send it only to the 6LNs whose NCEs are marked as 
 			 * ra_pending. Since routers may choose to delay the router advertisement
 			 * in order to respond to several solicitations, we have to send the RA 
-			 * to all marked NCEs. */
+			 * to all marked NCEs. They are served from the template once the 
+			 * hold-down has collected the RSs sent meanwhile. */
 			if (uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-				/* Save uip_len, as pgw_output sets it to 0 */
-				aux_len = uip_len;
-				for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
-					if(nbr->isused && nbr->ra_pending) {
-						/* Retrieve uip_len (we might have cleared it if we've sent a packet) */
-						uip_len = aux_len;
-						/* Set destination IPv6 address*/
-						uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &nbr->ipaddr);
-						/* And destination MAC address */
-						eui64_copy(&dst_eui64, &nbr->lladdr);
-						/* Send packet out */
-						pgw_output();
-						/* Clear the RA-pending flag */
-						nbr->ra_pending = 0;
-					}
+				if (pgw_ra_len == 0) {
+					/* Too long to be kept: every 6LN gets this very RA */
+					pgw_ra_clear_pending();
+				} else {
+					uip_len = 0;
+					pgw_ra_schedule();
 				}
-				ra_pending = 0;
 			} else {
 				/* 
 				 * The RA message is unicast. Clear NCE's ra_pending flag in case 
@@ -720,6 +967,266 @@ proxy_redirect_input()
 	return;
 }
 
+/* 
+ * Whether the RR's RA in uip_buf (whose PIO has already been processed) is the
+ * one the template was built from, for the same contexts. Only its destination
+ * and checksum may differ.
+ */
+static u8_t
+pgw_ra_match()
+{
+	if (pgw_ra_len == 0 || context_chaged || uip_len != pgw_ra_rrlen ||
+			!eui64_cmp(&src_eui64, &pgw_ra_src_eui64) ||
+			!uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, 
+											&((struct uip_ip_hdr *)pgw_ra_template)->srcipaddr)) {
+		return 0;
+	}
+	/* Compare the RA from the byte following the ICMPv6 checksum */
+	return pgw_ra_count_contexts() == pgw_ra_contexts &&
+		memcmp(&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + 4], &pgw_ra_template[UIP_IPH_LEN + 4],
+					uip_len - UIP_IPH_LEN - 4) == 0;
+}
+
+/* 
+ * Number of contexts in use, each of which has a 6CO in the template. A context
+ * may have been removed without notice since the template was built.
+ */
+static u8_t
+pgw_ra_count_contexts()
+{
+	u8_t contexts = 0;
+	
+	for(context = pgw_addr_context_table;
+    context < pgw_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; context++) {
+    if (context->state != NOT_IN_USE) {
+			contexts++;
+    }
+	}
+	return contexts;
+}
+
+/* 
+ * Keeps the RA in uip_buf, built from an RR's RA of rrlen bytes, as template. 
+ * If it does not fit in PGW_RA_TEMPLATE_LEN, there is no template.
+ */
+static void
+pgw_ra_save(u16_t rrlen)
+{
+#if PGW_RA_CACHE
+	u32_t lifetime;
+	
+#endif /* PGW_RA_CACHE */
+	pgw_ra_len = 0;
+	PGW_STAT(pgw_stats.ra_rebuilt++);
+	if (uip_len > PGW_RA_TEMPLATE_LEN) {
+		return;
+	}
+	memcpy(pgw_ra_template, &uip_buf[UIP_LLH_LEN], uip_len);
+	pgw_ra_len = uip_len;
+	pgw_ra_rrlen = rrlen;
+	eui64_copy(&pgw_ra_src_eui64, &src_eui64);
+	pgw_ra_contexts = pgw_ra_count_contexts();
+#if PGW_RA_CACHE
+	/* The template is used until its shortest lifetime runs out */
+	pgw_ra_maxage = PGW_RA_CACHE_LIFETIME;
+	lifetime = uip_ntohs(UIP_ND6_RA_BUF->router_lifetime);
+	if (lifetime != 0 && lifetime < pgw_ra_maxage) {
+		pgw_ra_maxage = lifetime;
+	}
+	pgw_ra_pio = 0;
+	if (pgw_opt_prefix_info != NULL) {
+		pgw_ra_pio = (u8_t *)pgw_opt_prefix_info - &uip_buf[UIP_LLH_LEN];
+		lifetime = uip_ntohl(pgw_opt_prefix_info->validlt);
+		if (lifetime < pgw_ra_maxage) {
+			pgw_ra_maxage = lifetime;
+		}
+	}
+	/* And while every 6CO, aged in whole minutes, still has some lifetime */
+	for(context = pgw_addr_context_table;
+    context < pgw_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; context++) {
+    if (context->state != NOT_IN_USE) {
+			lifetime = context->vlifetime.interval / 60;
+			lifetime = lifetime > 0 ? (lifetime - 1) * 60 : 0;
+			if (lifetime < pgw_ra_maxage) {
+				pgw_ra_maxage = lifetime;
+			}
+    }
+	}
+#endif /* PGW_RA_CACHE */
+}
+
+/* 
+ * Copies the template to uip_buf, ready to be proxied to the IEEE 802.15.4 
+ * segment, and sets its destination IPv6 address (dst must not point to 
+ * uip_buf). Sending the packet may translate its LLAO in place, so it is 
+ * restored before each transmission. The packet in uip_buf is replaced: 
+ * changes made to the copy need not be recorded in the edit log.
+ */
+static void
+pgw_ra_restore(uip_ipaddr_t *dst)
+{
+	pgw_chksum_t chksum;
+	
+	pgw_edit_rewrite();
+	memcpy(&uip_buf[UIP_LLH_LEN], pgw_ra_template, pgw_ra_len);
+	uip_len = pgw_ra_len;
+	eui64_copy(&src_eui64, &pgw_ra_src_eui64);
+	incoming_if = IEEE_802_3;
+	outgoing_if = IEEE_802_15_4;
+	if (!uip_ipaddr_cmp(&UIP_IP_BUF->destipaddr, dst)) {
+		/* Only the address changes in the checksum */
+		pgw_chksum_begin(&chksum);
+		pgw_chksum_remove(&chksum, &UIP_IP_BUF->destipaddr, sizeof(uip_ipaddr_t));
+		uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dst);
+		pgw_chksum_insert(&chksum, &UIP_IP_BUF->destipaddr, sizeof(uip_ipaddr_t));
+		pgw_chksum_end(&chksum);
+	}
+}
+
+#if PGW_RA_CACHE
+/* 
+ * Answers the RS in uip_buf, from n, with a unicast RA built from the template,
+ * its router, prefix and context lifetimes aged since the RR sent it. Returns 
+ * 0, with the RS untouched, if there is no template, it has gone stale or the
+ * contexts have changed since it was built.
+ */
+static u8_t
+pgw_ra_answer(pgw_nbr_t *n)
+{
+	pgw_chksum_t chksum;
+	uip_nd6_opt_prefix_info *pio;
+	uip_nd6_opt_6co *co;
+	u32_t age, lifetime;
+	u16_t off;
+	
+	age = clock_seconds() - pgw_ra_time;
+	if (pgw_ra_len == 0 || age >= pgw_ra_maxage || context_chaged ||
+			pgw_ra_count_contexts() != pgw_ra_contexts) {
+		return 0;
+	}
+	uip_ipaddr_copy(&fipaddr, &UIP_IP_BUF->srcipaddr);
+	pgw_ra_restore(&fipaddr);
+	if (age > 0) {
+		pgw_chksum_begin(&chksum);
+		lifetime = uip_ntohs(UIP_ND6_RA_BUF->router_lifetime);
+		if (lifetime != 0) {
+			pgw_chksum_remove(&chksum, &UIP_ND6_RA_BUF->router_lifetime, 2);
+			UIP_ND6_RA_BUF->router_lifetime = uip_htons((u16_t)(lifetime - age));
+			pgw_chksum_insert(&chksum, &UIP_ND6_RA_BUF->router_lifetime, 2);
+		}
+		if (pgw_ra_pio != 0) {
+			/* Infinite lifetimes are not aged */
+			pio = (uip_nd6_opt_prefix_info *)&uip_buf[UIP_LLH_LEN + pgw_ra_pio];
+			pgw_chksum_remove(&chksum, &pio->validlt, 8);
+			lifetime = uip_ntohl(pio->validlt);
+			if (lifetime != 0xffffffff) {
+				pio->validlt = uip_htonl(lifetime - age);
+			}
+			lifetime = uip_ntohl(pio->preferredlt);
+			if (lifetime != 0xffffffff) {
+				pio->preferredlt = uip_htonl(lifetime > age ? lifetime - age : 0);
+			}
+			pgw_chksum_insert(&chksum, &pio->validlt, 8);
+		}
+		/* 6CO lifetimes are in units of 60 s: round the age up */
+		for (off = UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_RA_LEN; off < uip_len; 
+				off += co->len << 3) {
+			co = (uip_nd6_opt_6co *)&uip_buf[UIP_LLH_LEN + off];
+			if (co->len == 0) {
+				break;
+			}
+			if (co->type == UIP_ND6_OPT_6CO) {
+				pgw_chksum_remove(&chksum, &co->lifetime, 2);
+				lifetime = uip_ntohs(co->lifetime);
+				co->lifetime = uip_htons(lifetime > (age + 59) / 60 ? 
+																	(u16_t)(lifetime - (age + 59) / 60) : 0);
+				pgw_chksum_insert(&chksum, &co->lifetime, 2);
+			}
+		}
+		pgw_chksum_end(&chksum);
+	}
+	eui64_copy(&dst_eui64, &n->lladdr);
+	pgw_output();
+	/* The RS may still be delivered to the local host */
+	incoming_if = IEEE_802_15_4;
+	n->ra_pending = 0;
+	PGW_STAT(pgw_stats.ra_answered++);
+	return 1;
+}
+#endif /* PGW_RA_CACHE */
+
+/* Clears the RA-pending flag of every NCE, once they all have been sent a RA */
+static void
+pgw_ra_clear_pending()
+{
+	for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
+		if(nbr->isused && nbr->ra_pending) {
+			nbr->ra_pending = 0;
+		}
+	}
+	ra_pending = 0;
+	etimer_stop(&pgw_ra_timer);
+}
+
+/* Sends the template to the pending 6LNs after the hold-down, if not running yet */
+static void
+pgw_ra_schedule()
+{
+#if PGW_RA_HOLDDOWN
+	if (etimer_expired(&pgw_ra_timer)) {
+		PROCESS_CONTEXT_BEGIN(&pgw_process);
+		etimer_set(&pgw_ra_timer, PGW_RA_HOLDDOWN);
+		PROCESS_CONTEXT_END(&pgw_process);
+	}
+#else
+	pgw_ra_flush();
+#endif /* PGW_RA_HOLDDOWN */
+}
+
+/* 
+ * Sends the template to the 6LNs marked as ra_pending: a single link-local 
+ * all-nodes RA if there are at least PGW_RA_MCAST_THRESHOLD of them, a unicast
+ * RA to each of them otherwise.
+ */
+void
+pgw_ra_flush()
+{
+	u8_t pending = 0;
+	
+	if (pgw_ra_len == 0) {
+		return;
+	}
+	for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
+		if(nbr->isused && nbr->ra_pending) {
+			pending++;
+		}
+	}
+	if (pending == 0) {
+		ra_pending = 0;
+		return;
+	}
+	
+	if (pending >= PGW_RA_MCAST_THRESHOLD) {
+		uip_create_linklocal_allnodes_mcast(&fipaddr);
+		pgw_ra_restore(&fipaddr);
+		eui64_copy(&dst_eui64, &rimeaddr_null);
+		pgw_output();
+		PGW_STAT(pgw_stats.ra_mcast++);
+		pgw_ra_clear_pending();
+		return;
+	}
+	for(nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
+		if(nbr->isused && nbr->ra_pending) {
+			pgw_ra_restore(&nbr->ipaddr);
+			eui64_copy(&dst_eui64, &nbr->lladdr);
+			pgw_output();
+			PGW_STAT(pgw_stats.ra_ucast++);
+			nbr->ra_pending = 0;
+		}
+	}
+	ra_pending = 0;
+}
+
 static void
 pgw_output(){
 	if (uip_len > 0) {
@@ -734,6 +1241,8 @@ pgw_output(){
 void pgw_create_ns(uip_ipaddr_t* src, uip_ipaddr_t* dst, uip_ipaddr_t* tgt){
 	
 	uip_ipaddr_t aux;
+	
+	pgw_edit_rewrite();
 	/* 
 	 * Deep copy address to ensure that addresses are not overwriten 
 	 * (in case src and/or dst point to each other).
@@ -780,6 +1289,7 @@ pgw_create_na(uip_ipaddr_t* src, uip_ipaddr_t* dst, uip_ipaddr_t* tgt, u8_t flag
 		
 	uip_ipaddr_t aux;
 	
+	pgw_edit_rewrite();
 	uip_ipaddr_copy(&aux, src);
   uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dst);
 	uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &aux);
@@ -817,15 +1327,16 @@ pgw_append_icmp_opt(u8_t type, void* data, u8_t status, u16_t lifetime)
 	switch (type) {
 	case UIP_ND6_OPT_SLLAO:
 	case UIP_ND6_OPT_TLLAO:
+		pgw_edit_insert(UIP_ICMP_OPTS_APPEND, UIP_ND6_OPT_LLAO_LEN);
 		UIP_ICMP_OPTS_APPEND->len = UIP_ND6_OPT_LLAO_LEN >> 3;
   	memcpy((u8_t*)(UIP_ICMP_OPTS_APPEND) + UIP_ND6_OPT_DATA_OFFSET, data, UIP_LLADDR_LEN);
   	/* padding required */
   	memset((u8_t*)(UIP_ICMP_OPTS_APPEND) + UIP_ND6_OPT_DATA_OFFSET + UIP_LLADDR_LEN, 0,
     				UIP_ND6_OPT_LLAO_LEN - 2 - UIP_LLADDR_LEN);
-    UIP_IP_BUF->len[1] += UIP_ND6_OPT_LLAO_LEN;
     uip_len += UIP_ND6_OPT_LLAO_LEN;
 		break;
 	case UIP_ND6_OPT_ARO:
+		pgw_edit_insert(UIP_ICMP_OPTS_APPEND, UIP_ND6_OPT_ARO_LEN);
 		UIP_ICMP_OPTS_APPEND->len = UIP_ND6_OPT_ARO_LEN >> 3;
 		((uip_nd6_opt_aro*)UIP_ICMP_OPTS_APPEND)->status = status;
 		/* The reserved field MUST be initialized to zero by the sender */		
@@ -834,13 +1345,14 @@ pgw_append_icmp_opt(u8_t type, void* data, u8_t status, u16_t lifetime)
   	((uip_nd6_opt_aro*)UIP_ICMP_OPTS_APPEND)->lifetime = lifetime;
 		memcpy(&(((uip_nd6_opt_aro*)UIP_ICMP_OPTS_APPEND)->eui64), data, UIP_LLADDR_LEN);
 		/* No need for padding here */
-		UIP_IP_BUF->len[1] += UIP_ND6_OPT_ARO_LEN;
 		uip_len += UIP_ND6_OPT_ARO_LEN;
 		break;
 	case UIP_ND6_OPT_6CO:
 		if (((pgw_addr_context_t*)data)->length > 64) {
+			pgw_edit_insert(UIP_ICMP_OPTS_APPEND, 24);
 			UIP_ICMP_OPTS_APPEND->len = 3; /* Units of 8 octets */
 		} else {
+			pgw_edit_insert(UIP_ICMP_OPTS_APPEND, 16);
 			UIP_ICMP_OPTS_APPEND->len = 2; /* Units of 8 octets */
 		}
 		((uip_nd6_opt_6co*)UIP_ICMP_OPTS_APPEND)->preflen = ((pgw_addr_context_t*)data)->length;
@@ -854,10 +1366,25 @@ pgw_append_icmp_opt(u8_t type, void* data, u8_t status, u16_t lifetime)
 		memcpy(&(((uip_nd6_opt_6co*)UIP_ICMP_OPTS_APPEND)->prefix), 
 						&((pgw_addr_context_t*)data)->prefix,
 						((pgw_addr_context_t*)data)->length);
-		UIP_IP_BUF->len[1] += UIP_ICMP_OPTS_APPEND->len << 3;
     uip_len += UIP_ICMP_OPTS_APPEND->len << 3;
 		break;	
 	}
+	/* RAs may be longer than 255 bytes */
+	UIP_IP_BUF->len[0] = (u8_t)((uip_len - UIP_IPH_LEN) >> 8);
+	UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
+}
+
+/* Hashes len bytes of data. Used to index the bridge and neighbor caches; the
+ * caller masks the result to the size of its hash index. */
+u16_t
+pgw_hash(const u8_t *data, u8_t len)
+{
+	u16_t h = 0;
+	
+	while (len--) {
+		h = ((h << 5) | (h >> 11)) ^ *data++;
+	}
+	return h;
 }
 
 /* Updates the ICMPv6 checksum */
@@ -867,6 +1394,57 @@ pgw_update_icmp_checksum(){
 	UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 }
 
+/* One's complement addition */
+static u16_t
+chksum_add(u16_t a, u16_t b)
+{
+	a += b;
+	return (a < b) ? a + 1 : a;
+}
+
+/* Starts an incremental update from the checksum of the packet in uip_buf */
+void
+pgw_chksum_begin(pgw_chksum_t *c)
+{
+	c->sum = (u16_t)~uip_ntohs(UIP_ICMP_BUF->icmpchksum);
+	c->len = uip_len - UIP_IPH_LEN;
+}
+
+/* Adds len bytes written to the message */
+void
+pgw_chksum_insert(pgw_chksum_t *c, const void *data, u16_t len)
+{
+	c->sum = uip_chksum_add(c->sum, data, len);
+}
+
+/* Subtracts len bytes about to be removed or overwritten (RFC 1624, eqn. 3) */
+void
+pgw_chksum_remove(pgw_chksum_t *c, const void *data, u16_t len)
+{
+	c->sum = chksum_add(c->sum, (u16_t)~uip_chksum_add(0, data, len));
+}
+
+/* 
+ * Returns the checksum field (network byte order) of the message if its 
+ * upper-layer length is len. It does not change c, so it can be used for a 
+ * copy of the headers with a different length.
+ */
+u16_t
+pgw_chksum_value(pgw_chksum_t *c, u16_t len)
+{
+	u16_t sum;
+	
+	sum = chksum_add(chksum_add(c->sum, (u16_t)~c->len), len);
+	return uip_htons((u16_t)~sum);
+}
+
+/* Writes the checksum of the packet in uip_buf */
+void
+pgw_chksum_end(pgw_chksum_t *c)
+{
+	UIP_ICMP_BUF->icmpchksum = pgw_chksum_value(c, uip_len - UIP_IPH_LEN);
+}
+
 /* This function expects a NS with ARO to be in uip_buf and generates
  * the NA with ARO in response depending on the value of status. */
 static void
@@ -923,18 +1501,71 @@ pgw_eventhandler(process_event_t ev, process_data_t data)
 {
 	if (ev == PROCESS_EVENT_TIMER) { 
 		if(data == &pgw_timer_periodic && etimer_expired(&pgw_timer_periodic)) {
+			/* pgw_periodic() re-arms the timer for the next deadline */
 			pgw_periodic();
 			pgw_output();
-			etimer_reset(&pgw_timer_periodic);	
+			pgw_fwd_rx_filter_sync();
+		} else if (data == &pgw_ra_timer) {
+			/* The hold-down is over: answer the RSs collected meanwhile */
+			pgw_ra_flush();
 		}
 	}
 }
 
+#if PGW_PROFILE
+void
+pgw_profile_reset(void)
+{
+	memset(pgw_profile, 0, sizeof(pgw_profile));
+}
+
+/* Kind of message in uip_buf, as told apart by the profiler */
+static u8_t
+pgw_profile_type(void)
+{
+	if (UIP_IP_BUF->proto != UIP_PROTO_ICMP6) {
+		return PGW_PROF_OTHER;
+	}
+	switch (UIP_ICMP_BUF->type) {
+	case ICMP6_NS:
+		return PGW_PROF_NS;
+	case ICMP6_NA:
+		return PGW_PROF_NA;
+	case ICMP6_RS:
+		return PGW_PROF_RS;
+	case ICMP6_RA:
+		return PGW_PROF_RA;
+	case ICMP6_REDIRECT:
+		return PGW_PROF_REDIRECT;
+	default:
+		return PGW_PROF_ICMP6;
+	}
+}
+#endif /* PGW_PROFILE */
+
 void
 pgw_input(void)
 {
+#if PGW_PROFILE
+	u8_t type;
+	u32_t start;
+	
+	/* Take the type now, the packet may be replaced while it is processed */
+	type = pgw_profile_type();
+	start = clock_cycles();
+#endif /* PGW_PROFILE */
 	pgw_packet_input();
 	pgw_output();
+	/* Neighbors may have registered or the bridge learned new stations */
+	pgw_fwd_rx_filter_sync();
+#if PGW_PROFILE
+	start = clock_cycles() - start;
+	pgw_profile[type].count++;
+	pgw_profile[type].cycles += start;
+	if (start > pgw_profile[type].max) {
+		pgw_profile[type].max = start;
+	}
+#endif /* PGW_PROFILE */
 }
 
 PROCESS_THREAD(pgw_process, ev, data)
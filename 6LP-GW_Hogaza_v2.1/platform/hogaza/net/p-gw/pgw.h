@@ -15,8 +15,16 @@
 
 #define NULL 0
 
-/* Time between periodic processings */
-#define PGW_PERIOD (CLOCK_SECOND/10)
+/* 
+ * Maximum time between periodic processings. Neighbor and context timers are
+ * kept in a deadline heap (see pgw_nd.c), so the periodic timer normally fires
+ * at the next deadline; this bounds the sleep for bridge cache ageing.
+ */
+#ifdef PGW_CONF_PERIOD
+#define PGW_PERIOD PGW_CONF_PERIOD
+#else
+#define PGW_PERIOD (CLOCK_SECOND * 10)
+#endif /* PGW_CONF_PERIOD */
 /* Maximum number of contexts */
 #define PGW_CONF_MAX_ADDR_CONTEXTS 16
 /* Minimum delay between context changes (I-D.ietf.6lowpan-nd) */
@@ -38,7 +46,163 @@
 #endif /* PGW_CONF_CONTEXT_LIFETIME */
 
 /* The number of NS messages to be sent for DAD */
+#ifdef PGW_CONF_MAX_DAD_NS
+#define PGW_MAX_DAD_NS		PGW_CONF_MAX_DAD_NS
+#else
 #define PGW_MAX_DAD_NS		1
+#endif /* PGW_CONF_MAX_DAD_NS */
+
+/* Time (in clock ticks) to wait for a reply to a DAD NS */
+#ifdef PGW_CONF_DAD_RETRANS
+#define PGW_DAD_RETRANS		PGW_CONF_DAD_RETRANS
+#else
+#define PGW_DAD_RETRANS		(UIP_ND6_RETRANS_TIMER / 1000 * CLOCK_SECOND)
+#endif /* PGW_CONF_DAD_RETRANS */
+
+/* 
+ * DAD scheduler. The registrations waiting for DAD are queued, and at most 
+ * PGW_DAD_INFLIGHT of them are probed at the same time. DAD NSs are sent to 
+ * the LAN at PGW_DAD_RATE per second at most, in bursts of PGW_DAD_BURST.
+ */
+#ifdef PGW_CONF_DAD_INFLIGHT
+#define PGW_DAD_INFLIGHT	PGW_CONF_DAD_INFLIGHT
+#else
+#define PGW_DAD_INFLIGHT	8
+#endif /* PGW_CONF_DAD_INFLIGHT */
+
+#ifdef PGW_CONF_DAD_RATE
+#define PGW_DAD_RATE			PGW_CONF_DAD_RATE
+#else
+#define PGW_DAD_RATE			20
+#endif /* PGW_CONF_DAD_RATE */
+
+#ifdef PGW_CONF_DAD_BURST
+#define PGW_DAD_BURST			PGW_CONF_DAD_BURST
+#else
+#define PGW_DAD_BURST			4
+#endif /* PGW_CONF_DAD_BURST */
+
+/* Collect 6LP-GW statistics (bridge cache, queues, buffers...) */
+#ifdef PGW_CONF_STATISTICS
+#define PGW_STATISTICS PGW_CONF_STATISTICS
+#else
+#define PGW_STATISTICS 0
+#endif /* PGW_CONF_STATISTICS */
+
+#if PGW_STATISTICS
+#define PGW_STAT(s) s
+#else
+#define PGW_STAT(s)
+#endif /* PGW_STATISTICS */
+
+/* 
+ * RA coalescing. The last RA from the RR, with its SLLAO and 6CO options, is 
+ * kept as a template and only rebuilt when the RR's RA or the contexts change.
+ * A multicast RA answering pending RSs is held for PGW_RA_HOLDDOWN ticks to 
+ * collect further RSs (0 sends it at once). Then, if at least 
+ * PGW_RA_MCAST_THRESHOLD 6LNs are waiting, a single link-local all-nodes RA is
+ * broadcast; otherwise one unicast RA is sent to each of them.
+ */
+#ifdef PGW_CONF_RA_HOLDDOWN
+#define PGW_RA_HOLDDOWN PGW_CONF_RA_HOLDDOWN
+#else
+#define PGW_RA_HOLDDOWN (CLOCK_SECOND / 2)
+#endif /* PGW_CONF_RA_HOLDDOWN */
+
+#ifdef PGW_CONF_RA_MCAST_THRESHOLD
+#define PGW_RA_MCAST_THRESHOLD PGW_CONF_RA_MCAST_THRESHOLD
+#else
+#define PGW_RA_MCAST_THRESHOLD 3
+#endif /* PGW_CONF_RA_MCAST_THRESHOLD */
+
+/* Bytes of the RA template (IPv6 header included). Longer RAs are broadcast */
+#ifdef PGW_CONF_RA_TEMPLATE_LEN
+#define PGW_RA_TEMPLATE_LEN PGW_CONF_RA_TEMPLATE_LEN
+#else
+#define PGW_RA_TEMPLATE_LEN 192
+#endif /* PGW_CONF_RA_TEMPLATE_LEN */
+
+/* 
+ * Answer RSs from the RA template. Every RA from the RR refreshes the template,
+ * and a RS from a 6LN gets a unicast RA at once, its router and prefix 
+ * lifetimes aged since the RR sent it. The RS is then not sent to the RR. A 
+ * template past one of those lifetimes, or older than PGW_RA_CACHE_LIFETIME 
+ * seconds, is not used: the RS waits for the RR as before.
+ */
+#ifdef PGW_CONF_RA_CACHE
+#define PGW_RA_CACHE PGW_CONF_RA_CACHE
+#else
+#define PGW_RA_CACHE 1
+#endif /* PGW_CONF_RA_CACHE */
+
+#ifdef PGW_CONF_RA_CACHE_LIFETIME
+#define PGW_RA_CACHE_LIFETIME PGW_CONF_RA_CACHE_LIFETIME
+#else
+#define PGW_RA_CACHE_LIFETIME 1800	/* seconds */
+#endif /* PGW_CONF_RA_CACHE_LIFETIME */
+
+/* 
+ * Bytes of the edit log of a packet both proxied and forwarded unchanged (see
+ * pgw_packet_input()). The proxy's edits are recorded in it and undone, instead
+ * of copying the packet. A packet the proxy replaces as a whole (e.g. a NS 
+ * answered with a NA) has its ICMPv6 body saved there at once, so the log must
+ * hold the body of a RA rebuilt from the template (PGW_RA_TEMPLATE_LEN).
+ */
+#ifdef PGW_CONF_EDIT_LOG_LEN
+#define PGW_EDIT_LOG_LEN PGW_CONF_EDIT_LOG_LEN
+#else
+#define PGW_EDIT_LOG_LEN 256
+#endif /* PGW_CONF_EDIT_LOG_LEN */
+
+#if PGW_STATISTICS
+/* Proxy statistics */
+typedef struct {
+	u32_t undone;			/* Packets both proxied and forwarded unchanged */
+	u32_t edit_lost;	/* Of them, not forwarded: the edit log could not hold the edits */
+	u32_t edit_max;		/* Most bytes of the edit log ever used */
+	u32_t llao_drops;	/* ND messages not sent to Ethernet: an LLAO could not be translated */
+	u32_t ra_rebuilt;	/* RA templates built from the RR's RA */
+	u32_t ra_reused;	/* RR's RAs answered from the cached template */
+	u32_t ra_mcast;		/* Coalesced RAs broadcast to all the 6LNs */
+	u32_t ra_ucast;		/* RAs unicast to a pending 6LN */
+	u32_t ra_answered;	/* RSs answered from the RA template */
+} pgw_stats_t;
+
+extern pgw_stats_t pgw_stats;
+#endif /* PGW_STATISTICS */
+
+/* 
+ * Time pgw_input() per kind of message (see pgw_bench.c). The time is taken 
+ * from clock_cycles(), which every platform provides in its clock_arch.h 
+ * along with its frequency, CLOCK_CYCLES_HZ.
+ */
+#ifdef PGW_CONF_PROFILE
+#define PGW_PROFILE PGW_CONF_PROFILE
+#else
+#define PGW_PROFILE 0
+#endif /* PGW_CONF_PROFILE */
+
+#if PGW_PROFILE
+/* Kinds of messages told apart by the profiler */
+#define PGW_PROF_NS				0
+#define PGW_PROF_NA				1
+#define PGW_PROF_RS				2
+#define PGW_PROF_RA				3
+#define PGW_PROF_REDIRECT	4
+#define PGW_PROF_ICMP6		5	/* Any other ICMPv6 message */
+#define PGW_PROF_OTHER		6	/* Any other packet */
+#define PGW_PROF_TYPES		7
+
+typedef struct pgw_profile {
+	u32_t count;			/* Packets processed */
+	u32_t cycles;			/* Total clock_cycles() spent on them */
+	u32_t max;				/* Longest processing of one of them */
+} pgw_profile_t;
+
+extern pgw_profile_t pgw_profile[PGW_PROF_TYPES];
+
+void pgw_profile_reset(void);
+#endif /* PGW_PROFILE */
 
 /* Traffic filters */
 #define CONF_FILTER_TCP 1
@@ -81,6 +245,46 @@ extern u8_t ra_pending, context_chaged;
 
 void pgw_init(void);
 void local_node_output(uip_lladdr_t *localdest);
+u16_t pgw_hash(const u8_t *data, u8_t len);
+
+/*
+ * Edit log (see PGW_EDIT_LOG_LEN). While a packet is both proxied and 
+ * forwarded, code that changes the ICMPv6 body in uip_buf records the change
+ * before making it: pgw_edit_write() for bytes about to be overwritten, 
+ * pgw_edit_insert() for bytes about to be inserted (or appended) and 
+ * pgw_edit_remove() for bytes about to be removed. pgw_edit_remove() returns 0
+ * if the log cannot hold them, in which case they must be kept. 
+ * pgw_edit_rewrite() is called before the packet is replaced as a whole. The
+ * IPv6 and ICMPv6 headers and uip_len need not be recorded. Otherwise the 
+ * functions do nothing.
+ */
+void pgw_edit_write(const void *p, u16_t len);
+void pgw_edit_insert(const void *p, u16_t len);
+u8_t pgw_edit_remove(const void *p, u16_t len);
+void pgw_edit_rewrite(void);
+/* Sends the cached RA to the 6LNs waiting for one, as the hold-down expiry does */
+void pgw_ra_flush(void);
+
+/*
+ * Incremental update of the ICMPv6 checksum of the packet in uip_buf (RFC 
+ * 1624), for rewrites that change a few bytes of a long message. 
+ * pgw_chksum_begin() takes the sum from the checksum field, so the packet must
+ * have a valid checksum. Bytes are accounted for with pgw_chksum_remove() 
+ * before they are overwritten or removed and with pgw_chksum_insert() once 
+ * they have been written; they must start at an even offset of the packet 
+ * (moving data by a multiple of 2 bytes does not change the sum). 
+ * pgw_chksum_end() writes the checksum, accounting for the change of uip_len.
+ */
+typedef struct pgw_chksum {
+	u16_t sum;		/* One's complement sum of the message, host byte order */
+	u16_t len;		/* Upper-layer length (pseudo-header) included in sum */
+} pgw_chksum_t;
+
+void pgw_chksum_begin(pgw_chksum_t *c);
+void pgw_chksum_insert(pgw_chksum_t *c, const void *data, u16_t len);
+void pgw_chksum_remove(pgw_chksum_t *c, const void *data, u16_t len);
+u16_t pgw_chksum_value(pgw_chksum_t *c, u16_t len);
+void pgw_chksum_end(pgw_chksum_t *c);
 
 /* 6LP-GW "driver" datastructre */
 
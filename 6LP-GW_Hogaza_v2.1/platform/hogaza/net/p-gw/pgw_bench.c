@@ -0,0 +1,588 @@
+/**
+ * \file			pgw_bench.c
+ *
+ * \brief			Synthetic ND workloads for measuring the 6LP-GW
+ *
+ * 						The messages are built in uip_buf the way the Ethernet and
+ * 						radio drivers leave them and handed to pgw_input(), so that
+ * 						the profiler times the whole processing of each of them
+ * 						(proxying, bridge, output and hash filter update). The 
+ * 						Ethernet and radio drivers are off while it runs, so the 
+ * 						output stops at them and nothing is sent, and the 6LP-GW
+ * 						is initialized again afterwards: the fake 6LNs, the
+ * 						2001:db8::/64 context, the RR and the bridge entries are
+ * 						forgotten. The workloads are:
+ * 						- ra:  RAs from the RR, which has no 6LN waiting for them
+ * 						- aro: registration storm. Every 6LN sends a NS with ARO to
+ * 						       the RR and the RR answers each of them with a NA
+ * 						- dad: DAD NSs from the LAN for addresses of the 6LNs
+ * 						- nud: NUD NSs from the LAN to the 6LNs
+ * 						- rs:  every 6LN sends a RS, then a multicast RA from the RR
+ * 						       is sent to all of them. The coalesced RA is sent at 
+ * 						       once instead of after the hold-down ("flush"). With 
+ * 						       PGW_CONF_RA_CACHE the RSs are answered from the RA 
+ * 						       template instead, and the RA only refreshes it
+ * 						- ra-large: the same with a RA carrying BENCH_RA_ROUTES Route
+ * 						       Information options
+ * 						- chksum: the checksum of that RA after its destination is 
+ * 						       rewritten, computed in full ("full") and incrementally
+ * 						       ("incremental"), as done in the RA fan-out. A mismatch
+ * 						       between both is reported as an "error" line
+ * 						- chksum-kernel: throughput of uip_chksum_add() over the
+ * 						       packet sizes in bench_sizes (the message column)
+ * 						Results are printed as CSV with the columns: workload,
+ * 						message, packets, cycles, max_cycles, cycles_per_packet,
+ * 						packets_per_second and cycles_hz (the clock_cycles()
+ * 						frequency, CLOCK_CYCLES_HZ).
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+
+#include <stdio.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/packetbuf.h"
+#include "net/pgw_netstack.h"
+#include "net/uip-icmp6.h"
+#include "net/uip-nd6.h"
+#include "net/uip_common.h"
+#include "net/p-gw/pgw.h"
+#include "net/p-gw/pgw_nd.h"
+#include "net/p-gw/pgw_fwd.h"
+#include "net/p-gw/pgw_bench.h"
+
+#if PGW_BENCH
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define ETH_BUF 	((struct uip_eth_hdr *)&uip_buf[0])
+#define UIP_ICMP_BUF     ((struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_ND6_RS_BUF            ((uip_nd6_rs *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define UIP_ND6_RA_BUF            ((uip_nd6_ra *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define UIP_ND6_NS_BUF            ((uip_nd6_ns *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define UIP_ND6_NA_BUF            ((uip_nd6_na *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define BENCH_OPT_BUF		(&uip_buf[UIP_LLH_LEN + uip_len])
+
+/* Lifetime (in minutes) requested in the AROs */
+#define BENCH_ARO_LIFETIME		60
+
+/* Route Information option (RFC 4191) and number of them in a large RA */
+#define BENCH_OPT_ROUTE_INFO	24
+#define BENCH_OPT_ROUTE_INFO_LEN	24
+#define BENCH_RA_ROUTES				6
+
+static const char *pgw_prof_names[PGW_PROF_TYPES] =
+	{ "ns", "na", "rs", "ra", "redirect", "icmp6", "other" };
+
+/* Packet sizes of the chksum-kernel workload: IPv4 and IPv6 headers up to the
+ * IPv6 minimum MTU */
+static const u16_t bench_sizes[] = { 20, 40, 64, 128, 256, 512, 1024, 1280 };
+
+/* Ethernet addresses of the RR and of a host on the LAN */
+static const struct uip_eth_addr rr_ethaddr = {{0x00, 0x1b, 0x21, 0x00, 0x00, 0x01}};
+static const struct uip_eth_addr host_ethaddr = {{0x00, 0x1b, 0x21, 0x00, 0x00, 0x02}};
+
+static uip_ipaddr_t bench_prefix;
+static uip_ipaddr_t bench_rr_ipaddr;
+static uip_ipaddr_t bench_host_ipaddr;
+static uip_ipaddr_t unspecified;
+static uip_ipaddr_t ipaddr;
+static uip_ipaddr_t mcast;
+static eui64_t eui64;
+static pgw_profile_t bench_flush;
+static struct uip_eth_addr ethaddr;
+
+/*---------------------------------------------------------------------------*/
+/* Addresses */
+
+/* EUI-64 of 6LN i. It maps back and forth to the Ethernet address below */
+static void
+bench_node_eui64(u8_t i, eui64_t *a)
+{
+	a->u8[0] = 0x00;
+	a->u8[1] = 0x12;
+	a->u8[2] = 0x4b;
+	a->u8[3] = 0xff;
+	a->u8[4] = 0xfe;
+	a->u8[5] = 0x00;
+	a->u8[6] = 0x00;
+	a->u8[7] = i + 1;
+}
+
+static void
+bench_node_ethaddr(u8_t i, struct uip_eth_addr *a)
+{
+	a->addr[0] = 0x00;
+	a->addr[1] = 0x12;
+	a->addr[2] = 0x4b;
+	a->addr[3] = 0x00;
+	a->addr[4] = 0x00;
+	a->addr[5] = i + 1;
+}
+
+/* Sets the interface ID of a from a 6-byte Ethernet or an 8-byte EUI-64 address */
+static void
+bench_set_iid(uip_ipaddr_t *a, const u8_t *lladdr, u8_t len)
+{
+	if (len == 6) {
+		a->u8[8] = lladdr[0] ^ 0x02;
+		a->u8[9] = lladdr[1];
+		a->u8[10] = lladdr[2];
+		a->u8[11] = 0xff;
+		a->u8[12] = 0xfe;
+		a->u8[13] = lladdr[3];
+		a->u8[14] = lladdr[4];
+		a->u8[15] = lladdr[5];
+	} else {
+		memcpy(&a->u8[8], lladdr, 8);
+		a->u8[8] ^= 0x02;
+	}
+}
+
+/* Global address of 6LN i */
+static void
+bench_node_ipaddr(u8_t i, uip_ipaddr_t *a)
+{
+	bench_node_eui64(i, &eui64);
+	uip_ipaddr_copy(a, &bench_prefix);
+	bench_set_iid(a, eui64.u8, 8);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Message construction */
+
+/* Starts an ICMPv6 message with a body of len bytes after the ICMPv6 header */
+static void
+bench_icmp(u8_t type, uip_ipaddr_t *src, uip_ipaddr_t *dst, u8_t len)
+{
+	memset(uip_buf, 0, UIP_LLH_LEN + UIP_IPH_LEN + UIP_ICMPH_LEN + len);
+	UIP_IP_BUF->vtc = 0x60;
+	UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+	UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
+	uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, src);
+	uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dst);
+	UIP_ICMP_BUF->type = type;
+	uip_ext_len = 0;
+	uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + len;
+}
+
+/* Appends a SLLAO option with a 6 or 8 byte address */
+static void
+bench_opt_sllao(const u8_t *lladdr, u8_t len)
+{
+	u8_t optlen = (len == 6) ? 8 : 16;
+
+	memset(BENCH_OPT_BUF, 0, optlen);
+	BENCH_OPT_BUF[0] = UIP_ND6_OPT_SLLAO;
+	BENCH_OPT_BUF[1] = optlen >> 3;
+	memcpy(&BENCH_OPT_BUF[UIP_ND6_OPT_DATA_OFFSET], lladdr, len);
+	uip_len += optlen;
+}
+
+static void
+bench_opt_aro(eui64_t *a)
+{
+	uip_nd6_opt_aro *aro = (uip_nd6_opt_aro *)BENCH_OPT_BUF;
+
+	memset(aro, 0, UIP_ND6_OPT_ARO_LEN);
+	aro->type = UIP_ND6_OPT_ARO;
+	aro->len = UIP_ND6_OPT_ARO_LEN >> 3;
+	aro->status = ARO_STATUS_SUCCESS;
+	aro->lifetime = uip_htons(BENCH_ARO_LIFETIME);
+	memcpy(&aro->eui64, a, sizeof(eui64_t));
+	uip_len += UIP_ND6_OPT_ARO_LEN;
+}
+
+static void
+bench_opt_prefix_info(void)
+{
+	uip_nd6_opt_prefix_info *pio = (uip_nd6_opt_prefix_info *)BENCH_OPT_BUF;
+
+	memset(pio, 0, sizeof(uip_nd6_opt_prefix_info));
+	pio->type = UIP_ND6_OPT_PREFIX_INFO;
+	pio->len = sizeof(uip_nd6_opt_prefix_info) >> 3;
+	pio->preflen = 64;
+	pio->flagsreserved1 = UIP_ND6_RA_FLAG_ONLINK | UIP_ND6_RA_FLAG_AUTONOMOUS;
+	pio->validlt = uip_htonl(86400);
+	pio->preferredlt = uip_htonl(14400);
+	uip_ipaddr_copy(&pio->prefix, &bench_prefix);
+	uip_len += sizeof(uip_nd6_opt_prefix_info);
+}
+
+/* Route Information option for the i-th /64 after the benchmark prefix */
+static void
+bench_opt_route_info(u8_t i)
+{
+	u8_t *opt = BENCH_OPT_BUF;
+
+	memset(opt, 0, BENCH_OPT_ROUTE_INFO_LEN);
+	opt[0] = BENCH_OPT_ROUTE_INFO;
+	opt[1] = BENCH_OPT_ROUTE_INFO_LEN >> 3;
+	opt[2] = 64;
+	/* Route lifetime: 1800 s */
+	opt[6] = 1800 >> 8;
+	opt[7] = 1800 & 0xff;
+	memcpy(&opt[8], &bench_prefix, 8);
+	opt[15] = i + 1;
+	uip_len += BENCH_OPT_ROUTE_INFO_LEN;
+}
+
+/* Completes the IPv6 header and the checksum and hands the message to the
+ * 6LP-GW as received from the Ethernet interface */
+static void
+bench_eth_input(const struct uip_eth_addr *src, const struct uip_eth_addr *dst)
+{
+	UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+	UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+	UIP_ICMP_BUF->icmpchksum = 0;
+	UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+	memcpy(&ETH_BUF->src, src, sizeof(struct uip_eth_addr));
+	memcpy(&ETH_BUF->dest, dst, sizeof(struct uip_eth_addr));
+	ETH_BUF->type = UIP_HTONS(UIP_ETHTYPE_IPV6);
+	incoming_if = IEEE_802_3;
+	NETSTACK_6LPGW.input();
+}
+
+/* The same for the radio interface. Broadcasts are sent to rimeaddr_null */
+static void
+bench_radio_input(eui64_t *src, eui64_t *dst)
+{
+	UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+	UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+	UIP_ICMP_BUF->icmpchksum = 0;
+	UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+	packetbuf_clear();
+	packetbuf_set_addr(PACKETBUF_ADDR_SENDER, (rimeaddr_t *)src);
+	packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, (rimeaddr_t *)dst);
+	incoming_if = IEEE_802_15_4;
+	NETSTACK_6LPGW.input();
+}
+
+/* Ethernet multicast address of an IPv6 multicast address */
+static void
+bench_mcast_ethaddr(uip_ipaddr_t *a, struct uip_eth_addr *e)
+{
+	e->addr[0] = 0x33;
+	e->addr[1] = 0x33;
+	memcpy(&e->addr[2], &a->u8[12], 4);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Messages */
+
+/* Multicast RA from the RR with SLLAO and PIO */
+static void
+bench_ra(void)
+{
+	uip_create_linklocal_allnodes_mcast(&mcast);
+	bench_icmp(ICMP6_RA, &bench_rr_ipaddr, &mcast, UIP_ND6_RA_LEN);
+	UIP_ND6_RA_BUF->cur_ttl = UIP_ND6_HOP_LIMIT;
+	UIP_ND6_RA_BUF->router_lifetime = uip_htons(1800);
+	bench_opt_sllao(rr_ethaddr.addr, 6);
+	bench_opt_prefix_info();
+	bench_mcast_ethaddr(&mcast, &ethaddr);
+	bench_eth_input(&rr_ethaddr, &ethaddr);
+}
+
+/* Multicast RA from the RR with SLLAO, PIO and BENCH_RA_ROUTES RIOs, left in
+ * uip_buf */
+static void
+bench_ra_large_build(void)
+{
+	u8_t i;
+
+	uip_create_linklocal_allnodes_mcast(&mcast);
+	bench_icmp(ICMP6_RA, &bench_rr_ipaddr, &mcast, UIP_ND6_RA_LEN);
+	UIP_ND6_RA_BUF->cur_ttl = UIP_ND6_HOP_LIMIT;
+	UIP_ND6_RA_BUF->router_lifetime = uip_htons(1800);
+	bench_opt_sllao(rr_ethaddr.addr, 6);
+	bench_opt_prefix_info();
+	for (i = 0; i < BENCH_RA_ROUTES; i++) {
+		bench_opt_route_info(i);
+	}
+	UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+	UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+}
+
+static void
+bench_ra_large(void)
+{
+	bench_ra_large_build();
+	bench_mcast_ethaddr(&mcast, &ethaddr);
+	bench_eth_input(&rr_ethaddr, &ethaddr);
+}
+
+/* Registration NS with SLLAO and ARO from 6LN i to the RR */
+static void
+bench_aro_ns(u8_t i)
+{
+	bench_node_ipaddr(i, &ipaddr);
+	bench_icmp(ICMP6_NS, &ipaddr, &rr_ipaddr, UIP_ND6_NS_LEN);
+	uip_ipaddr_copy(&UIP_ND6_NS_BUF->tgtipaddr, &rr_ipaddr);
+	bench_opt_sllao(eui64.u8, 8);
+	bench_opt_aro(&eui64);
+	bench_radio_input(&eui64, &rr_lladdr);
+}
+
+/* NA from the RR completing the registration of 6LN i */
+static void
+bench_rr_na(u8_t i)
+{
+	bench_node_ipaddr(i, &ipaddr);
+	bench_icmp(ICMP6_NA, &bench_rr_ipaddr, &ipaddr, UIP_ND6_NA_LEN);
+	UIP_ND6_NA_BUF->flagsreserved = UIP_ND6_NA_FLAG_ROUTER |
+		UIP_ND6_NA_FLAG_SOLICITED | UIP_ND6_NA_FLAG_OVERRIDE;
+	uip_ipaddr_copy(&UIP_ND6_NA_BUF->tgtipaddr, &bench_rr_ipaddr);
+	bench_node_ethaddr(i, &ethaddr);
+	bench_eth_input(&rr_ethaddr, &ethaddr);
+}
+
+/* DAD NS from the LAN for the address of 6LN i */
+static void
+bench_dad_ns(u8_t i)
+{
+	bench_node_ipaddr(i, &ipaddr);
+	uip_create_solicited_node(&ipaddr, &mcast);
+	bench_icmp(ICMP6_NS, &unspecified, &mcast, UIP_ND6_NS_LEN);
+	uip_ipaddr_copy(&UIP_ND6_NS_BUF->tgtipaddr, &ipaddr);
+	bench_mcast_ethaddr(&mcast, &ethaddr);
+	bench_eth_input(&host_ethaddr, &ethaddr);
+}
+
+/* NUD NS from a LAN host to 6LN i */
+static void
+bench_nud_ns(u8_t i)
+{
+	bench_node_ipaddr(i, &ipaddr);
+	bench_icmp(ICMP6_NS, &bench_host_ipaddr, &ipaddr, UIP_ND6_NS_LEN);
+	uip_ipaddr_copy(&UIP_ND6_NS_BUF->tgtipaddr, &ipaddr);
+	bench_opt_sllao(host_ethaddr.addr, 6);
+	bench_node_ethaddr(i, &ethaddr);
+	bench_eth_input(&host_ethaddr, &ethaddr);
+}
+
+/* RS from 6LN i */
+static void
+bench_rs(u8_t i)
+{
+	bench_node_ipaddr(i, &ipaddr);
+	uip_create_linklocal_allrouters_mcast(&mcast);
+	bench_icmp(ICMP6_RS, &ipaddr, &mcast, UIP_ND6_RS_LEN);
+	bench_opt_sllao(eui64.u8, 8);
+	bench_radio_input(&eui64, (eui64_t *)&rimeaddr_null);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Prints one CSV line */
+static void
+bench_print(const char *workload, const char *message, pgw_profile_t *p)
+{
+	unsigned long long pps;
+
+	pps = 0;
+	if (p->cycles > 0) {
+		pps = (unsigned long long)p->count * CLOCK_CYCLES_HZ / p->cycles;
+	}
+	printf("%s,%s,%lu,%lu,%lu,%lu,%lu,%lu\n", workload, message,
+				 (unsigned long)p->count, (unsigned long)p->cycles,
+				 (unsigned long)p->max, (unsigned long)(p->cycles / p->count),
+				 (unsigned long)pps, (unsigned long)CLOCK_CYCLES_HZ);
+}
+
+/* Prints the profile of the last workload and clears it */
+static void
+bench_report(const char *workload)
+{
+	u8_t i;
+
+	for (i = 0; i < PGW_PROF_TYPES; i++) {
+		if (pgw_profile[i].count > 0) {
+			bench_print(workload, pgw_prof_names[i], &pgw_profile[i]);
+		}
+	}
+	pgw_profile_reset();
+	if (bench_flush.count > 0) {
+		bench_print(workload, "flush", &bench_flush);
+	}
+	memset(&bench_flush, 0, sizeof(bench_flush));
+}
+
+/* Adds the time elapsed since start to p */
+static void
+bench_account(pgw_profile_t *p, u32_t start)
+{
+	u32_t t = clock_cycles() - start;
+
+	p->count++;
+	p->cycles += t;
+	if (t > p->max) {
+		p->max = t;
+	}
+}
+
+/* Sends the coalesced RA without waiting for the hold-down */
+static void
+bench_ra_flush(void)
+{
+	u32_t start;
+
+	start = clock_cycles();
+	pgw_ra_flush();
+	bench_account(&bench_flush, start);
+}
+
+/* 
+ * Rewrites the destination of the large RA to each 6LN in turn, updating its
+ * checksum as the RA fan-out does, against a full recomputation. 
+ */
+static void
+bench_chksum(u8_t nodes, u16_t rounds)
+{
+	pgw_profile_t full, incremental;
+	pgw_chksum_t chksum;
+	u16_t r;
+	u8_t i;
+	u32_t start;
+
+	memset(&full, 0, sizeof(full));
+	memset(&incremental, 0, sizeof(incremental));
+	bench_ra_large_build();
+	UIP_ICMP_BUF->icmpchksum = 0;
+	UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_node_ipaddr(i, &ipaddr);
+			start = clock_cycles();
+			pgw_chksum_begin(&chksum);
+			pgw_chksum_remove(&chksum, &UIP_IP_BUF->destipaddr, sizeof(uip_ipaddr_t));
+			uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &ipaddr);
+			pgw_chksum_insert(&chksum, &UIP_IP_BUF->destipaddr, sizeof(uip_ipaddr_t));
+			pgw_chksum_end(&chksum);
+			bench_account(&incremental, start);
+			/* The message must verify with the incremental checksum */
+			if (uip_icmp6chksum() != 0xffff) {
+				printf("chksum,error,%u,%u\n", i, r);
+			}
+			start = clock_cycles();
+			UIP_ICMP_BUF->icmpchksum = 0;
+			UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+			bench_account(&full, start);
+		}
+	}
+	if (full.count > 0) {
+		bench_print("chksum", "full", &full);
+		bench_print("chksum", "incremental", &incremental);
+	}
+}
+
+/* Sums packets of each size in bench_sizes, from the IPv6 header in uip_buf */
+static void
+bench_chksum_kernel(u16_t rounds)
+{
+	pgw_profile_t p;
+	char name[6];
+	u16_t r, i;
+	u32_t start;
+	volatile u16_t sum;
+
+	for (i = 0; i < UIP_BUFSIZE - UIP_LLH_LEN; i++) {
+		uip_buf[UIP_LLH_LEN + i] = (u8_t)(i * 7);
+	}
+	for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+		memset(&p, 0, sizeof(p));
+		for (r = 0; r < rounds; r++) {
+			start = clock_cycles();
+			sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], bench_sizes[i]);
+			bench_account(&p, start);
+		}
+		if (p.count > 0) {
+			sprintf(name, "%u", bench_sizes[i]);
+			bench_print("chksum-kernel", name, &p);
+		}
+	}
+}
+
+void
+pgw_bench_run(u8_t nodes, u16_t rounds)
+{
+	u8_t i;
+	u16_t r;
+
+	if (nodes > MAX_6LOWPAN_NEIGHBORS) {
+		nodes = MAX_6LOWPAN_NEIGHBORS;
+	}
+	uip_ip6addr(&bench_prefix, 0x2001, 0x0db8, 0, 0, 0, 0, 0, 0);
+	uip_create_unspecified(&unspecified);
+	uip_create_linklocal_prefix(&bench_rr_ipaddr);
+	bench_set_iid(&bench_rr_ipaddr, rr_ethaddr.addr, 6);
+	uip_ipaddr_copy(&bench_host_ipaddr, &bench_prefix);
+	bench_set_iid(&bench_host_ipaddr, host_ethaddr.addr, 6);
+
+	/* Frames are dropped by the drivers instead of being sent */
+	NETSTACK_ETHERNET.off();
+	NETSTACK_RADIO.off();
+
+	printf("workload,message,packets,cycles,max_cycles,cycles_per_packet,"
+				 "packets_per_second,cycles_hz\n");
+	pgw_profile_reset();
+
+	/* The first RA makes the RR known and creates the prefix context */
+	for (r = 0; r < rounds; r++) {
+		bench_ra();
+	}
+	bench_report("ra");
+
+	/* The first round registers the 6LNs, the next ones re-register them */
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_aro_ns(i);
+		}
+		for (i = 0; i < nodes; i++) {
+			bench_rr_na(i);
+		}
+	}
+	bench_report("aro");
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_dad_ns(i);
+		}
+	}
+	bench_report("dad");
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_nud_ns(i);
+		}
+	}
+	bench_report("nud");
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_rs(i);
+		}
+		bench_ra();
+		bench_ra_flush();
+	}
+	bench_report("rs");
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nodes; i++) {
+			bench_rs(i);
+		}
+		bench_ra_large();
+		bench_ra_flush();
+	}
+	bench_report("ra-large");
+
+	bench_chksum(nodes, rounds);
+	bench_chksum_kernel(rounds);
+
+	uip_len = 0;
+	NETSTACK_ETHERNET.on();
+	NETSTACK_RADIO.on();
+	/* Forget the simulated network */
+	pgw_init();
+	pgw_fwd_rx_filter_sync();
+}
+
+#endif /* PGW_BENCH */
@@ -0,0 +1,48 @@
+/**
+ * \file			pgw_bench.h
+ *
+ * \brief			Synthetic ND workloads for measuring the 6LP-GW
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+
+#ifndef PGW_BENCH_H_
+#define PGW_BENCH_H_
+
+#include "contiki.h"
+#include "net/p-gw/pgw.h"
+
+/* Build the ND benchmark. It is timed by the profiler (PGW_CONF_PROFILE) */
+#ifdef PGW_CONF_BENCH
+#define PGW_BENCH PGW_CONF_BENCH
+#else
+#define PGW_BENCH 0
+#endif /* PGW_CONF_BENCH */
+
+#if PGW_BENCH && !PGW_PROFILE
+#error "PGW_CONF_BENCH requires PGW_CONF_PROFILE"
+#endif
+
+/* Default number of simulated 6LNs (at most MAX_6LOWPAN_NEIGHBORS) */
+#ifdef PGW_CONF_BENCH_NODES
+#define PGW_BENCH_NODES PGW_CONF_BENCH_NODES
+#else
+#define PGW_BENCH_NODES 20
+#endif /* PGW_CONF_BENCH_NODES */
+
+/* Default number of times each workload is run over all the 6LNs */
+#ifdef PGW_CONF_BENCH_ROUNDS
+#define PGW_BENCH_ROUNDS PGW_CONF_BENCH_ROUNDS
+#else
+#define PGW_BENCH_ROUNDS 50
+#endif /* PGW_CONF_BENCH_ROUNDS */
+
+/*
+ * Runs every workload with the given number of 6LNs and rounds, printing one
+ * CSV line per workload and message type to the standard output. It must be
+ * run on a freshly initialized 6LP-GW, before any real traffic. No frame is
+ * sent, and the 6LP-GW is initialized again (pgw_init()) before it returns.
+ */
+void pgw_bench_run(u8_t nodes, u16_t rounds);
+
+#endif /*PGW_BENCH_H_*/
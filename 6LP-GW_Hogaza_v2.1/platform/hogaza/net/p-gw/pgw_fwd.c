@@ -6,13 +6,18 @@
  * \author		Luis Maqueda <luis@sen.se>
  */
 #include "net/p-gw/pgw_fwd.h"
+#include "net/p-gw/pgw_txq.h"
 #include "net/uip-nd6.h"
+#include "net/uipv4/uipv4_arp.h"
 
 #define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define ETH_BUF 	((struct uip_eth_hdr *)&uip_buf[0])
 #define UIP_ICMP_BUF     ((struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
 #define UIP_PGW_OPT_HDR_BUF  ((uip_nd6_opt_hdr *)&uip_buf[uip_l2_l3_icmp_hdr_len + pgw_opt_offset])
 #define CURRENT_OPT_LENGTH		(UIP_PGW_OPT_HDR_BUF->len << 3)
+/* Reserved field, target and destination addresses of a redirect (RFC 4861) */
+#define ND6_REDIRECT_LEN		36
+#define bridge_hash(addr)	(pgw_hash((addr)->u8, sizeof(eui64_t)) & (BRIDGE_HASH_SIZE - 1))
 
 /*
  *  Global (extern) variables 
@@ -26,23 +31,47 @@ eui64_t src_eui64, dst_eui64;									/** \brief Source and destination MAC addr
  */
 /** \brief Bridge table */
 static bridge_table_t brigde_table;
+#if PGW_STATISTICS
+/** \brief Bridge cache statistics */
+bridge_stats_t bridge_stats;
+/** \brief Frames received per poll of each interface driver */
+rx_batch_stats_t eth_rx_stats, radio_rx_stats;
+#endif /* PGW_STATISTICS */
 /** \brief Bridge table entry*/
 static bridge_entry_t *lookup_result;
 /** Offset from the end of the icmpv6 header to the option in uip_buf*/					
 static u8_t pgw_opt_offset;
 /**  Pointer to llao option in uip_buf */
 static u8_t *pgw_opt_llao;
+/** Set when the bridge input for the packet in uip_buf was already done by
+ * pgw_fwd_eth_filter() */
+static u8_t bridge_input_done;
+#if PGW_ETH_HW_FILTER
+/** Set when the Ethernet receive filter must be rebuilt */
+static u8_t rx_filter_dirty;
+#endif /* PGW_ETH_HW_FILTER */
+/** Out of line parts of the frame being sent to the Ethernet interface: 
+ * header, IPv6 and ICMPv6 headers and translated LLAO options */
+static struct uip_eth_hdr eth_tx_eth_hdr;
+static u8_t eth_tx_hdrs[UIP_IPH_LEN + UIP_ICMPH_LEN];
+static u8_t eth_tx_llao[ETH_TX_MAX_LLAO][8];
+static eth_segment_t eth_tx_seg[ETH_TX_SEGMENTS];
 /* 
  * Local function prototypes 
  */
 static void bridge_input(void);
 static void bridge_addr_add(eui64_t *addr, interface_t interface);
 static bridge_entry_t* bridge_addr_lookup(eui64_t *addr); 
+static void bridge_addr_rm(bridge_idx_t index);
+static void bridge_lru_unlink(bridge_idx_t index);
+static void bridge_lru_push(bridge_idx_t index);
 static int is_multicast_lladdr(eui64_t* addr);
 static u8_t translate_icmp_lladdr(interface_t target);
+static u8_t eth_tx_segments(eth_segment_t *seg);
 static u8_t network_layer_filter(void);
 static void get_lladdr(eui64_t* src, eui64_t* dst);
 //static void slide(u8_t* data, int16_t len, int16_t slide);
+static u8_t tx_class(void);
 static void radio_if_forward(eui64_t* src, eui64_t* dst);
 static void eth_if_forward(eui64_t* src, eui64_t* dst);
 static void create_ethernet_lladdr(eui64_t * ethernet, eui64_t * lowpan);
@@ -51,15 +80,33 @@ static void create_6lowpan_lladdr(eui64_t * ethernet, eui64_t * lowpan);
 void
 pgw_fwd_init() 
 {
-	memset(brigde_table, 0, sizeof(brigde_table));
+	bridge_idx_t i;
+	
+	memset(&brigde_table, 0, sizeof(brigde_table));
+	brigde_table.lru_head = BRIDGE_NONE;
+	brigde_table.lru_tail = BRIDGE_NONE;
+	/* Chain all entries in the free list */
+	for (i = 0; i < MAX_BRIDGE_ENTRIES - 1; i++) {
+		brigde_table.table[i].next = i + 1;
+	}
+	brigde_table.table[MAX_BRIDGE_ENTRIES - 1].next = BRIDGE_NONE;
+	brigde_table.free = 0;
 	/* Optimization: Add local host to bridge cache */
 	bridge_addr_add(&rimeaddr_node_addr, LOCAL);
+	pgw_fwd_rx_filter_changed();
 }
 
 void
 pgw_fwd_input()
 {
 	
+	if (bridge_input_done && incoming_if == IEEE_802_3) {
+		/* Already done on the packet headers by pgw_fwd_eth_filter() */
+		bridge_input_done = 0;
+		return;
+	}
+	bridge_input_done = 0;
+	
 	/* get src and dst MAC addresses */
 	if (incoming_if != LOCAL) {
 		get_lladdr(&src_eui64, &dst_eui64);
@@ -71,6 +118,50 @@ pgw_fwd_input()
 	}
 }
 
+/**
+ * \brief 	Performs the bridge input for a packet received from the Ethernet
+ * 			interface with only its Ethernet and IPv6 headers in uip_buf, so
+ * 			that it can be dropped before being read completely.
+ * \return	A value other than 0 if the packet can be filtered out: either 
+ * 			pgw_fwd_input() would filter it or its destination is on the 
+ * 			Ethernet segment it came from.
+ */
+u8_t
+pgw_fwd_eth_filter()
+{
+	get_lladdr(&src_eui64, &dst_eui64);
+	bridge_input();
+	
+	if (network_layer_filter() || outgoing_if == IEEE_802_3) {
+		bridge_input_done = 0;
+		return 1;
+	}
+	bridge_input_done = 1;
+	return 0;
+}
+
+#if PGW_STATISTICS
+/*
+ * Called by the interface drivers after each poll, with the number of frames
+ * received and the maximum they could receive.
+ */
+void
+pgw_fwd_rx_batch(rx_batch_stats_t *stats, u8_t frames, u8_t budget)
+{
+	if (frames == 0) {
+		return;
+	}
+	stats->polls++;
+	stats->frames += frames;
+	if (frames == budget) {
+		stats->full++;
+	}
+	if (frames > stats->max) {
+		stats->max = frames;
+	}
+}
+#endif /* PGW_STATISTICS */
+
 static void
 bridge_input() 
 {
@@ -82,21 +173,137 @@ bridge_input()
 		 * pair (MAC addr., interface) to the cache.
 		 */
 		bridge_addr_add(&src_eui64, incoming_if);
+	} else if (lookup_result->interface != LOCAL) {
+		/* Refresh the entry. The station may have moved to another interface */
+		if (lookup_result->interface != incoming_if) {
+			pgw_fwd_rx_filter_changed();
+		}
+		lookup_result->interface = incoming_if;
+		lookup_result->last_seen = clock_time();
+		bridge_lru_unlink(lookup_result - brigde_table.table);
+		bridge_lru_push(lookup_result - brigde_table.table);
 	}
 	
+	if (is_multicast_lladdr(&dst_eui64)) {
+		/* 
+	 	 * If it is multicast packet forward it to every interface but the 
+	 	 * upstream interface (including This Node's interface).
+	 	 */			
+	 	outgoing_if = UNDEFINED;
+	 	return;
+	}
+	
+	PGW_STAT(bridge_stats.lookups++);
 	lookup_result = bridge_addr_lookup(&dst_eui64);
-	if ((is_multicast_lladdr(&dst_eui64)) || (lookup_result == NULL)) {
+	if (lookup_result == NULL) {
 		/* 
-	 	 * If it is multicast packet or a unicast packet whose dst. MAC addr. 
-	 	 * is not in the cache, forward it to every interface but the upstream 
-	 	 * interface (including This Node's interface).
+	 	 * The same applies to a unicast packet whose dst. MAC addr. is not in 
+	 	 * the cache.
 	 	 */			
+	 	PGW_STAT(bridge_stats.floods++);
 	 	outgoing_if = UNDEFINED;
 	} else {
 		outgoing_if = lookup_result->interface;
 	}
 }
 
+/**
+ * \brief 	Notifies that the set of addresses the Ethernet controller must 
+ * 			receive may have changed. The filter is rebuilt by the next call 
+ * 			to pgw_fwd_rx_filter_sync().
+ */
+void
+pgw_fwd_rx_filter_changed()
+{
+#if PGW_ETH_HW_FILTER
+	rx_filter_dirty = 1;
+#endif /* PGW_ETH_HW_FILTER */
+}
+
+/**
+ * \brief 	Rebuilds the Ethernet controller receive filter if needed. 
+ * 			Broadcast frames are always received (ARP, DHCP).
+ */
+void
+pgw_fwd_rx_filter_sync()
+{
+#if PGW_ETH_HW_FILTER
+	unsigned char table[8];
+	u8_t addr[6];
+	eui64_t eth_addr;
+	pgw_nbr_t *nbr;
+	bridge_idx_t index;
+	
+	if (!rx_filter_dirty) {
+		return;
+	}
+	rx_filter_dirty = 0;
+	memset(table, 0, sizeof(table));
+	
+	/* Our own unicast address, shared by IPv4 and IPv6 */
+	NETSTACK_ETHERNET.filter_add(table, &uip_ethaddr);
+	/* All-nodes and all-routers multicast groups */
+	addr[0] = addr[1] = 0x33;
+	addr[2] = addr[3] = addr[4] = 0;
+	addr[5] = 0x01;
+	NETSTACK_ETHERNET.filter_add(table, addr);
+	addr[5] = 0x02;
+	NETSTACK_ETHERNET.filter_add(table, addr);
+	/* Our solicited-node multicast group */
+	addr[2] = 0xff;
+	addr[3] = rimeaddr_node_addr.u8[5];
+	addr[4] = rimeaddr_node_addr.u8[6];
+	addr[5] = rimeaddr_node_addr.u8[7];
+	NETSTACK_ETHERNET.filter_add(table, addr);
+	/* Solicited-node multicast groups of the 6LoWPAN neighbors, for which the
+	 * 6LP-GW answers NS messages (those of their registered and of their 
+	 * EUI-64-based link-local addresses), and their unicast addresses */
+	for (nbr = pgw_6ln_cache; nbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; nbr++) {
+		if (nbr->isused) {
+			addr[3] = nbr->ipaddr.u8[13];
+			addr[4] = nbr->ipaddr.u8[14];
+			addr[5] = nbr->ipaddr.u8[15];
+			NETSTACK_ETHERNET.filter_add(table, addr);
+			addr[3] = nbr->lladdr.u8[5];
+			addr[4] = nbr->lladdr.u8[6];
+			addr[5] = nbr->lladdr.u8[7];
+			NETSTACK_ETHERNET.filter_add(table, addr);
+			create_ethernet_lladdr(&eth_addr, &nbr->lladdr);
+			NETSTACK_ETHERNET.filter_add(table, eth_addr.u8);
+		}
+	}
+	/* Stations learned on the 6LoWPAN segment */
+	for (index = brigde_table.lru_head; index != BRIDGE_NONE; 
+			index = brigde_table.table[index].next) {
+		if (brigde_table.table[index].interface == IEEE_802_15_4) {
+			create_ethernet_lladdr(&eth_addr, &brigde_table.table[index].addr);
+			NETSTACK_ETHERNET.filter_add(table, eth_addr.u8);
+		}
+	}
+	NETSTACK_ETHERNET.set_filter(table);
+#endif /* PGW_ETH_HW_FILTER */
+}
+
+/**
+ * \brief 	Ages out bridge cache entries whose address has not been seen as 
+ * 			source for BRIDGE_AGEING_TIME seconds. Since the LRU list is
+ * 			ordered by last_seen, only expired entries are visited.
+ */
+void
+pgw_fwd_periodic()
+{
+	bridge_idx_t index;
+	
+	while ((index = brigde_table.lru_tail) != BRIDGE_NONE) {
+		if ((clock_time_t)(clock_time() - brigde_table.table[index].last_seen) < 
+				(clock_time_t)BRIDGE_AGEING_TIME * CLOCK_SECOND) {
+			break;
+		}
+		bridge_addr_rm(index);
+		PGW_STAT(bridge_stats.aged++);
+	}
+}
+
 void 
 pgw_fwd_output(eui64_t* src, eui64_t* dst) 
 {
@@ -111,16 +318,14 @@ pgw_fwd_output(eui64_t* src, eui64_t* dst)
 				outgoing_if = IEEE_802_15_4;
 				translate_icmp_lladdr(IEEE_802_15_4);
 				radio_if_forward(src, dst);
-				/* And also to the LOCAL interface */
-				translate_icmp_lladdr(IEEE_802_15_4); //Already done in radio_if_forward()
+				/* And also to the LOCAL interface (already translated) */
 				tcpip_input();	
 			} else if (incoming_if == IEEE_802_15_4) {
 				/* Forward it to the Ethernet interface first*/
 				outgoing_if = IEEE_802_3;
-				translate_icmp_lladdr(IEEE_802_3);
 				eth_if_forward(src, dst);	
-				/* And also to the LOCAL interface */
-				translate_icmp_lladdr(IEEE_802_15_4); // tcpip stack works with 8-byte addresses
+				/* And also to the LOCAL interface. uip_buf is unchanged and keeps the 
+				 * 8-byte addresses the tcpip stack works with */
 				tcpip_input();
 			} else if (incoming_if == LOCAL) {
 				/* Forward it to the IEEE_802_15_4 interface */
@@ -128,7 +333,6 @@ pgw_fwd_output(eui64_t* src, eui64_t* dst)
 				radio_if_forward(src, dst);
 				outgoing_if = IEEE_802_3;
 				/* And also to the IEEE_802_3 interface */
-				translate_icmp_lladdr(IEEE_802_3);
 				eth_if_forward(src, dst);
 				uip_len = 0;
 			} else {
@@ -149,7 +353,6 @@ pgw_fwd_output(eui64_t* src, eui64_t* dst)
 			} 
 			radio_if_forward(src, dst);
 		} else if (outgoing_if == IEEE_802_3) {
-			translate_icmp_lladdr(IEEE_802_3);
 			eth_if_forward(src, dst);
 		} else {
 			goto discard;
@@ -226,22 +429,25 @@ int is_multicast_lladdr(eui64_t* addr) {
 }
 
 /**
- * \brief Translate the link-layer (L2) addresses in an ICMP packet.
- *        This will just be NA/NS/RA/RS packets currently.
- * 		  It Also removes undesired options to optimize transmissions
- * \param target The target we want to end up with - either IEEE_802_3
- *        for ethernet, or IEEE_802_15_4 for 802.15.4
- * \return       Returns how successful the translation was
- * \retval 0     Addresses, if present, were translated.
- * \retval -1    ICMP message was unknown type, nothing done.
- * \retval -2    ICMP Length does not make sense?
- * \retval -3    Unknown 'target' type
+ * \brief Translate the link-layer (L2) addresses in an ICMP packet to their
+ *        8-byte form, in place, so that it can be passed to the 6LoWPAN layer
+ *        or to the stack. This will just be NA/NS/RA/RS/redirect packets 
+ *        currently.
+ * 		  It Also removes undesired options to optimize transmissions. The 
+ *        translation to 6-byte addresses is not done in place, see 
+ *        eth_tx_segments().
+ * \param target The target we want to end up with. Only IEEE_802_15_4 is
+ *        handled.
+ * \return       1 if the packet was processed, 0 otherwise
  */
  
 static u8_t
 translate_icmp_lladdr(interface_t target)
 {
-	if (UIP_IP_BUF->proto != UIP_PROTO_ICMP6) {
+	u8_t changed = 0;
+	pgw_chksum_t chksum;
+	
+	if (UIP_IP_BUF->proto != UIP_PROTO_ICMP6 || target != IEEE_802_15_4) {
 		return 0;
 	}
 	
@@ -259,82 +465,58 @@ translate_icmp_lladdr(interface_t target)
   case ICMP6_RA:
    	pgw_opt_offset = UIP_ND6_RA_LEN;
    	break;
+  case ICMP6_REDIRECT:
+   	pgw_opt_offset = ND6_REDIRECT_LEN;
+   	break;
 	default:
    	return 0;
 	}
 	
+	pgw_chksum_begin(&chksum);
 	while(uip_l3_icmp_hdr_len + pgw_opt_offset < uip_len) {
 		if(UIP_PGW_OPT_HDR_BUF->len == 0) {
-			return 0;
+			break;
     }
-   	if ((UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_SLLAO) ||
-   			(UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_TLLAO)) {
+   	if (((UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_SLLAO) ||
+   			(UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_TLLAO)) &&
+   			(UIP_PGW_OPT_HDR_BUF->len == 1)) {
+   		/* Only 6-byte addresses are translated: the packet may have been 
+   		 * translated already */
    		pgw_opt_llao = (u8_t*)UIP_PGW_OPT_HDR_BUF;
-     	/* Shrink/grow buffer as needed */
-     	if (target == IEEE_802_15_4) {
-       	/* 
-       	 * Current link-layer address is 6 bytes long. As ICMPv6 options
-       	 * length is expressed in units of 8 octets, new LLAO option will 
-       	 * be 8 bytes longer.
-       	 */
-       	memmove(pgw_opt_llao + CURRENT_OPT_LENGTH + 8, 
-       				pgw_opt_llao + CURRENT_OPT_LENGTH, 
-       				uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH);
-//       	slide(pgw_opt_llao + CURRENT_OPT_LENGTH, 
-//       				uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH, 
-//       				8);
-       	/* Adjust the IP header length, as well as uIP length */		
-       	uip_len += 8;
-       	UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
-				UIP_IP_BUF->len[0] = (((u8_t)(uip_len - UIP_IPH_LEN)) >> 8);
-				/* Translate addresses */
-       	create_6lowpan_lladdr((eui64_t *)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]), 
-       														(eui64_t *)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]));
-       	/* Fill the rest of the option with zeroes */
-				memset(&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]) + 8, 0, 6);
-				/* Adjust the length of the option */
-       	UIP_PGW_OPT_HDR_BUF->len = 2;
-       	//We broke ICMP checksum, be sure to fix that
-     		pgw_update_icmp_checksum();
-			} else if (target == IEEE_802_3) {
-				/* create eth address from 802.15.4 address before destroying it */
-      	create_ethernet_lladdr((eui64_t*)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]), 
-      															(eui64_t *)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]));
-        /* 
-         * Current link-layer address is 8 bytes long. As ICMPv6 options
-         * length is expressed in units of 8 octets, new LLAO option will 
-         * be 8 bytes shorter.
-         */
-         memmove(pgw_opt_llao + CURRENT_OPT_LENGTH - 8, 
-         					pgw_opt_llao + CURRENT_OPT_LENGTH,
-         					uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH);
-//        slide(pgw_opt_llao + CURRENT_OPT_LENGTH, 
-//        			uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH, 
-//        			-8);
-				/* Adjust the IP header length, as well as uip_len value */
-        uip_len -= 8;
-        UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
-				UIP_IP_BUF->len[0] = (((u8_t)(uip_len - UIP_IPH_LEN)) >> 8);
-	      /* Translate addresses */
-      	/* Adjust the length of the option */
-        UIP_PGW_OPT_HDR_BUF->len = 1;
-        /* We broke ICMP checksum, be sure to fix that */
-      	pgw_update_icmp_checksum();
-			} else {
-				return 0; //Uh-oh!
-      }
+   		pgw_chksum_remove(&chksum, pgw_opt_llao, 8);
+     	/* 
+     	 * Current link-layer address is 6 bytes long. As ICMPv6 options
+     	 * length is expressed in units of 8 octets, new LLAO option will 
+     	 * be 8 bytes longer.
+     	 */
+     	pgw_edit_write(pgw_opt_llao, 8);
+     	pgw_edit_insert(pgw_opt_llao + CURRENT_OPT_LENGTH, 8);
+     	memmove(pgw_opt_llao + CURRENT_OPT_LENGTH + 8, 
+     				pgw_opt_llao + CURRENT_OPT_LENGTH, 
+     				uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH);
+     	uip_len += 8;
+			/* Translate addresses */
+     	create_6lowpan_lladdr((eui64_t *)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]), 
+     														(eui64_t *)&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]));
+     	/* Fill the rest of the option with zeroes */
+			memset(&(pgw_opt_llao[UIP_ND6_OPT_DATA_OFFSET]) + 8, 0, 6);
+			/* Adjust the length of the option */
+     	UIP_PGW_OPT_HDR_BUF->len = 2;
+     	pgw_chksum_insert(&chksum, pgw_opt_llao, 16);
+     	changed = 1;
 #if CONF_OPT_FILTERING
-    } else if (((target == IEEE_802_15_4) &&
-    		(UIP_ICMP_BUF->type == ICMP6_RA) &&
+    } else if ((UIP_ICMP_BUF->type == ICMP6_RA) &&
+    		(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_SLLAO) &&
+    		(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_TLLAO) &&
     		(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_PREFIX_INFO) &&
 //	    	(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_MTU) &&
-	    	(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_6CO))) {
-//	    			||
-//	    			((target == IEEE_802_3) &&
-//    				(UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_6CO) &&
-//	    			(UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_ABRO) &&
-//	    			(UIP_PGW_OPT_HDR_BUF->type == UIP_ND6_OPT_ARO))) {
-	    /* Filter out options we don't care. Remove and slide */
+	    	(UIP_PGW_OPT_HDR_BUF->type != UIP_ND6_OPT_6CO) &&
+	    	pgw_edit_remove(UIP_PGW_OPT_HDR_BUF, CURRENT_OPT_LENGTH)) {
+	    /* 
+	     * Filter out options we don't care. Remove and slide. An option the 
+	     * edit log (see pgw.h) cannot hold is kept.
+	     */
+	    pgw_chksum_remove(&chksum, UIP_PGW_OPT_HDR_BUF, CURRENT_OPT_LENGTH);
 			/* Update uip_len with its new value before we lose the length 
 			 * of the option */
 			uip_len -= CURRENT_OPT_LENGTH;
@@ -344,25 +526,126 @@ translate_icmp_lladdr(interface_t target)
 	    memmove((u8_t*)UIP_PGW_OPT_HDR_BUF,
 	    				(u8_t*)UIP_PGW_OPT_HDR_BUF + CURRENT_OPT_LENGTH, 
     					uip_len - uip_l3_icmp_hdr_len - pgw_opt_offset);
-//    	slide((u8_t*)UIP_PGW_OPT_HDR_BUF + CURRENT_OPT_LENGTH, 
-//    				uip_len - uip_l2_l3_icmp_hdr_len - pgw_opt_offset - CURRENT_OPT_LENGTH,
-//    				-CURRENT_OPT_LENGTH);
-			
-    	/* Adjust the IP header length */
-      UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
-			UIP_IP_BUF->len[0] = (u8_t)((uip_len - UIP_IPH_LEN) >> 8);
-
-			/* We broke ICMP checksum, be sure to fix that */
-      pgw_update_icmp_checksum();
-		}
-#else
-		}
+    	changed = 1;
+    	/* The next option is now at the same offset */
+    	continue;
 #endif /* CONF_OPT_FILTERING */
+		}
     pgw_opt_offset += CURRENT_OPT_LENGTH;
 	}
+	if (changed) {
+		/* Adjust the IP header length and write the ICMP checksum, once */
+		UIP_IP_BUF->len[1] = (u8_t)(uip_len - UIP_IPH_LEN);
+		UIP_IP_BUF->len[0] = (u8_t)((uip_len - UIP_IPH_LEN) >> 8);
+		pgw_chksum_end(&chksum);
+	}
 	return 1;
 }
 
+/**
+ * \brief 		Describes the IPv6 packet in uip_buf as a list of segments for
+ * 				the Ethernet interface, with the LLAO options of ND messages in 
+ * 				6-byte form. Translated options, and the IPv6 and ICMPv6 headers
+ * 				whose length and checksum change, are built out of line, so that 
+ * 				uip_buf is neither moved nor modified.
+ * \param seg	Array of at least ETH_TX_SEGMENTS - 1 segments
+ * \return		Number of segments, or 0 if the packet has more than 
+ * 				ETH_TX_MAX_LLAO 8-byte LLAOs or a truncated one, and must be 
+ * 				dropped
+ */
+static u8_t
+eth_tx_segments(eth_segment_t *seg)
+{
+	u8_t *ip = &uip_buf[UIP_LLH_LEN];
+	u8_t *opt;
+	u16_t offset, from, len;
+	pgw_chksum_t chksum;
+	u8_t llaos = 0, count = 0;
+	
+	if (UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+		switch(UIP_ICMP_BUF->type) {
+	  case ICMP6_NS:
+	  case ICMP6_NA:
+	  	offset = uip_l3_icmp_hdr_len + UIP_ND6_NA_LEN;
+	    break;
+	  case ICMP6_RS:
+	   	offset = uip_l3_icmp_hdr_len + UIP_ND6_RS_LEN;
+	   	break;
+	  case ICMP6_RA:
+	   	offset = uip_l3_icmp_hdr_len + UIP_ND6_RA_LEN;
+	   	break;
+	  case ICMP6_REDIRECT:
+	   	offset = uip_l3_icmp_hdr_len + ND6_REDIRECT_LEN;
+	   	break;
+		default:
+	   	offset = uip_len;
+	   	break;
+		}
+	} else {
+		offset = uip_len;
+	}
+	
+	from = uip_l3_icmp_hdr_len;
+	len = uip_len;
+	pgw_chksum_begin(&chksum);
+	/* Leave room for the headers */
+	count = 1;
+	for (; offset + 2 <= uip_len && ip[offset + 1] != 0; offset += ip[offset + 1] << 3) {
+		opt = &ip[offset];
+		if ((opt[0] != UIP_ND6_OPT_SLLAO && opt[0] != UIP_ND6_OPT_TLLAO) || 
+				opt[1] != 2) {
+			continue;
+		}
+		if (offset + 16 > uip_len || llaos == ETH_TX_MAX_LLAO) {
+			/* It cannot be translated, and a 8-byte address would be wrong */
+			return 0;
+		}
+		/* Data up to the option, unchanged */
+		if (offset > from) {
+			seg[count].data = &ip[from];
+			seg[count].len = offset - from;
+			count++;
+		}
+		/* The option, with a 6-byte address */
+		eth_tx_llao[llaos][0] = opt[0];
+		eth_tx_llao[llaos][1] = 1;
+		create_ethernet_lladdr((eui64_t *)&eth_tx_llao[llaos][UIP_ND6_OPT_DATA_OFFSET],
+													 (eui64_t *)&opt[UIP_ND6_OPT_DATA_OFFSET]);
+		seg[count].data = eth_tx_llao[llaos];
+		seg[count].len = 8;
+		count++;
+		pgw_chksum_remove(&chksum, opt, 16);
+		pgw_chksum_insert(&chksum, eth_tx_llao[llaos], 8);
+		llaos++;
+		from = offset + 16;
+		len -= 8;
+	}
+	
+	if (llaos == 0) {
+		/* Nothing to translate: the packet goes out as it is */
+		seg[0].data = ip;
+		seg[0].len = uip_len;
+		return 1;
+	}
+	if (from < uip_len) {
+		seg[count].data = &ip[from];
+		seg[count].len = uip_len - from;
+		count++;
+	}
+	/* 
+	 * Headers with the new length, and the checksum updated for the options 
+	 * and the length (pseudo-header) that changed (RFC 1624, eqn. 3).
+	 */
+	memcpy(eth_tx_hdrs, ip, uip_l3_icmp_hdr_len);
+	((struct uip_ip_hdr *)eth_tx_hdrs)->len[0] = (u8_t)((len - UIP_IPH_LEN) >> 8);
+	((struct uip_ip_hdr *)eth_tx_hdrs)->len[1] = (u8_t)(len - UIP_IPH_LEN);
+	((struct uip_icmp_hdr *)&eth_tx_hdrs[UIP_IPH_LEN])->icmpchksum = 
+		pgw_chksum_value(&chksum, len - UIP_IPH_LEN);
+	seg[0].data = eth_tx_hdrs;
+	seg[0].len = uip_l3_icmp_hdr_len;
+	return count;
+}
+
 /**
  * \brief 			Create a 802.3 address from a 802.15.4 long address. It is possible
  * 					that ethernet and lowpan point to the same address. 
@@ -402,12 +685,35 @@ create_ethernet_lladdr(eui64_t * ethernet, eui64_t * lowpan)
 //	}
 //}
 
+/*
+ * Returns the egress queue class of the packet in uip_buf: ND messages go 
+ * before anything else.
+ */
+static u8_t
+tx_class(void)
+{
+	if (UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+		switch (UIP_ICMP_BUF->type) {
+		case ICMP6_RS:
+		case ICMP6_RA:
+		case ICMP6_NS:
+		case ICMP6_NA:
+		case ICMP6_REDIRECT:
+			return PGW_TXQ_CONTROL;
+		}
+	}
+	return PGW_TXQ_BULK;
+}
+
 static void 
 radio_if_forward(eui64_t* src, eui64_t* dst)
 {
 	rimeaddr_t r_addr;
 	uip_lladdr_t ll_addr;
 	
+	/* Tell the radio driver which queue class the frames belong to */
+	pgw_txq_class = tx_class();
+	
 	/*
 	 * In order to use the sicslowpan output function, we need to set the
 	 * global variable rimeaddr_node_addr with the src address of the 
@@ -444,72 +750,198 @@ radio_if_forward(eui64_t* src, eui64_t* dst)
 	 */
 	rimeaddr_set_node_addr(&r_addr);
 	eui64_copy((rimeaddr_t*)&uip_lladdr, (rimeaddr_t*)&ll_addr); 
+	pgw_txq_class = PGW_TXQ_BULK;
 }
 
+/*
+ * Sends the packet in uip_buf to the Ethernet interface. The frame is given
+ * to the driver as a list of segments (see eth_tx_segments()), so uip_buf is 
+ * left unchanged and can still be passed to the stack.
+ */
 static void 
 eth_if_forward(eui64_t* src, eui64_t* dst)
 {
+	u8_t count;
+	
 	/*
-	 * Copy the src and dst MAC addresses into uip_buf 
+	 * Build the Ethernet header with the src and dst MAC addresses
 	 */
-	create_ethernet_lladdr((eui64_t *)&ETH_BUF->src, (eui64_t *)src);
+	create_ethernet_lladdr((eui64_t *)&eth_tx_eth_hdr.src, (eui64_t *)src);
 	if (is_multicast_lladdr(dst)) {
 		/*
 		 * Create Ethernet multicast address
 		 */
-		ETH_BUF->dest.addr[0] = 0x33;
-	  ETH_BUF->dest.addr[1] = 0x33;
-	  ETH_BUF->dest.addr[2] = UIP_IP_BUF->destipaddr.u8[12];
-	  ETH_BUF->dest.addr[3] = UIP_IP_BUF->destipaddr.u8[13];
-	  ETH_BUF->dest.addr[4] = UIP_IP_BUF->destipaddr.u8[14];
-	  ETH_BUF->dest.addr[5] = UIP_IP_BUF->destipaddr.u8[15];
+		eth_tx_eth_hdr.dest.addr[0] = 0x33;
+	  eth_tx_eth_hdr.dest.addr[1] = 0x33;
+	  eth_tx_eth_hdr.dest.addr[2] = UIP_IP_BUF->destipaddr.u8[12];
+	  eth_tx_eth_hdr.dest.addr[3] = UIP_IP_BUF->destipaddr.u8[13];
+	  eth_tx_eth_hdr.dest.addr[4] = UIP_IP_BUF->destipaddr.u8[14];
+	  eth_tx_eth_hdr.dest.addr[5] = UIP_IP_BUF->destipaddr.u8[15];
 	} else {
 		/*
 		 * Create Ethernet unicast address
 		 */
-		create_ethernet_lladdr((eui64_t *)&ETH_BUF->dest, (eui64_t *)dst);
+		create_ethernet_lladdr((eui64_t *)&eth_tx_eth_hdr.dest, (eui64_t *)dst);
 	}
 	/*
 	 * The Ethernet type/length value that matches IPv6 is 0x86dd.
 	 */
-	ETH_BUF->type = UIP_HTONS(0x86dd);
+	eth_tx_eth_hdr.type = UIP_HTONS(0x86dd);
 	
-	NETSTACK_MAC_ETH.send();
+	eth_tx_seg[0].data = &eth_tx_eth_hdr;
+	eth_tx_seg[0].len = sizeof(struct uip_eth_hdr);
+	count = eth_tx_segments(&eth_tx_seg[1]);
+	if (count == 0) {
+		PGW_STAT(pgw_stats.llao_drops++);
+		PGW_STAT(eth_tx_stats.dropped[pgw_txq_class]++);
+		return;
+	}
+	NETSTACK_MAC_ETH.sendv(eth_tx_seg, 1 + count);
+}
+
+/**
+ * \brief Remove an entry from the LRU list.
+ */
+static void
+bridge_lru_unlink(bridge_idx_t index)
+{
+	bridge_entry_t *e = &brigde_table.table[index];
+	
+	if (e->prev != BRIDGE_NONE) {
+		brigde_table.table[e->prev].next = e->next;
+	} else {
+		brigde_table.lru_head = e->next;
+	}
+	if (e->next != BRIDGE_NONE) {
+		brigde_table.table[e->next].prev = e->prev;
+	} else {
+		brigde_table.lru_tail = e->prev;
+	}
+}
+
+/**
+ * \brief Insert an entry at the head (most recently used end) of the LRU list.
+ */
+static void
+bridge_lru_push(bridge_idx_t index)
+{
+	bridge_entry_t *e = &brigde_table.table[index];
+	
+	e->prev = BRIDGE_NONE;
+	e->next = brigde_table.lru_head;
+	if (brigde_table.lru_head != BRIDGE_NONE) {
+		brigde_table.table[brigde_table.lru_head].prev = index;
+	} else {
+		brigde_table.lru_tail = index;
+	}
+	brigde_table.lru_head = index;
 }
 
 /*
- * Returns a value other than 0 if the packet in uip_buf can be filtered out. 
+ * Adds the pair (addr, interface) to the bridge cache. If the cache is full,
+ * the least recently seen entry is evicted. The entry for the local host is
+ * never linked in the LRU list, so it can be neither evicted nor aged.
  */
 static void 
 bridge_addr_add(eui64_t *addr, interface_t interface) 
 {
+	bridge_idx_t index;
+	u16_t slot;
 	
-	int index;
-	
-	if (brigde_table.elems != MAX_BRIDGE_ENTRIES) {
-		index = brigde_table.elems;
-		brigde_table.elems++;
-	} else {
-		/* pick victim randomly */
-		index = random_rand()%MAX_BRIDGE_ENTRIES;
+	if (brigde_table.free == BRIDGE_NONE) {
+		/* Evict the least recently used entry */
+		if (brigde_table.lru_tail == BRIDGE_NONE) {
+			return;
+		}
+		bridge_addr_rm(brigde_table.lru_tail);
+		PGW_STAT(bridge_stats.evicted++);
 	}
+	index = brigde_table.free;
+	brigde_table.free = brigde_table.table[index].next;
+	brigde_table.elems++;
+	
 	brigde_table.table[index].interface = interface;
+	brigde_table.table[index].last_seen = clock_time();
 	eui64_copy(&brigde_table.table[index].addr, addr);
+	if (interface != LOCAL) {
+		bridge_lru_push(index);
+	}
+	if (interface == IEEE_802_15_4) {
+		pgw_fwd_rx_filter_changed();
+	}
+	
+	/* Insert in the hash index */
+	slot = bridge_hash(addr);
+	while (brigde_table.hash[slot] != 0) {
+		slot = (slot + 1) & (BRIDGE_HASH_SIZE - 1);
+	}
+	brigde_table.hash[slot] = index + 1;
+	PGW_STAT(bridge_stats.learned++);
+}
+
+/*
+ * Removes an entry from the bridge cache. The hash index uses backward-shift
+ * deletion, so no tombstones are left behind and probe sequences stay short.
+ */
+static void
+bridge_addr_rm(bridge_idx_t index)
+{
+	u16_t slot, next, home;
+	
+	/* Find the slot pointing to this entry */
+	slot = bridge_hash(&brigde_table.table[index].addr);
+	while (brigde_table.hash[slot] != index + 1) {
+		slot = (slot + 1) & (BRIDGE_HASH_SIZE - 1);
+	}
+	/* Shift back the following entries of the cluster if needed */
+	next = slot;
+	while (1) {
+		next = (next + 1) & (BRIDGE_HASH_SIZE - 1);
+		if (brigde_table.hash[next] == 0) {
+			break;
+		}
+		home = bridge_hash(&brigde_table.table[brigde_table.hash[next] - 1].addr);
+		/* The entry at next can fill the hole if its home slot is not 
+		 * cyclically in (slot, next] */
+		if (((next - home) & (BRIDGE_HASH_SIZE - 1)) >= 
+				((next - slot) & (BRIDGE_HASH_SIZE - 1))) {
+			brigde_table.hash[slot] = brigde_table.hash[next];
+			slot = next;
+		}
+	}
+	brigde_table.hash[slot] = 0;
+	
+	if (brigde_table.table[index].interface != LOCAL) {
+		bridge_lru_unlink(index);
+	}
+	if (brigde_table.table[index].interface == IEEE_802_15_4) {
+		pgw_fwd_rx_filter_changed();
+	}
+	brigde_table.table[index].next = brigde_table.free;
+	brigde_table.free = index;
+	brigde_table.elems--;
 }
 
 static bridge_entry_t* 
 bridge_addr_lookup(eui64_t *addr) 
 {
-	int i;
+	u16_t slot;
+	bridge_entry_t *e;
 	
-	for (i = 0; i < brigde_table.elems; i++) {
-		if (eui64_cmp(addr, &(brigde_table.table[i].addr))) {
-			return &(brigde_table.table[i]);
+	slot = bridge_hash(addr);
+	while (brigde_table.hash[slot] != 0) {
+		e = &brigde_table.table[brigde_table.hash[slot] - 1];
+		if (eui64_cmp(addr, &e->addr)) {
+			return e;
 		}
+		slot = (slot + 1) & (BRIDGE_HASH_SIZE - 1);
 	}
 	return NULL;
 }
 
+/*
+ * Returns a value other than 0 if the packet in uip_buf can be filtered out. 
+ */
 static u8_t
 network_layer_filter() 
 {
@@ -17,7 +17,62 @@
 
 
 /* Number of entries in the bridge */
+#ifdef PGW_CONF_BRIDGE_ENTRIES
+#define MAX_BRIDGE_ENTRIES	PGW_CONF_BRIDGE_ENTRIES
+#else
 #define MAX_BRIDGE_ENTRIES	30
+#endif /* PGW_CONF_BRIDGE_ENTRIES */
+
+/* 
+ * Number of slots in the bridge hash index. It must be a power of two and 
+ * should be at least twice MAX_BRIDGE_ENTRIES to keep probe sequences short.
+ */
+#ifdef PGW_CONF_BRIDGE_HASH_SIZE
+#define BRIDGE_HASH_SIZE	PGW_CONF_BRIDGE_HASH_SIZE
+#else
+#define BRIDGE_HASH_SIZE	64
+#endif /* PGW_CONF_BRIDGE_HASH_SIZE */
+
+#if BRIDGE_HASH_SIZE <= MAX_BRIDGE_ENTRIES
+#error "BRIDGE_HASH_SIZE must be larger than MAX_BRIDGE_ENTRIES"
+#endif
+
+/* Time (in seconds) after which an entry not seen as source is aged out */
+#ifdef PGW_CONF_BRIDGE_AGEING_TIME
+#define BRIDGE_AGEING_TIME	PGW_CONF_BRIDGE_AGEING_TIME
+#else
+#define BRIDGE_AGEING_TIME	300
+#endif /* PGW_CONF_BRIDGE_AGEING_TIME */
+
+/* 
+ * Program the Ethernet controller receive filter with the addresses the 
+ * 6LP-GW is interested in (its own, all-nodes, all-routers, the solicited-node
+ * groups of the 6LoWPAN neighbors and the stations bridged to the 6LoWPAN 
+ * segment), so that other frames are dropped by the controller.
+ */
+#ifdef PGW_CONF_ETH_HW_FILTER
+#define PGW_ETH_HW_FILTER	PGW_CONF_ETH_HW_FILTER
+#else
+#define PGW_ETH_HW_FILTER	1
+#endif /* PGW_CONF_ETH_HW_FILTER */
+
+/* 
+ * Maximum number of LLAO options of a ND message translated to 6-byte form 
+ * when it is sent to the Ethernet interface. A message with more (or with a
+ * truncated one) is dropped rather than sent with 8-byte addresses. A frame 
+ * is made of up to ETH_TX_SEGMENTS segments.
+ */
+#define ETH_TX_MAX_LLAO		2
+#define ETH_TX_SEGMENTS		(3 + 2 * ETH_TX_MAX_LLAO)
+
+/* Index of an entry in the bridge table. BRIDGE_NONE marks the end of a list */
+#if MAX_BRIDGE_ENTRIES < 255
+typedef u8_t bridge_idx_t;
+#define BRIDGE_NONE		0xff
+#else
+typedef u16_t bridge_idx_t;
+#define BRIDGE_NONE		0xffff
+#endif /* MAX_BRIDGE_ENTRIES < 255 */
 
 /* 
  * Interface types 
@@ -35,13 +90,53 @@ typedef enum {
 typedef struct {
 	interface_t interface;
 	eui64_t addr;
+	/* Time at which the address was last seen as source */
+	clock_time_t last_seen;
+	/* LRU list links (most recently used first) */
+	bridge_idx_t prev;
+	bridge_idx_t next;
 } bridge_entry_t;
 
+/*
+ * The bridge cache. Entries live in a fixed table and are reached through an
+ * open-addressed (linear probing) hash index keyed on the EUI-64. In-use 
+ * entries are chained in a LRU list, so that eviction and ageing never
+ * require scanning the whole table. Unused entries are chained in a free list
+ * through their "next" field.
+ */
 typedef struct {
 	bridge_entry_t table[MAX_BRIDGE_ENTRIES];
-	u8_t elems;
+	/* Hash index: entry index + 1, or 0 if the slot is empty */
+	bridge_idx_t hash[BRIDGE_HASH_SIZE];
+	bridge_idx_t lru_head;
+	bridge_idx_t lru_tail;
+	bridge_idx_t free;
+	bridge_idx_t elems;
 } bridge_table_t;
 
+#if PGW_STATISTICS
+/* Bridge cache statistics */
+typedef struct {
+	u32_t lookups;	/* Destination lookups */
+	u32_t floods;	/* Unicast frames flooded because of a cache miss */
+	u32_t learned;	/* Addresses added to the cache */
+	u32_t evicted;	/* Entries evicted (LRU) because the cache was full */
+	u32_t aged;		/* Entries removed by ageing */
+} bridge_stats_t;
+
+extern bridge_stats_t bridge_stats;
+
+/* Frames received per poll of an interface driver */
+typedef struct {
+	u32_t polls;	/* Polls that received at least one frame */
+	u32_t frames;	/* Frames received */
+	u32_t full;		/* Polls that stopped at the budget (RX_BATCH) */
+	u8_t max;			/* Most frames received in a poll */
+} rx_batch_stats_t;
+
+extern rx_batch_stats_t eth_rx_stats, radio_rx_stats;
+#endif /* PGW_STATISTICS */
+
 /** \brief Incoming and outgoing interfaces */
 extern interface_t incoming_if, outgoing_if;
 /** \brief Source and destination MAC addresses */
@@ -52,5 +147,12 @@ extern eui64_t src_eui64, dst_eui64;
 void pgw_fwd_init(void);
 void pgw_fwd_input(void);
 void pgw_fwd_output(eui64_t* src, eui64_t* dst);
+void pgw_fwd_periodic(void);
+u8_t pgw_fwd_eth_filter(void);
+#if PGW_STATISTICS
+void pgw_fwd_rx_batch(rx_batch_stats_t *stats, u8_t frames, u8_t budget);
+#endif /* PGW_STATISTICS */
+void pgw_fwd_rx_filter_changed(void);
+void pgw_fwd_rx_filter_sync(void);
 
 #endif /*PGW_FWD_H_*/
@@ -12,6 +12,9 @@
 #include "net/p-gw/pgw_fwd.h"
 #include "contiki-net.h"
 #include "net/uip-nd6.h"
+#if PGW_STATISTICS
+#include <stdio.h>
+#endif /* PGW_STATISTICS */
 
 static pgw_addr_context_t *loccontext;			/** \brief Pointer to a context */
 static u8_t context_id;											/** \brief Context index */
@@ -24,10 +27,81 @@ struct etimer pgw_timer_periodic;
 pgw_nbr_t pgw_6ln_cache[MAX_6LOWPAN_NEIGHBORS];
 /** \brief The Context Table */
 pgw_addr_context_t pgw_addr_context_table[PGW_CONF_MAX_ADDR_CONTEXTS];
+/** 
+ * \brief Hash indices of the neighbor cache, one per key. Each slot holds the 
+ * index of a NCE plus one, or 0 if the slot is empty (open addressing with
+ * linear probing).
+ */
+static pgw_nbr_idx_t pgw_nbr_index[PGW_NBR_KEYS][PGW_NBR_HASH_SIZE];
+
+/* 
+ * Objects whose timers are tracked by the deadline heap: NCEs first, then 
+ * contexts.
+ */
+#define PGW_TIMED_OBJS		(MAX_6LOWPAN_NEIGHBORS + PGW_CONF_MAX_ADDR_CONTEXTS)
+#define PGW_HEAP_NONE			((pgw_nbr_idx_t)-1)
+
+/** \brief An entry in the deadline heap */
+typedef struct pgw_deadline {
+	clock_time_t deadline;
+	pgw_nbr_idx_t obj;
+} pgw_deadline_t;
+
+/** 
+ * \brief Binary min-heap holding the next deadline of every NCE and context in
+ * use, so that periodic processing only visits what has expired.
+ */
+static pgw_deadline_t pgw_heap[PGW_TIMED_OBJS];
+static pgw_nbr_idx_t pgw_heap_len;
+/** \brief Position of each object in pgw_heap, or PGW_HEAP_NONE */
+static pgw_nbr_idx_t pgw_heap_pos[PGW_TIMED_OBJS];
+
+/** \brief NCEs waiting for DAD, oldest first (a ring of NCE indices) */
+static pgw_nbr_idx_t pgw_dad_queue[MAX_6LOWPAN_NEIGHBORS];
+static pgw_nbr_idx_t pgw_dad_head, pgw_dad_len;
+/** \brief Number of NCEs being probed */
+static u8_t pgw_dad_inflight;
+/** 
+ * \brief Token bucket limiting the DAD NSs sent to the LAN. A NS costs 
+ * CLOCK_SECOND credits and PGW_DAD_RATE credits are earned per tick.
+ */
+#define PGW_DAD_CREDIT_MAX	((u32_t)PGW_DAD_BURST * CLOCK_SECOND)
+static u32_t pgw_dad_credit;
+static clock_time_t pgw_dad_refilled;
+
+#if PGW_STATISTICS
+/** \brief Registration latency histogram, see pgw_dad_bucket() */
+#define PGW_DAD_HIST_LEN	64
+static u16_t pgw_dad_hist[PGW_DAD_HIST_LEN];
+static u32_t pgw_dad_registrations;
+static clock_time_t pgw_dad_max;
+static pgw_nbr_idx_t pgw_dad_max_queue;
+static u32_t pgw_dad_deferred;		/* DAD NSs delayed by the rate limit */
+#endif /* PGW_STATISTICS */
 
 
 /* Function prototypes */
 
+static u16_t pgw_nbr_hash(u8_t key, pgw_nbr_t *n);
+static u8_t pgw_nbr_key_cmp(u8_t key, pgw_nbr_t *n, const void *k);
+static pgw_nbr_t* pgw_nbr_index_lookup(u8_t key, u16_t slot, const void *k);
+static void pgw_nbr_index_add(u8_t key, pgw_nbr_t *n);
+static void pgw_nbr_index_rm(u8_t key, pgw_nbr_t *n);
+
+static void pgw_heap_swap(pgw_nbr_idx_t i, pgw_nbr_idx_t j);
+static void pgw_heap_up(pgw_nbr_idx_t i);
+static void pgw_heap_down(pgw_nbr_idx_t i);
+static void pgw_deadline_set(pgw_nbr_idx_t obj, clock_time_t deadline);
+static void pgw_deadline_clear(pgw_nbr_idx_t obj);
+static void pgw_timer_rearm(void);
+
+static void pgw_nd_output(void);
+static clock_time_t pgw_dad_wait(void);
+static void pgw_dad_run(void);
+static void pgw_dad_release(pgw_nbr_t *nbr);
+#if PGW_STATISTICS
+static void pgw_dad_account(pgw_nbr_t *nbr);
+#endif /* PGW_STATISTICS */
 void pgw_dad(pgw_nbr_t* nbr);
 void pgw_dad_failed(pgw_nbr_t* nbr);
 void pgw_dad_response(pgw_nbr_t* nbr, u8_t status);
@@ -36,28 +110,357 @@ void
 pgw_nd_init()
 {
 	memset(pgw_6ln_cache, 0, sizeof(pgw_6ln_cache));
+	memset(pgw_nbr_index, 0, sizeof(pgw_nbr_index));
 	memset(pgw_addr_context_table, 0, sizeof(pgw_addr_context_table));
+	memset(pgw_heap_pos, 0xff, sizeof(pgw_heap_pos));
+	pgw_heap_len = 0;
+	pgw_dad_head = 0;
+	pgw_dad_len = 0;
+	pgw_dad_inflight = 0;
+	pgw_dad_credit = PGW_DAD_CREDIT_MAX;
+	pgw_dad_refilled = clock_time();
+	PROCESS_CONTEXT_BEGIN(&pgw_process);
 	etimer_set(&pgw_timer_periodic, PGW_PERIOD);
+	PROCESS_CONTEXT_END(&pgw_process);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Deadline heap */
+
+/* Wrap-around safe "a is earlier than b" */
+#define deadline_before(a, b)		((s32_t)((a) - (b)) < 0)
+
+static void
+pgw_heap_swap(pgw_nbr_idx_t i, pgw_nbr_idx_t j)
+{
+	pgw_deadline_t tmp;
+	
+	tmp = pgw_heap[i];
+	pgw_heap[i] = pgw_heap[j];
+	pgw_heap[j] = tmp;
+	pgw_heap_pos[pgw_heap[i].obj] = i;
+	pgw_heap_pos[pgw_heap[j].obj] = j;
+}
+
+static void
+pgw_heap_up(pgw_nbr_idx_t i)
+{
+	while (i > 0 && 
+			deadline_before(pgw_heap[i].deadline, pgw_heap[(i - 1) / 2].deadline)) {
+		pgw_heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void
+pgw_heap_down(pgw_nbr_idx_t i)
+{
+	u16_t child;
+	
+	/* Computed in 16 bits, it cannot wrap around past pgw_heap_len */
+	while ((child = 2 * (u16_t)i + 1) < pgw_heap_len) {
+		if (child + 1 < pgw_heap_len && 
+				deadline_before(pgw_heap[child + 1].deadline, pgw_heap[child].deadline)) {
+			child++;
+		}
+		if (!deadline_before(pgw_heap[child].deadline, pgw_heap[i].deadline)) {
+			return;
+		}
+		pgw_heap_swap(i, child);
+		i = child;
+	}
+}
+
+/* Inserts obj in the heap or moves it to its new deadline */
+static void
+pgw_deadline_set(pgw_nbr_idx_t obj, clock_time_t deadline)
+{
+	pgw_nbr_idx_t i = pgw_heap_pos[obj];
+	
+	if (i == PGW_HEAP_NONE) {
+		i = pgw_heap_len++;
+		pgw_heap[i].obj = obj;
+		pgw_heap_pos[obj] = i;
+	}
+	pgw_heap[i].deadline = deadline;
+	pgw_heap_up(i);
+	pgw_heap_down(pgw_heap_pos[obj]);
+	
+	/* Wake up earlier if this is now the first deadline */
+	if (pgw_heap_pos[obj] == 0 && 
+			deadline_before(deadline, etimer_expiration_time(&pgw_timer_periodic))) {
+		pgw_timer_rearm();
+	}
+}
+
+static void
+pgw_deadline_clear(pgw_nbr_idx_t obj)
+{
+	pgw_nbr_idx_t i = pgw_heap_pos[obj];
+	
+	if (i == PGW_HEAP_NONE) {
+		return;
+	}
+	pgw_heap_pos[obj] = PGW_HEAP_NONE;
+	if (i != --pgw_heap_len) {
+		/* Fill the hole with the last entry and restore the heap property */
+		pgw_heap[i] = pgw_heap[pgw_heap_len];
+		obj = pgw_heap[i].obj;
+		pgw_heap_pos[obj] = i;
+		pgw_heap_up(i);
+		pgw_heap_down(pgw_heap_pos[obj]);
+	}
+}
+
+/* 
+ * Sets the periodic timer to the first deadline, or to when a queued NCE can
+ * be probed, or to PGW_PERIOD at most 
+ */
+static void
+pgw_timer_rearm(void)
+{
+	clock_time_t now = clock_time();
+	clock_time_t interval = PGW_PERIOD;
+	clock_time_t wait;
+	
+	if (pgw_heap_len > 0) {
+		if (!deadline_before(now, pgw_heap[0].deadline)) {
+			interval = 1;
+		} else if (pgw_heap[0].deadline - now < interval) {
+			interval = pgw_heap[0].deadline - now;
+		}
+	}
+	if (pgw_dad_len > 0 && pgw_dad_inflight < PGW_DAD_INFLIGHT) {
+		wait = pgw_dad_wait();
+		if (wait < 1) {
+			wait = 1;
+		}
+		if (wait < interval) {
+			interval = wait;
+		}
+	}
+	PROCESS_CONTEXT_BEGIN(&pgw_process);
+	etimer_set(&pgw_timer_periodic, interval);
+	PROCESS_CONTEXT_END(&pgw_process);
+}
+
+/* clock_seconds() advances every CLOCK_SECOND ticks of clock_time() */
+#define stimer_deadline(t)	((clock_time_t)((t)->start + (t)->interval) * CLOCK_SECOND)
+#define timer_deadline(t)		((t)->start + (t)->interval)
+
+/**
+ * \brief 	Updates the position of a NCE in the deadline heap. Must be called
+ * 			whenever its reachable or DAD timer is (re)set.
+ */
+void
+pgw_nbr_schedule(pgw_nbr_t *nbr)
+{
+	clock_time_t deadline;
+	
+	if (!nbr->isused) {
+		return;
+	}
+	deadline = stimer_deadline(&nbr->reachable);
+	if ((nbr->dadstate == PGW_DAD_PROBING) &&
+			deadline_before(timer_deadline(&nbr->dadtimer), deadline)) {
+		deadline = timer_deadline(&nbr->dadtimer);
+	}
+	pgw_deadline_set(nbr - pgw_6ln_cache, deadline);
+}
+
+/**
+ * \brief 	Updates the position of a context in the deadline heap. Must be 
+ * 			called whenever its vlifetime timer is (re)set.
+ */
+void
+pgw_context_schedule(pgw_addr_context_t *context)
+{
+	if (context->state == NOT_IN_USE) {
+		return;
+	}
+	pgw_deadline_set(MAX_6LOWPAN_NEIGHBORS + (context - pgw_addr_context_table), 
+										stimer_deadline(&context->vlifetime));
+}
+
+/*---------------------------------------------------------------------------*/
+/* Neighbor cache hash indices */
+
+/* Hash bucket of a key. The solicited-node group of an address is defined by 
+ * its last 24 bits, so that is all we hash for PGW_NBR_KEY_SNMA. Those of the 
+ * EUI-64-based link-local address are the last 3 bytes of the EUI-64 */
+#define pgw_nbr_ipaddr_hash(a)	(pgw_hash((a)->u8, sizeof(uip_ipaddr_t)) & (PGW_NBR_HASH_SIZE - 1))
+#define pgw_nbr_lladdr_hash(a)	(pgw_hash((a)->u8, sizeof(eui64_t)) & (PGW_NBR_HASH_SIZE - 1))
+#define pgw_nbr_snma_hash(a)		(pgw_hash(&(a)->u8[13], 3) & (PGW_NBR_HASH_SIZE - 1))
+
+static u16_t
+pgw_nbr_hash(u8_t key, pgw_nbr_t *n)
+{
+	switch (key) {
+	case PGW_NBR_KEY_IPADDR:
+		return pgw_nbr_ipaddr_hash(&n->ipaddr);
+	case PGW_NBR_KEY_LLADDR:
+		return pgw_nbr_lladdr_hash(&n->lladdr);
+	case PGW_NBR_KEY_LL_SNMA:
+		return pgw_hash(&n->lladdr.u8[5], 3) & (PGW_NBR_HASH_SIZE - 1);
+	default:
+		return pgw_nbr_snma_hash(&n->ipaddr);
+	}
+}
+
+static u8_t
+pgw_nbr_key_cmp(u8_t key, pgw_nbr_t *n, const void *k)
+{
+	switch (key) {
+	case PGW_NBR_KEY_IPADDR:
+		return uip_ipaddr_cmp(&n->ipaddr, (uip_ipaddr_t *)k);
+	case PGW_NBR_KEY_LLADDR:
+		return eui64_cmp(&n->lladdr, k);
+	case PGW_NBR_KEY_LL_SNMA:
+		return memcmp(&n->lladdr.u8[5], &((uip_ipaddr_t *)k)->u8[13], 3) == 0;
+	default:
+		return memcmp(&n->ipaddr.u8[13], &((uip_ipaddr_t *)k)->u8[13], 3) == 0;
+	}
+}
+
+/* Returns the first NCE matching k in the probe sequence starting at slot */
+static pgw_nbr_t*
+pgw_nbr_index_lookup(u8_t key, u16_t slot, const void *k)
+{
+	pgw_nbr_idx_t *index = pgw_nbr_index[key];
+	
+	while (index[slot] != 0) {
+		locnbr = &pgw_6ln_cache[index[slot] - 1];
+		if (pgw_nbr_key_cmp(key, locnbr, k)) {
+			return locnbr;
+		}
+		slot = (slot + 1) & (PGW_NBR_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+static void
+pgw_nbr_index_add(u8_t key, pgw_nbr_t *n)
+{
+	pgw_nbr_idx_t *index = pgw_nbr_index[key];
+	u16_t slot;
+	
+	slot = pgw_nbr_hash(key, n);
+	while (index[slot] != 0) {
+		slot = (slot + 1) & (PGW_NBR_HASH_SIZE - 1);
+	}
+	index[slot] = (n - pgw_6ln_cache) + 1;
+}
+
+/* Backward-shift deletion, so that no tombstones are needed */
+static void
+pgw_nbr_index_rm(u8_t key, pgw_nbr_t *n)
+{
+	pgw_nbr_idx_t *index = pgw_nbr_index[key];
+	pgw_nbr_idx_t i = (n - pgw_6ln_cache) + 1;
+	u16_t slot, next, home;
+	
+	slot = pgw_nbr_hash(key, n);
+	while (index[slot] != i) {
+		if (index[slot] == 0) {
+			/* Not indexed */
+			return;
+		}
+		slot = (slot + 1) & (PGW_NBR_HASH_SIZE - 1);
+	}
+	next = slot;
+	while (1) {
+		next = (next + 1) & (PGW_NBR_HASH_SIZE - 1);
+		if (index[next] == 0) {
+			break;
+		}
+		home = pgw_nbr_hash(key, &pgw_6ln_cache[index[next] - 1]);
+		if (((next - home) & (PGW_NBR_HASH_SIZE - 1)) >= 
+				((next - slot) & (PGW_NBR_HASH_SIZE - 1))) {
+			index[slot] = index[next];
+			slot = next;
+		}
+	}
+	index[slot] = 0;
 }
 
 /*---------------------------------------------------------------------------*/
 pgw_nbr_t*
 pgw_nbr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *) pgw_6ln_cache, UIP_DS6_NBR_NB,
-      sizeof(pgw_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **) & locnbr) == FOUND) {
-    return locnbr;
-  }
-  return NULL;
+	return pgw_nbr_index_lookup(PGW_NBR_KEY_IPADDR, pgw_nbr_ipaddr_hash(ipaddr), ipaddr);
+}
+
+/*---------------------------------------------------------------------------*/
+pgw_nbr_t*
+pgw_nbr_lookup_by_lladdr(eui64_t *lladdr)
+{
+	return pgw_nbr_index_lookup(PGW_NBR_KEY_LLADDR, pgw_nbr_lladdr_hash(lladdr), lladdr);
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 	Looks up the NCE whose EUI-64 matches the interface ID of ipaddr,
+ * 			e.g. the owner of a link-local address. A 6LN may own several NCEs
+ * 			(e.g. one created by its RS and one for its registered address), 
+ * 			so a REGISTERED one is preferred.
+ */
+pgw_nbr_t*
+pgw_nbr_lookup_by_iid(uip_ipaddr_t *ipaddr)
+{
+	eui64_t lladdr;
+	pgw_nbr_t *first = NULL;
+	u16_t slot;
+	
+	lladdr.u8[0] = ipaddr->u8[8] ^ 0x02;
+	memcpy(&lladdr.u8[1], &ipaddr->u8[9], 7);
+	
+	slot = pgw_nbr_lladdr_hash(&lladdr);
+	while (pgw_nbr_index[PGW_NBR_KEY_LLADDR][slot] != 0) {
+		locnbr = &pgw_6ln_cache[pgw_nbr_index[PGW_NBR_KEY_LLADDR][slot] - 1];
+		if (eui64_cmp(&locnbr->lladdr, &lladdr)) {
+			if (locnbr->state == PGW_REGISTERED) {
+				return locnbr;
+			} else if (first == NULL) {
+				first = locnbr;
+			}
+		}
+		slot = (slot + 1) & (PGW_NBR_HASH_SIZE - 1);
+	}
+	return first;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 	Looks up a NCE whose address, or the link-local address derived from 
+ * 			its EUI-64, belongs to the solicited-node multicast group of ipaddr 
+ * 			(ipaddr may be the group address itself).
+ */
+pgw_nbr_t*
+pgw_nbr_lookup_by_snma(uip_ipaddr_t *ipaddr)
+{
+	pgw_nbr_t *n;
+	
+	n = pgw_nbr_index_lookup(PGW_NBR_KEY_SNMA, pgw_nbr_snma_hash(ipaddr), ipaddr);
+	if (n == NULL) {
+		n = pgw_nbr_index_lookup(PGW_NBR_KEY_LL_SNMA, pgw_nbr_snma_hash(ipaddr), ipaddr);
+	}
+	return n;
 }
+
 /*---------------------------------------------------------------------------*/
 void
 pgw_nbr_rm(pgw_nbr_t *nbr)
 {
-	if(nbr != NULL) {
+	u8_t key;
+	
+	if((nbr != NULL) && (nbr->isused)) {
+		for (key = 0; key < PGW_NBR_KEYS; key++) {
+			pgw_nbr_index_rm(key, nbr);
+		}
+		pgw_deadline_clear(nbr - pgw_6ln_cache);
+		pgw_dad_release(nbr);
    	nbr->isused = 0;
+   	pgw_fwd_rx_filter_changed();
   }
   return;
 }
@@ -67,12 +470,20 @@ pgw_nbr_t*
 pgw_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
                 u8_t isrouter, u8_t state)
 {
-  int r;
-
-  r = uip_ds6_list_loop((uip_ds6_element_t *)pgw_6ln_cache, UIP_DS6_NBR_NB,
-      									sizeof(pgw_nbr_t), ipaddr, 128, (uip_ds6_element_t **)&locnbr);
+	u8_t key;
+	
+	if (pgw_nbr_lookup(ipaddr) != NULL) {
+		/* The NCE already exists */
+		return NULL;
+	}
+	
+	for(locnbr = pgw_6ln_cache; locnbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; locnbr++) {
+		if (!locnbr->isused) {
+			break;
+		}
+	}
 
-  if(r == FREESPACE) {
+  if(locnbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS) {
     locnbr->isused = 1;
     uip_ipaddr_copy(&(locnbr->ipaddr), ipaddr);
     if(lladdr != NULL) {
@@ -89,9 +500,19 @@ pgw_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
 		}
 		locnbr->aro_pending = 0;
 		locnbr->ra_pending = 0;
+		/* The slot may be reused, so DAD must start over */
+		locnbr->dadnscount = 0;
+		timer_set(&locnbr->dadtimer, 0);
+		locnbr->link_frames = 0;
+		locnbr->link_samples = 0;
     locnbr->last_lookup = clock_time();
+    for (key = 0; key < PGW_NBR_KEYS; key++) {
+    	pgw_nbr_index_add(key, locnbr);
+    }
+    pgw_nbr_schedule(locnbr);
+    pgw_fwd_rx_filter_changed();
     return locnbr;
-  } else if(r == NOSPACE) {
+  } else {
     /* We did not find any empty slot on the neighbor list, so we need
        to remove one old entry to make room. */
     pgw_nbr_t *n, *oldest;
@@ -100,7 +521,7 @@ pgw_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
     oldest = NULL;
     oldest_time = clock_time();
 
-    for(n = pgw_6ln_cache; n < &pgw_6ln_cache[UIP_DS6_NBR_NB]; n++) {
+    for(n = pgw_6ln_cache; n < &pgw_6ln_cache[MAX_6LOWPAN_NEIGHBORS]; n++) {
       if(n->isused) {
         if((n->last_lookup < oldest_time) && (n->state == PGW_GARBAGE_COLLECTIBLE)) {
         	/* We do not want to remove any registered or tentative entry */
@@ -116,6 +537,80 @@ pgw_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
   }
   return NULL;
 }
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 	Accounts for a frame received from the 6LN lladdr in the link 
+ * 			quality of all its NCEs. rssi and lqi are those reported by the radio,
+ * 			lqi being 0 if they were not measured (the frame is then only 
+ * 			counted).
+ */
+void
+pgw_nbr_link_input(eui64_t *lladdr, s8_t rssi, u8_t lqi)
+{
+	u16_t slot;
+	
+	slot = pgw_nbr_lladdr_hash(lladdr);
+	while (pgw_nbr_index[PGW_NBR_KEY_LLADDR][slot] != 0) {
+		locnbr = &pgw_6ln_cache[pgw_nbr_index[PGW_NBR_KEY_LLADDR][slot] - 1];
+		if (eui64_cmp(&locnbr->lladdr, lladdr)) {
+			locnbr->link_frames++;
+			if (lqi == 0) {
+				/* Not measured */
+			} else if (locnbr->link_samples++ == 0) {
+				locnbr->link_rssi = (s16_t)rssi * PGW_LINK_SCALE;
+				locnbr->link_lqi = (u16_t)lqi * PGW_LINK_SCALE;
+			} else {
+				/* avg += (sample - avg) / 2^shift */
+				locnbr->link_rssi += ((s16_t)rssi * PGW_LINK_SCALE - locnbr->link_rssi) 
+						>> PGW_LINK_EWMA_SHIFT;
+				locnbr->link_lqi = locnbr->link_lqi - (locnbr->link_lqi >> PGW_LINK_EWMA_SHIFT)
+						+ (((u16_t)lqi * PGW_LINK_SCALE) >> PGW_LINK_EWMA_SHIFT);
+			}
+		}
+		slot = (slot + 1) & (PGW_NBR_HASH_SIZE - 1);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 	Tells whether the link to a 6LN is weak (see PGW_LINK_LQI_WEAK). 
+ * 			It is not until its LQI has been measured.
+ */
+u8_t
+pgw_nbr_link_weak(pgw_nbr_t *nbr)
+{
+	return nbr->link_samples > 0 && 
+			nbr->link_lqi < (u16_t)PGW_LINK_LQI_WEAK * PGW_LINK_SCALE;
+}
+
+#if PGW_STATISTICS
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 	Prints the link quality of every 6LN as CSV lines: "link", EUI-64,
+ * 			frames received, frames measured, average RSSI and LQI, and whether
+ * 			the link is weak.
+ */
+void
+pgw_nbr_link_print(void)
+{
+	pgw_nbr_t *n;
+	u8_t i;
+	
+	for (n = pgw_6ln_cache; n < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; n++) {
+		if (!n->isused) {
+			continue;
+		}
+		printf("link,");
+		for (i = 0; i < sizeof(eui64_t); i++) {
+			printf("%02x", n->lladdr.u8[i]);
+		}
+		printf(",%u,%u,%d,%u,%u\n", n->link_frames, n->link_samples,
+				n->link_rssi / PGW_LINK_SCALE, n->link_lqi / PGW_LINK_SCALE,
+				pgw_nbr_link_weak(n));
+	}
+}
+#endif /* PGW_STATISTICS */
 /*---------------------------------------------------------------------------*/
 
 pgw_addr_context_t*
@@ -132,6 +627,7 @@ pgw_context_add(uip_nd6_opt_6co *context_option, u16_t defrt_lifetime) {
     	} else {
     		loccontext->state = IN_USE_UNCOMPRESS_ONLY;
     	}
+    	pgw_context_schedule(loccontext);
     	return loccontext;
     }
   }
@@ -151,6 +647,7 @@ pgw_context_create(uip_ipaddr_t *prefix, u8_t length) {
     	pgw_addr_context_table[context_id].state = IN_USE_UNCOMPRESS_ONLY;
     	stimer_set(&pgw_addr_context_table[context_id].vlifetime, 
     							PGW_INITIAL_CONTEXT_LIFETIME); 
+    	pgw_context_schedule(&pgw_addr_context_table[context_id]);
     	return &pgw_addr_context_table[context_id];
 		}
 	}
@@ -160,6 +657,7 @@ pgw_context_create(uip_ipaddr_t *prefix, u8_t length) {
 void 
 pgw_context_rm(pgw_addr_context_t *context){
 	context->state = NOT_IN_USE;
+	pgw_deadline_clear(MAX_6LOWPAN_NEIGHBORS + (context - pgw_addr_context_table));
 }
 
 pgw_addr_context_t *
@@ -188,16 +686,26 @@ pgw_context_lookup_by_prefix(uip_ipaddr_t *prefix) {
 
 /**
  * \brief 	Performs periodic tasks for 6LP-GW variable management, such as
- * 			processing of neighbor lifetimes and DAD timers
+ * 			processing of neighbor lifetimes and DAD timers. Only the NCEs and
+ * 			contexts whose deadline has passed are visited; the periodic timer
+ * 			is then re-armed for the next deadline.
  */ 
 void
 pgw_periodic() 
 {
+	pgw_nbr_idx_t obj, budget;
 	
-	/* periodic processing of contexts */
-	for(loccontext = pgw_addr_context_table;
-      loccontext < pgw_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; loccontext++) {
-  	if (loccontext->state != NOT_IN_USE) {
+	/* ageing of bridge cache entries */
+	pgw_fwd_periodic();
+	
+	/* Each object is visited at most once per invocation */
+	for (budget = pgw_heap_len; budget > 0 && pgw_heap_len > 0 &&
+			!deadline_before(clock_time(), pgw_heap[0].deadline); budget--) {
+		obj = pgw_heap[0].obj;
+		
+		if (obj >= MAX_6LOWPAN_NEIGHBORS) {
+			/* periodic processing of contexts */
+			loccontext = &pgw_addr_context_table[obj - MAX_6LOWPAN_NEIGHBORS];
   		if (stimer_expired(&loccontext->vlifetime)) {
 				switch(loccontext->state) {
 				case IN_USE_UNCOMPRESS_ONLY:
@@ -222,45 +730,256 @@ pgw_periodic()
 					break;
 				}  			
   		}
+  		pgw_context_schedule(loccontext);
+  		continue;
+		}
+		
+		/* periodic processing of neighbors */
+		locnbr = &pgw_6ln_cache[obj];
+		/* 
+		 * If the reachable timer is expired, we delete the NCE, 
+		 * regardless of the NCE's state.
+		 */
+		if(stimer_expired(&(locnbr->reachable))) {
+			/* I-D.ietf-6lowpan-nd: Should the Registration Lifetime in a NCE expire,
+			 * then the router MUST delete the cache entry. */
+			pgw_nbr_rm(locnbr);
+			continue;
+		} else if ((locnbr->dadstate == PGW_DAD_PROBING) && 
+				(timer_expired(&locnbr->dadtimer))) {
+			/* pgw_dad() sends its packet at once, so every probe due is handled */
+			pgw_dad(locnbr);
+			continue;
     }
+    pgw_nbr_schedule(locnbr);
 	}
 	
-	/* periodic processing of neighbors */
-	for(locnbr = pgw_6ln_cache; locnbr < pgw_6ln_cache + MAX_6LOWPAN_NEIGHBORS; locnbr++) {
-		if(locnbr->isused) {
-			/* 
-			 * If the reachable timer is expired, we delete the NCE, 
-			 * regardless of the NCE's state.
-			 */
-			if(stimer_expired(&(locnbr->reachable))) {
-				/* I-D.ietf-6lowpan-nd: Should the Registration Lifetime in a NCE expire,
-				 * then the router MUST delete the cache entry. */
-				pgw_nbr_rm(locnbr);
-			} else if ((locnbr->state == PGW_TENTATIVE) && 
-					(!uip_is_addr_link_local(&locnbr->ipaddr))) {
-				if ((locnbr->dadnscount <= PGW_MAX_DAD_NS) &&
-						(timer_expired(&locnbr->dadtimer))) {
-        	pgw_dad(locnbr);
-        	/* If we found a neighbor requiring DAD, perform it. If there were 
-        	 * more neighbors requiring it, we'll do it in further invocations */
-       	 	return;
-				}	
-      }
-    }
+	/* Probe the NCEs queued for the slots freed */
+	pgw_dad_run();
+	pgw_timer_rearm();
+	return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* DAD scheduler */
+
+/* Sends the packet in uip_buf, as pgw_input() does once it has been proxied */
+static void
+pgw_nd_output(void)
+{
+	if (uip_len > 0) {
+		pgw_fwd_output(&src_eui64, &dst_eui64);
+		uip_len = 0;
 	}
+}
+
+/* Ticks until the rate limit lets a DAD NS be sent, 0 if it can be sent now */
+static clock_time_t
+pgw_dad_wait(void)
+{
+	clock_time_t now = clock_time();
+	clock_time_t elapsed = now - pgw_dad_refilled;
 	
-	etimer_reset(&pgw_timer_periodic);
-	return;
+	pgw_dad_refilled = now;
+	if (elapsed > PGW_DAD_CREDIT_MAX / PGW_DAD_RATE) {
+		pgw_dad_credit = PGW_DAD_CREDIT_MAX;
+	} else {
+		pgw_dad_credit += elapsed * PGW_DAD_RATE;
+		if (pgw_dad_credit > PGW_DAD_CREDIT_MAX) {
+			pgw_dad_credit = PGW_DAD_CREDIT_MAX;
+		}
+	}
+	if (pgw_dad_credit >= CLOCK_SECOND) {
+		return 0;
+	}
+	return (CLOCK_SECOND - pgw_dad_credit + PGW_DAD_RATE - 1) / PGW_DAD_RATE;
+}
+
+/**
+ * \brief 	Queues a new registration for DAD and probes the queued NCEs that 
+ * 			fit in the free slots. Packets are sent at once, so the NS with 
+ * 			ARO in uip_buf is consumed.
+ */
+void
+pgw_dad_start(pgw_nbr_t *nbr)
+{
+	if (nbr->dadstate == PGW_DAD_IDLE) {
+		nbr->dadstate = PGW_DAD_QUEUED;
+		nbr->dadnscount = 0;
+		nbr->dadstart = clock_time();
+		pgw_dad_queue[(pgw_dad_head + pgw_dad_len) % MAX_6LOWPAN_NEIGHBORS] = 
+				nbr - pgw_6ln_cache;
+		pgw_dad_len++;
+#if PGW_STATISTICS
+		if (pgw_dad_len > pgw_dad_max_queue) {
+			pgw_dad_max_queue = pgw_dad_len;
+		}
+#endif /* PGW_STATISTICS */
+	}
+	uip_len = 0;
+	pgw_dad_run();
+	pgw_timer_rearm();
 }
 
+/* Probes queued NCEs, oldest first, while there are free slots and credits */
+static void
+pgw_dad_run(void)
+{
+	pgw_nbr_t *n;
+	
+	while (pgw_dad_len > 0 && pgw_dad_inflight < PGW_DAD_INFLIGHT && 
+			pgw_dad_wait() == 0) {
+		n = &pgw_6ln_cache[pgw_dad_queue[pgw_dad_head]];
+		pgw_dad_head = (pgw_dad_head + 1) % MAX_6LOWPAN_NEIGHBORS;
+		pgw_dad_len--;
+		n->dadstate = PGW_DAD_PROBING;
+		pgw_dad_inflight++;
+		pgw_dad(n);
+	}
+}
+
+/* Frees the slot or the queue position of a NCE whose DAD is over */
+static void
+pgw_dad_release(pgw_nbr_t *nbr)
+{
+	pgw_nbr_idx_t i, obj;
+	
+	if (nbr->dadstate == PGW_DAD_PROBING) {
+		pgw_dad_inflight--;
+		if (pgw_dad_len > 0) {
+			/* A queued NCE can take the slot */
+			pgw_timer_rearm();
+		}
+	} else if (nbr->dadstate == PGW_DAD_QUEUED) {
+		obj = nbr - pgw_6ln_cache;
+		for (i = 0; i < pgw_dad_len; i++) {
+			if (pgw_dad_queue[(pgw_dad_head + i) % MAX_6LOWPAN_NEIGHBORS] == obj) {
+				break;
+			}
+		}
+		if (i < pgw_dad_len) {
+			/* Close the gap, keeping the order of the others */
+			for (; i + 1 < pgw_dad_len; i++) {
+				pgw_dad_queue[(pgw_dad_head + i) % MAX_6LOWPAN_NEIGHBORS] = 
+						pgw_dad_queue[(pgw_dad_head + i + 1) % MAX_6LOWPAN_NEIGHBORS];
+			}
+			pgw_dad_len--;
+		}
+	}
+	nbr->dadstate = PGW_DAD_IDLE;
+}
+
+#if PGW_STATISTICS
+/* 
+ * Histogram bucket of a latency of t ticks: one per tick below 4, then 4 per
+ * power of two (25% resolution).
+ */
+static u8_t
+pgw_dad_bucket(clock_time_t t)
+{
+	u8_t e = 2;
+	u8_t i;
+	
+	if (t < 4) {
+		return t;
+	}
+	while (t >> (e + 1)) {
+		e++;
+	}
+	i = 4 * (e - 1) + ((t >> (e - 2)) & 3);
+	return i < PGW_DAD_HIST_LEN ? i : PGW_DAD_HIST_LEN - 1;
+}
+
+/* Shortest latency falling in bucket i */
+static clock_time_t
+pgw_dad_bucket_min(u8_t i)
+{
+	if (i < 4) {
+		return i;
+	}
+	return (clock_time_t)(4 + (i & 3)) << (i / 4 - 1);
+}
+
+/* Records the latency of the registration of nbr, which is being answered */
+static void
+pgw_dad_account(pgw_nbr_t *nbr)
+{
+	clock_time_t t = clock_time() - nbr->dadstart;
+	
+	if (nbr->dadstate == PGW_DAD_IDLE) {
+		/* Not a registration */
+		return;
+	}
+	pgw_dad_hist[pgw_dad_bucket(t)]++;
+	pgw_dad_registrations++;
+	if (t > pgw_dad_max) {
+		pgw_dad_max = t;
+	}
+}
+
+#define pgw_ticks_ms(t)		((unsigned long)(t) * 1000 / CLOCK_SECOND)
+
+/* p-th percentile of the registration latency, in ms, rounded up to its bucket */
+static unsigned long
+pgw_dad_percentile(u8_t p)
+{
+	u32_t rank, seen;
+	clock_time_t t;
+	u8_t i;
+	
+	if (pgw_dad_registrations == 0) {
+		return 0;
+	}
+	rank = (pgw_dad_registrations * p + 99) / 100;
+	seen = 0;
+	for (i = 0; i < PGW_DAD_HIST_LEN - 1; i++) {
+		seen += pgw_dad_hist[i];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	t = pgw_dad_max;
+	if (i < PGW_DAD_HIST_LEN - 1 && pgw_dad_bucket_min(i + 1) - 1 < t) {
+		t = pgw_dad_bucket_min(i + 1) - 1;
+	}
+	return pgw_ticks_ms(t);
+}
+
+/**
+ * \brief 	Prints the registration latency, from the NS with ARO to the NA 
+ * 			answering it, as a CSV line: "dad", registrations, 50th, 90th and 
+ * 			99th percentiles and maximum (in ms), longest DAD queue and DAD NSs
+ * 			delayed by the rate limit.
+ */
+void
+pgw_dad_print(void)
+{
+	printf("dad,%lu,%lu,%lu,%lu,%lu,%u,%lu\n", (unsigned long)pgw_dad_registrations,
+			pgw_dad_percentile(50), pgw_dad_percentile(90), pgw_dad_percentile(99),
+			pgw_ticks_ms(pgw_dad_max), pgw_dad_max_queue, (unsigned long)pgw_dad_deferred);
+}
+#endif /* PGW_STATISTICS */
+
 /*
- * Perform DAD on behalf of a 6LN
+ * Perform DAD on behalf of a 6LN. The NS or the NA answering the 6LN is sent
+ * at once.
  */
 void 
 pgw_dad(pgw_nbr_t* nbr)
 {
+	clock_time_t wait;
+	
 	/* send maxdadns NS for DAD  */
   if(nbr->dadnscount < PGW_MAX_DAD_NS) {
+  	wait = pgw_dad_wait();
+  	if (wait > 0) {
+  		/* Rate limited: try again as soon as the NS can be sent */
+  		PGW_STAT(pgw_dad_deferred++);
+  		timer_set(&nbr->dadtimer, wait);
+  		pgw_nbr_schedule(nbr);
+  		return;
+  	}
+  	pgw_dad_credit -= CLOCK_SECOND;
   	/* 
   	 * The packet is sent on behalf of a 6LN, so its incoming_if is IEEE_802_15_4.
   	 * Even though it is a multicast packet, its outgoing_if must be IEEE_802_3.
@@ -275,17 +994,25 @@ pgw_dad(pgw_nbr_t* nbr)
 	  pgw_create_ns(NULL, NULL, &nbr->ipaddr);
 	  /* No options in DAD NS */
 	  pgw_update_icmp_checksum();
+	  pgw_nd_output();
   	nbr->dadnscount++;
-   	timer_set(&nbr->dadtimer, UIP_ND6_RETRANS_TIMER / 1000 * CLOCK_SECOND);
+   	timer_set(&nbr->dadtimer, PGW_DAD_RETRANS);
+   	pgw_nbr_schedule(nbr);
    	return;
   }
   /*
    * If we arrive here it means DAD succeeded, otherwise the dad process
    * would have been interrupted in ns/na_input
    */
+#if PGW_STATISTICS
+  pgw_dad_account(nbr);
+#endif /* PGW_STATISTICS */
+  pgw_dad_release(nbr);
   nbr->state = PGW_REGISTERED;
   nbr->aro_pending = 0;
+  pgw_nbr_schedule(nbr);
   pgw_dad_response(nbr, ARO_STATUS_SUCCESS);
+  pgw_nd_output();
   return;
 }
 
@@ -296,6 +1023,9 @@ pgw_dad_failed(pgw_nbr_t* nbr)
 	 * The node who sent the NS with ARO is awaiting for response 
 	 * so let's respond it.
 	 */
+#if PGW_STATISTICS
+	pgw_dad_account(nbr);
+#endif /* PGW_STATISTICS */
 	pgw_dad_response(nbr, ARO_STATUS_DUPLICATE);
 	/* And the delete the NCE */
 	pgw_nbr_rm(nbr);
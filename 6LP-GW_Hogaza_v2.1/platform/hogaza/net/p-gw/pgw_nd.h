@@ -11,6 +11,7 @@
 
 #include "contiki.h"
 #include "contiki-net.h"
+#include "net/p-gw/pgw.h"
 
 #define  PGW_GARBAGE_COLLECTIBLE 0
 #define  PGW_TENTATIVE 1
@@ -30,6 +31,64 @@
 #define ARO_STATUS_DUPLICATE			1
 #define ARO_STATUS_RTR_NC_FULL			2
 
+/* DAD performed on behalf of a 6LN, see pgw_dad_start() */
+#define PGW_DAD_IDLE		0
+#define PGW_DAD_QUEUED		1	/* Waiting for a probe slot */
+#define PGW_DAD_PROBING		2	/* Probing, until dadtimer expires */
+
+/* 
+ * Number of slots of each neighbor cache hash index. It must be a power of 
+ * two, larger than MAX_6LOWPAN_NEIGHBORS.
+ */
+#ifdef PGW_CONF_NBR_HASH_SIZE
+#define PGW_NBR_HASH_SIZE		PGW_CONF_NBR_HASH_SIZE
+#else
+#define PGW_NBR_HASH_SIZE		64
+#endif /* PGW_CONF_NBR_HASH_SIZE */
+
+#if PGW_NBR_HASH_SIZE <= MAX_6LOWPAN_NEIGHBORS
+#error "PGW_NBR_HASH_SIZE must be larger than MAX_6LOWPAN_NEIGHBORS"
+#endif
+
+/* 
+ * Index of a NCE, or of a NCE or context in the deadline heap. It is only 
+ * wider than a byte if the neighbor cache is (e.g. in host tests).
+ */
+#if MAX_6LOWPAN_NEIGHBORS + PGW_CONF_MAX_ADDR_CONTEXTS < 255
+typedef u8_t pgw_nbr_idx_t;
+#else
+typedef u16_t pgw_nbr_idx_t;
+#endif /* MAX_6LOWPAN_NEIGHBORS + PGW_CONF_MAX_ADDR_CONTEXTS < 255 */
+
+/*
+ * Link quality of the 6LNs: exponentially weighted moving average of the RSSI
+ * and LQI of the frames received from each of them, with weight
+ * 1/2^PGW_LINK_EWMA_SHIFT. The averages are kept in 1/PGW_LINK_SCALE units.
+ */
+#ifdef PGW_CONF_LINK_EWMA_SHIFT
+#define PGW_LINK_EWMA_SHIFT		PGW_CONF_LINK_EWMA_SHIFT
+#else
+#define PGW_LINK_EWMA_SHIFT		3
+#endif /* PGW_CONF_LINK_EWMA_SHIFT */
+#define PGW_LINK_SCALE				16
+
+/*
+ * A link whose average LQI is below this is weak: unicast frames sent over it
+ * request a MAC ACK and are sent again until acknowledged (see radio_driver.c).
+ */
+#ifdef PGW_CONF_LINK_LQI_WEAK
+#define PGW_LINK_LQI_WEAK		PGW_CONF_LINK_LQI_WEAK
+#else
+#define PGW_LINK_LQI_WEAK		80
+#endif /* PGW_CONF_LINK_LQI_WEAK */
+
+/* Keys on which the neighbor cache is indexed */
+#define PGW_NBR_KEY_IPADDR		0	/* Full IPv6 address */
+#define PGW_NBR_KEY_LLADDR		1	/* EUI-64 (i.e. interface ID) */
+#define PGW_NBR_KEY_SNMA		2	/* Solicited-node multicast group */
+#define PGW_NBR_KEY_LL_SNMA	3	/* Same, of the EUI-64-based link-local address */
+#define PGW_NBR_KEYS			4
+
 #define UIP_ND6_RA_FLAG_COMPRESSION     0x10
 #define UIP_ND6_RA_CID						      0x0F
 
@@ -68,6 +127,13 @@ typedef struct pgw_nbr {
   u8_t ra_pending;
   struct timer dadtimer;
   u8_t dadnscount;
+  u8_t dadstate;
+  clock_time_t dadstart;	/* When the registration was received */
+  /* Link quality, see pgw_nbr_link_input() */
+  s16_t link_rssi;
+  u16_t link_lqi;
+  u16_t link_frames;		/* Frames received */
+  u16_t link_samples;		/* Frames received with RSSI and LQI */
 } pgw_nbr_t;
 
 typedef enum pgw_context_state {
@@ -104,12 +170,24 @@ extern pgw_addr_context_t pgw_addr_context_table[PGW_CONF_MAX_ADDR_CONTEXTS];
 
 void pgw_nd_init();
 pgw_nbr_t* pgw_nbr_lookup(uip_ipaddr_t *ipaddr);
+pgw_nbr_t* pgw_nbr_lookup_by_lladdr(eui64_t *lladdr);
+pgw_nbr_t* pgw_nbr_lookup_by_iid(uip_ipaddr_t *ipaddr);
+pgw_nbr_t* pgw_nbr_lookup_by_snma(uip_ipaddr_t *ipaddr);
 void pgw_nbr_rm(pgw_nbr_t *nbr);
+void pgw_nbr_schedule(pgw_nbr_t *nbr);
 pgw_nbr_t* pgw_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
 												u8_t isrouter, u8_t state);
+void pgw_nbr_link_input(eui64_t *lladdr, s8_t rssi, u8_t lqi);
+u8_t pgw_nbr_link_weak(pgw_nbr_t *nbr);
+void pgw_dad_start(pgw_nbr_t *nbr);
+#if PGW_STATISTICS
+void pgw_nbr_link_print(void);
+void pgw_dad_print(void);
+#endif /* PGW_STATISTICS */
 pgw_addr_context_t* pgw_context_add(uip_nd6_opt_6co *context_option, u16_t defrt_lifetime);
 pgw_addr_context_t* pgw_context_create(uip_ipaddr_t *prefix, u8_t length);
 void pgw_context_rm(pgw_addr_context_t *context);
+void pgw_context_schedule(pgw_addr_context_t *context);
 pgw_addr_context_t* pgw_context_lookup_by_id(u8_t context_id);
 pgw_addr_context_t* pgw_context_lookup_by_prefix(uip_ipaddr_t *prefix);
 void pgw_periodic();
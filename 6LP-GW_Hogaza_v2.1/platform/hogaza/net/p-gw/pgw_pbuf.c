@@ -0,0 +1,119 @@
+/**
+ * \file		pgw_pbuf.c
+ *
+ * \brief		Packet buffers of the 6LoWPAN-ND proxy-gateway
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+#include <string.h>
+#include "net/p-gw/pgw_pbuf.h"
+#if PGW_STATISTICS
+#include <stdio.h>
+#endif /* PGW_STATISTICS */
+
+#if PGW_STATISTICS
+pgw_pbuf_stats_t pgw_pbuf_stats;
+#endif /* PGW_STATISTICS */
+
+static u8_t pgw_pbuf_mem[PGW_PBUF_NUM][PGW_PBUF_SIZE];
+static u16_t pgw_pbuf_length[PGW_PBUF_NUM];
+static u8_t pgw_pbuf_refs[PGW_PBUF_NUM];
+/** \brief Free buffers, chained through pgw_pbuf_next */
+static pgw_pbuf_t pgw_pbuf_free;
+static pgw_pbuf_t pgw_pbuf_next[PGW_PBUF_NUM];
+static u8_t pgw_pbuf_used;
+
+void
+pgw_pbuf_init()
+{
+	pgw_pbuf_t b;
+
+	pgw_pbuf_free = PGW_PBUF_NONE;
+	for (b = PGW_PBUF_NUM; b-- > 0;) {
+		pgw_pbuf_refs[b] = 0;
+		pgw_pbuf_next[b] = pgw_pbuf_free;
+		pgw_pbuf_free = b;
+	}
+	pgw_pbuf_used = 0;
+	PGW_STAT(memset(&pgw_pbuf_stats, 0, sizeof(pgw_pbuf_stats)));
+}
+
+pgw_pbuf_t
+pgw_pbuf_alloc(u16_t len)
+{
+	pgw_pbuf_t b;
+
+	if (len > PGW_PBUF_SIZE) {
+		return PGW_PBUF_NONE;
+	}
+	if ((b = pgw_pbuf_free) == PGW_PBUF_NONE) {
+		PGW_STAT(pgw_pbuf_stats.failed++);
+		return PGW_PBUF_NONE;
+	}
+	pgw_pbuf_free = pgw_pbuf_next[b];
+	pgw_pbuf_refs[b] = 1;
+	pgw_pbuf_length[b] = len;
+	pgw_pbuf_used++;
+#if PGW_STATISTICS
+	if (pgw_pbuf_used > pgw_pbuf_stats.max_used) {
+		pgw_pbuf_stats.max_used = pgw_pbuf_used;
+	}
+	pgw_pbuf_stats.allocs++;
+#endif /* PGW_STATISTICS */
+	return b;
+}
+
+u8_t
+pgw_pbuf_avail(void)
+{
+	return PGW_PBUF_NUM - pgw_pbuf_used;
+}
+
+void
+pgw_pbuf_ref(pgw_pbuf_t b)
+{
+	pgw_pbuf_refs[b]++;
+}
+
+void
+pgw_pbuf_unref(pgw_pbuf_t b)
+{
+	if (--pgw_pbuf_refs[b] == 0) {
+		pgw_pbuf_next[b] = pgw_pbuf_free;
+		pgw_pbuf_free = b;
+		pgw_pbuf_used--;
+	}
+}
+
+u8_t *
+pgw_pbuf_data(pgw_pbuf_t b)
+{
+	return pgw_pbuf_mem[b];
+}
+
+u16_t
+pgw_pbuf_len(pgw_pbuf_t b)
+{
+	return pgw_pbuf_length[b];
+}
+
+void
+pgw_pbuf_set_len(pgw_pbuf_t b, u16_t len)
+{
+	pgw_pbuf_length[b] = len;
+}
+
+#if PGW_STATISTICS
+/**
+ * \brief 	Prints one CSV line: "pbuf", buffer size and number, buffers in 
+ * 			use, most ever in use, allocations and failed allocations.
+ */
+void
+pgw_pbuf_print(void)
+{
+	printf("pbuf,%u,%u,%u,%u,%lu,%lu\n", PGW_PBUF_SIZE, PGW_PBUF_NUM,
+			pgw_pbuf_used, pgw_pbuf_stats.max_used,
+			(unsigned long)pgw_pbuf_stats.allocs,
+			(unsigned long)pgw_pbuf_stats.failed);
+}
+#endif /* PGW_STATISTICS */
@@ -0,0 +1,84 @@
+/**
+ * \file		pgw_pbuf.h
+ *
+ * \brief		Packet buffers of the 6LoWPAN-ND proxy-gateway
+ *
+ * 				Frames that must outlive uip_buf (frames waiting for the radio)
+ * 				are kept in buffers from a fixed pool, sized for 802.15.4 
+ * 				frames. They are passed around as handles and freed when their
+ * 				last reference is dropped. A packet both proxied and forwarded
+ * 				is not copied: the proxy's changes are undone (see 
+ * 				PGW_EDIT_LOG_LEN in pgw.h).
+ *
+ * 				Received packets are not kept in the pool: the drivers, 
+ * 				mac_eth_driver, pgw_fwd and pgw_sicslowpan still work on 
+ * 				uip_buf, which the uIP core and the proxy read and write in 
+ * 				place, so a packet is handled to completion before the next one
+ * 				is read.
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+
+#ifndef PGW_PBUF_H_
+#define PGW_PBUF_H_
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/p-gw/pgw.h"
+
+/* Size and number of buffers */
+#ifdef PGW_CONF_PBUF_SIZE
+#define PGW_PBUF_SIZE PGW_CONF_PBUF_SIZE
+#else
+#define PGW_PBUF_SIZE 128
+#endif /* PGW_CONF_PBUF_SIZE */
+
+#ifdef PGW_CONF_PBUF_NUM
+#define PGW_PBUF_NUM PGW_CONF_PBUF_NUM
+#else
+#define PGW_PBUF_NUM 16
+#endif /* PGW_CONF_PBUF_NUM */
+
+#if PGW_PBUF_NUM >= 255
+#error "There must be less than 255 packet buffers"
+#endif
+
+/* A buffer handle */
+typedef u8_t pgw_pbuf_t;
+#define PGW_PBUF_NONE		0xff
+
+#if PGW_STATISTICS
+/* Pool statistics (the buffers in use are counted by pgw_pbuf_avail()) */
+typedef struct {
+	u8_t max_used;	/* Most buffers ever in use */
+	u32_t allocs;		/* Buffers allocated */
+	u32_t failed;		/* Allocations that found every buffer in use */
+} pgw_pbuf_stats_t;
+
+extern pgw_pbuf_stats_t pgw_pbuf_stats;
+#endif /* PGW_STATISTICS */
+
+void pgw_pbuf_init(void);
+
+/*
+ * Returns a buffer for len bytes, or PGW_PBUF_NONE if they do not fit or none
+ * is free. Its length is set to len and it has a reference.
+ */
+pgw_pbuf_t pgw_pbuf_alloc(u16_t len);
+
+/* Number of free buffers */
+u8_t pgw_pbuf_avail(void);
+
+void pgw_pbuf_ref(pgw_pbuf_t b);
+/* Drops a reference, freeing the buffer if it was the last one */
+void pgw_pbuf_unref(pgw_pbuf_t b);
+
+u8_t *pgw_pbuf_data(pgw_pbuf_t b);
+u16_t pgw_pbuf_len(pgw_pbuf_t b);
+void pgw_pbuf_set_len(pgw_pbuf_t b, u16_t len);
+
+#if PGW_STATISTICS
+void pgw_pbuf_print(void);
+#endif /* PGW_STATISTICS */
+
+#endif /*PGW_PBUF_H_*/
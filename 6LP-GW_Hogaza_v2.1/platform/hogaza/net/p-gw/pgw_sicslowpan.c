@@ -67,6 +67,7 @@
 #include "net/neighbor-info.h"
 #include "contiki-net.h"
 #include "net/p-gw/pgw_nd.h"
+#include "dev/radio_driver.h"
 
 #define DEBUG 0
 #if DEBUG
@@ -106,6 +107,13 @@ void uip_log(char *msg);
 #define SICSLOWPAN_MAX_MAC_TRANSMISSIONS 3
 #endif
 
+/* MAC transmissions of a frame sent to a 6LN over a weak link */
+#ifdef SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS_WEAK
+#define SICSLOWPAN_MAX_MAC_TRANSMISSIONS_WEAK SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS_WEAK
+#else
+#define SICSLOWPAN_MAX_MAC_TRANSMISSIONS_WEAK 5
+#endif
+
 #ifndef SICSLOWPAN_COMPRESSION
 #ifdef SICSLOWPAN_CONF_COMPRESSION
 #define SICSLOWPAN_COMPRESSION SICSLOWPAN_CONF_COMPRESSION
@@ -211,25 +219,21 @@ static u8_t rime_payload_len;
 static u8_t uncomp_hdr_len;
 /** @} */
 
+/** 
+ * The buffer used for the 6lowpan processing is uip_buf. Headers are
+ * uncompressed in place; fragments are kept in the reassembly pool below
+ * until the datagram is complete.
+ */
+#define sicslowpan_buf uip_buf
+#define sicslowpan_len uip_len
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
-static u16_t sicslowpan_len;
-
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
- */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
-
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
-
-/**
- * length of the ip packet already sent / received.
+ * length of the ip packet already sent.
  * It includes IP and transport headers.
  */
 static u16_t processed_ip_len;
@@ -237,21 +241,46 @@ static u16_t processed_ip_len;
 /** Datagram tag to be put in the fragments I send. */
 static u16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static u16_t reass_tag;
+/** Largest datagram we can reassemble */
+#define SICSLOWPAN_REASS_MAX_LEN    (UIP_BUFSIZE - UIP_LLH_LEN)
+/** Number of blocks in the shared reassembly pool */
+#define SICSLOWPAN_REASS_BLOCKS     (SICSLOWPAN_REASS_BUF_SIZE / SICSLOWPAN_REASS_BLOCK_SIZE)
+/** Blocks needed by the largest datagram */
+#define SICSLOWPAN_REASS_CTX_BLOCKS ((SICSLOWPAN_REASS_MAX_LEN + SICSLOWPAN_REASS_BLOCK_SIZE - 1) / SICSLOWPAN_REASS_BLOCK_SIZE)
+/** Fragment offsets are expressed in 8-byte units */
+#define SICSLOWPAN_REASS_UNITS      ((SICSLOWPAN_REASS_MAX_LEN + 7) >> 3)
+
+#if SICSLOWPAN_REASS_BLOCKS > 255
+#error "SICSLOWPAN_REASS_BUF_SIZE too large for the reassembly pool"
+#endif
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+/**
+ * A datagram being reassembled, keyed by (sender, tag, size) as mandated
+ * by RFC 4944. size is 0 when the context is free.
+ */
+struct sicslowpan_reass {
+  rimeaddr_t sender;
+  u16_t tag;
+  u16_t size;
+  /** Bytes of the datagram received so far */
+  u16_t received;
+  /** Reassembly timer */
+  struct timer timer;
+  /** Pool block holding each part of the datagram, plus one (0 if none) */
+  u8_t block[SICSLOWPAN_REASS_CTX_BLOCKS];
+  /** One bit per 8-byte unit received, to detect duplicates and overlaps */
+  u8_t bitmap[(SICSLOWPAN_REASS_UNITS + 7) >> 3];
+};
+
+static struct sicslowpan_reass reass_ctx[SICSLOWPAN_REASS_CONTEXTS];
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/** The reassembly pool, shared by all the contexts */
+static u8_t reass_pool[SICSLOWPAN_REASS_BLOCKS][SICSLOWPAN_REASS_BLOCK_SIZE];
+/** Stack of free pool blocks */
+static u8_t reass_free_blocks[SICSLOWPAN_REASS_BLOCKS];
+static u8_t reass_nfree;
 
 /** @} */
-#else /* SICSLOWPAN_CONF_FRAG */
-/** The buffer used for the 6lowpan processing is uip_buf.
-    We do not use any additional buffer.*/
-#define sicslowpan_buf uip_buf
-#define sicslowpan_len uip_len
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
@@ -1566,6 +1595,8 @@ sicslowpan_output(uip_lladdr_t *localdest)
 	
   /* The MAC address of the destination of the packet */
   rimeaddr_t dest;
+  /* The 6LN it is sent to */
+  pgw_nbr_t *nbr;
   
 
   /* init */
@@ -1596,6 +1627,13 @@ sicslowpan_output(uip_lladdr_t *localdest)
     rimeaddr_copy(&dest, &rimeaddr_null);
   } else {
     rimeaddr_copy(&dest, (const rimeaddr_t *)localdest);
+    /* Ask for a MAC ACK, and more transmissions, over a weak link */
+    nbr = pgw_nbr_lookup_by_lladdr((eui64_t *)&dest);
+    if(nbr != NULL && pgw_nbr_link_weak(nbr)) {
+      packetbuf_set_attr(PACKETBUF_ATTR_RELIABLE, 1);
+      packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                         SICSLOWPAN_MAX_MAC_TRANSMISSIONS_WEAK);
+    }
   }
   
   PRINTFO("sicslowpan output: sending packet len %d\n", uip_len);
@@ -1615,6 +1653,22 @@ sicslowpan_output(uip_lladdr_t *localdest)
   if(uip_len - uncomp_hdr_len > MAC_MAX_PAYLOAD - rime_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
     struct queuebuf *q;
+    u16_t frags;
+    
+    /*
+     * Drop the whole packet unless the radio can queue all its fragments: a
+     * packet missing a fragment would only waste the channel.
+     */
+    rime_payload_len = (MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) & 0xf8;
+    frags = 1 + (uip_len - uncomp_hdr_len -
+                 ((MAC_MAX_PAYLOAD - rime_hdr_len - SICSLOWPAN_FRAG1_HDR_LEN) & 0xf8) +
+                 rime_payload_len - 1) / rime_payload_len;
+    if(frags > radio_driver_tx_room()) {
+      PRINTFO("sicslowpan output: no room for %u fragments, dropping packet\n", frags);
+      pgw_txq_drop(&radio_tx_queue, pgw_txq_class, frags);
+      return 0;
+    }
+    
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
@@ -1717,6 +1771,135 @@ sicslowpan_output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \name Reassembly
+ *  @{
+ */
+/*--------------------------------------------------------------------*/
+/** \brief Return the blocks of a context to the pool and clear it */
+static void
+reass_reset(struct sicslowpan_reass *r)
+{
+  u8_t b;
+
+  for(b = 0; b < SICSLOWPAN_REASS_CTX_BLOCKS; b++) {
+    if(r->block[b] != 0) {
+      reass_free_blocks[reass_nfree++] = r->block[b] - 1;
+      r->block[b] = 0;
+    }
+  }
+  memset(r->bitmap, 0, sizeof(r->bitmap));
+  r->received = 0;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Find the context of a fragment, or start a new one.
+ *  Contexts that timed out are released first.
+ *  \return NULL if all the contexts are busy
+ */
+static struct sicslowpan_reass *
+reass_lookup(const rimeaddr_t *sender, u16_t tag, u16_t size)
+{
+  struct sicslowpan_reass *r, *found = NULL, *free = NULL;
+
+  for(r = reass_ctx; r < reass_ctx + SICSLOWPAN_REASS_CONTEXTS; r++) {
+    if(r->size != 0 && timer_expired(&r->timer)) {
+      PRINTFI("sicslowpan input: reassembly timed out (tag %d)\n", r->tag);
+      reass_reset(r);
+      r->size = 0;
+    }
+    if(r->size == 0) {
+      if(free == NULL) {
+        free = r;
+      }
+    } else if(r->tag == tag && r->size == size &&
+              rimeaddr_cmp(&r->sender, sender)) {
+      found = r;
+    }
+  }
+  if(found == NULL && free != NULL) {
+    found = free;
+    rimeaddr_copy(&found->sender, sender);
+    found->tag = tag;
+    found->size = size;
+    timer_set(&found->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+    PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n", size, tag);
+  }
+  return found;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Count the 8-byte units of [offset, offset + len) already received */
+static u8_t
+reass_units_received(struct sicslowpan_reass *r, u16_t offset, u16_t len)
+{
+  u8_t unit, count = 0;
+
+  for(unit = offset >> 3; unit < (offset + len + 7) >> 3; unit++) {
+    if(r->bitmap[unit >> 3] & (1 << (unit & 7))) {
+      count++;
+    }
+  }
+  return count;
+}
+/*--------------------------------------------------------------------*/
+static void
+reass_units_set(struct sicslowpan_reass *r, u16_t offset, u16_t len)
+{
+  u8_t unit;
+
+  for(unit = offset >> 3; unit < (offset + len + 7) >> 3; unit++) {
+    r->bitmap[unit >> 3] |= 1 << (unit & 7);
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Copy a fragment into the pool, taking blocks as needed
+ *  \return 0 if the pool is exhausted
+ */
+static u8_t
+reass_write(struct sicslowpan_reass *r, u16_t offset, u8_t *src, u16_t len)
+{
+  u8_t b;
+  u16_t chunk;
+
+  while(len > 0) {
+    b = offset / SICSLOWPAN_REASS_BLOCK_SIZE;
+    if(r->block[b] == 0) {
+      if(reass_nfree == 0) {
+        return 0;
+      }
+      r->block[b] = reass_free_blocks[--reass_nfree] + 1;
+    }
+    chunk = SICSLOWPAN_REASS_BLOCK_SIZE - (offset % SICSLOWPAN_REASS_BLOCK_SIZE);
+    if(chunk > len) {
+      chunk = len;
+    }
+    memcpy(&reass_pool[r->block[b] - 1][offset % SICSLOWPAN_REASS_BLOCK_SIZE],
+           src, chunk);
+    src += chunk;
+    offset += chunk;
+    len -= chunk;
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Gather a complete datagram into dst */
+static void
+reass_read(struct sicslowpan_reass *r, u8_t *dst)
+{
+  u8_t b;
+  u16_t offset, chunk;
+
+  for(b = 0, offset = 0; offset < r->size; b++, offset += chunk) {
+    chunk = r->size - offset;
+    if(chunk > SICSLOWPAN_REASS_BLOCK_SIZE) {
+      chunk = SICSLOWPAN_REASS_BLOCK_SIZE;
+    }
+    memcpy(dst + offset, reass_pool[r->block[b] - 1], chunk);
+  }
+}
+/** @} */
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1724,11 +1907,13 @@ sicslowpan_output(uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
+ *  copied in uip_buf. Fragments are stored in a reassembly context
+ *  instead; once all of them are in, the datagram is copied to uip_buf
+ *  and the IP layer is called.
  *
- * \note We do not check for overlapping sicslowpan fragments
- * (it is a SHALL in the RFC 4944 and should never happen)
+ * \note As per RFC 4944, duplicate fragments are ignored and a fragment
+ * overlapping others with a different offset or size restarts the
+ * reassembly.
  */
 static void
 input(void)
@@ -1741,6 +1926,11 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   u16_t frag_tag = 0;
+  /* reassembly context of the fragment */
+  struct sicslowpan_reass *reass = NULL;
+  /* data of the fragment, and where it goes in the IP packet */
+  u8_t *frag_ptr;
+  u16_t frag_len, frag_pos, frag_units;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1750,12 +1940,13 @@ input(void)
   /* The MAC puts the 15.4 payload inside the RIME data buffer */
   rime_ptr = packetbuf_dataptr();
 
+  /* Every frame (fragments included) counts for the link quality of its 
+   * sender. The radio driver sets the LQI attribute, if it measures it */
+  pgw_nbr_link_input((eui64_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                     (s8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI),
+                     (u8_t)packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
+
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)){
-  	sicslowpan_len = 0;
-  	processed_ip_len = 0;
-  }
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1785,32 +1976,15 @@ input(void)
   	break;
   } 
 
-  if(processed_ip_len > 0) {
-  	/* reassembly is ongoing */
-		if((frag_size > 0 &&
-    		(frag_size != sicslowpan_len ||
-      	reass_tag  != frag_tag ||
-        !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       	frag_size == 0) {
-    	/*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(frag_size > 0) {
+    if(frag_size > SICSLOWPAN_REASS_MAX_LEN) {
+      PRINTFI("sicslowpan input: Dropping fragment of a too large packet\n");
       return;
     }
-  } else {
-  	/*
-  	 * reassembly is off
-  	 * start it if we received a fragment
-  	 */
-  	if(frag_size > 0){
-    	sicslowpan_len = frag_size;
-    	reass_tag = frag_tag;
-    	timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-    	PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-    	sicslowpan_len, reass_tag);
-    	rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    reass = reass_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER), frag_tag, frag_size);
+    if(reass == NULL) {
+      PRINTFI("sicslowpan input: Dropping fragment, no reassembly context available\n");
+      return;
     }
   }
 
@@ -1865,33 +2039,59 @@ input(void)
   	return;
 	}
 	rime_payload_len = packetbuf_datalen() - rime_hdr_len;
-	memcpy((void *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (u16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
-
-	/* update processed_ip_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0){
-   	if(processed_ip_len == 0) {
-   		processed_ip_len += uncomp_hdr_len;
-   	}
-   	processed_ip_len += rime_payload_len;
-  } else {
+  if(frag_size > 0) {
+    if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
+      frag_ptr = rime_ptr + rime_hdr_len;
+      frag_len = rime_payload_len;
+    } else {
+      /* FRAG1: store the uncompressed headers along with the payload */
+      memcpy((void *)SICSLOWPAN_IP_BUF + uncomp_hdr_len, rime_ptr + rime_hdr_len, rime_payload_len);
+      frag_ptr = (u8_t *)SICSLOWPAN_IP_BUF;
+      frag_len = uncomp_hdr_len + rime_payload_len;
+    }
+    frag_pos = (u16_t)frag_offset << 3;
+    if(frag_len == 0) {
+      return;
+    }
+    if(frag_pos + frag_len > reass->size) {
+      PRINTFI("sicslowpan input: Fragment out of bounds, dropping reassembly\n");
+      reass_reset(reass);
+      reass->size = 0;
+      return;
+    }
+    frag_units = reass_units_received(reass, frag_pos, frag_len);
+    if(frag_units == ((frag_pos + frag_len + 7) >> 3) - (frag_pos >> 3)) {
+      PRINTFI("sicslowpan input: Duplicate fragment\n");
+      return;
+    } else if(frag_units > 0) {
+      PRINTFI("sicslowpan input: Overlapping fragment, restarting reassembly\n");
+      reass_reset(reass);
+    }
+    if(!reass_write(reass, frag_pos, frag_ptr, frag_len)) {
+      PRINTFI("sicslowpan input: Reassembly pool exhausted, dropping packet\n");
+      reass_reset(reass);
+      reass->size = 0;
+      return;
+    }
+    reass_units_set(reass, frag_pos, frag_len);
+    reass->received += frag_len;
+    if(reass->received < reass->size) {
+      return;
+    }
+    /* We have a full IP packet, deliver it to the IP stack */
+    reass_read(reass, (u8_t *)UIP_IP_BUF);
+    uip_len = reass->size;
+    reass_reset(reass);
+    reass->size = 0;
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
-  	sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
+  {
+    memcpy((void *)SICSLOWPAN_IP_BUF + uncomp_hdr_len, rime_ptr + rime_hdr_len, rime_payload_len);
+    uip_len = rime_payload_len + uncomp_hdr_len;
   }
-
-  /*
- 	 * If we have a full IP packet in sicslowpan_buf, deliver it to
- 	 * the IP stack
- 	 */
-	if(processed_ip_len == 0 || (processed_ip_len == sicslowpan_len)){
-  	PRINTFI("sicslowpan input: IP packet ready (length %d)\n", sicslowpan_len);
-    memcpy((void *)UIP_IP_BUF, (void *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_len = 0;
-#endif /* SICSLOWPAN_CONF_FRAG */
+  PRINTFI("sicslowpan input: IP packet ready (length %d)\n", uip_len);
 
 #if DEBUG
 	  {
@@ -1910,9 +2110,6 @@ input(void)
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
 		/* Either if the packet was compressed or not, it will be ready in uip_buf */
     NETSTACK_6LPGW.input();
-#if SICSLOWPAN_CONF_FRAG
-  }
-#endif /* SICSLOWPAN_CONF_FRAG */
 }
 /** @} */
 
@@ -1922,6 +2119,12 @@ input(void)
 void
 sicslowpan_init(void)
 {	
+#if SICSLOWPAN_CONF_FRAG
+  for(reass_nfree = 0; reass_nfree < SICSLOWPAN_REASS_BLOCKS; reass_nfree++) {
+    reass_free_blocks[reass_nfree] = reass_nfree;
+  }
+  memset(reass_ctx, 0, sizeof(reass_ctx));
+#endif /* SICSLOWPAN_CONF_FRAG */
   
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 #if !CONF_6LOWPAN_ND_6CO
@@ -62,6 +62,35 @@
 #define SICSLOWPAN_UDP_8_BIT_PORT_MIN                     0xF000
 #define SICSLOWPAN_UDP_8_BIT_PORT_MAX                     0xF0FF   /* F000 + 255 */
 
+/* Timeout (seconds) of an incomplete reassembly */
+#ifdef SICSLOWPAN_CONF_MAXAGE
+#define SICSLOWPAN_REASS_MAXAGE                           SICSLOWPAN_CONF_MAXAGE
+#else
+#define SICSLOWPAN_REASS_MAXAGE                           20
+#endif /* SICSLOWPAN_CONF_MAXAGE */
+
+/* Number of datagrams that can be reassembled concurrently */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS                         SICSLOWPAN_CONF_REASS_CONTEXTS
+#else
+#define SICSLOWPAN_REASS_CONTEXTS                         4
+#endif /* SICSLOWPAN_CONF_REASS_CONTEXTS */
+
+/* 
+ * Memory (bytes) shared by all reassembly contexts. It is handed out in 
+ * blocks of SICSLOWPAN_REASS_BLOCK_SIZE bytes as fragments arrive. By default
+ * every context can hold a 1280-byte datagram; with less, a large datagram
+ * leaves the other contexts short of blocks, and a fragment that finds the 
+ * pool exhausted drops its datagram.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_BUF_SIZE
+#define SICSLOWPAN_REASS_BUF_SIZE                         SICSLOWPAN_CONF_REASS_BUF_SIZE
+#else
+#define SICSLOWPAN_REASS_BUF_SIZE                         (SICSLOWPAN_REASS_CONTEXTS * 1280)
+#endif /* SICSLOWPAN_CONF_REASS_BUF_SIZE */
+
+#define SICSLOWPAN_REASS_BLOCK_SIZE                       64
+
 /** @} */
 
 /**
@@ -0,0 +1,152 @@
+/**
+ * \file		pgw_txq.c
+ *
+ * \brief		Bounded egress queues of the 6LoWPAN-ND proxy-gateway
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+#include <string.h>
+#include "net/p-gw/pgw_txq.h"
+#if PGW_STATISTICS
+#include <stdio.h>
+#endif /* PGW_STATISTICS */
+
+u8_t pgw_txq_class = PGW_TXQ_BULK;
+
+pgw_txq_frame_t pgw_txq_frames[PGW_PBUF_NUM];
+
+void
+pgw_txq_init(pgw_txq_t *q, u8_t limit)
+{
+	u8_t prio;
+
+	memset(q, 0, sizeof(pgw_txq_t));
+	for (prio = 0; prio < PGW_TXQ_CLASSES; prio++) {
+		q->head[prio] = PGW_PBUF_NONE;
+	}
+	q->limit = limit;
+}
+
+u8_t
+pgw_txq_room(pgw_txq_t *q, u8_t prio)
+{
+	u8_t room;
+
+	room = q->limit > q->depth ? q->limit - q->depth : 0;
+	if (pgw_pbuf_avail() < room) {
+		room = pgw_pbuf_avail();
+	}
+	if (prio != PGW_TXQ_CONTROL) {
+		/* Keep the last buffers of the queue and of the pool for control frames */
+		room = room > PGW_TXQ_RESERVED ? room - PGW_TXQ_RESERVED : 0;
+	}
+	return room;
+}
+
+void
+pgw_txq_drop(pgw_txq_t *q, u8_t prio, u8_t n)
+{
+	PGW_STAT(q->stats.dropped[prio] += n);
+}
+
+pgw_pbuf_t
+pgw_txq_alloc(pgw_txq_t *q, u8_t prio, u8_t len)
+{
+	if (len > PGW_TXQ_FRAME_LEN || pgw_txq_room(q, prio) == 0) {
+		pgw_txq_drop(q, prio, 1);
+		return PGW_PBUF_NONE;
+	}
+	/* A buffer is free, see pgw_txq_room() */
+	return pgw_pbuf_alloc(len);
+}
+
+void
+pgw_txq_push(pgw_txq_t *q, pgw_pbuf_t b, u8_t prio)
+{
+	pgw_txq_frames[b].next = PGW_PBUF_NONE;
+	pgw_txq_frames[b].queued = clock_time();
+	if (q->head[prio] == PGW_PBUF_NONE) {
+		q->head[prio] = b;
+	} else {
+		pgw_txq_frames[q->tail[prio]].next = b;
+	}
+	q->tail[prio] = b;
+	q->depth++;
+#if PGW_STATISTICS
+	q->stats.queued[prio]++;
+	if (q->depth > q->stats.max_depth) {
+		q->stats.max_depth = q->depth;
+	}
+#endif /* PGW_STATISTICS */
+}
+
+pgw_pbuf_t
+pgw_txq_pop(pgw_txq_t *q)
+{
+	pgw_pbuf_t b;
+	u8_t prio;
+#if PGW_STATISTICS
+	clock_time_t t;
+#endif /* PGW_STATISTICS */
+
+	for (prio = 0; prio < PGW_TXQ_CLASSES; prio++) {
+		if ((b = q->head[prio]) != PGW_PBUF_NONE) {
+			q->head[prio] = pgw_txq_frames[b].next;
+			q->depth--;
+#if PGW_STATISTICS
+			q->stats.sent[prio]++;
+			t = clock_time() - pgw_txq_frames[b].queued;
+			q->stats.wait[prio] += t;
+			if (t > q->stats.max_wait[prio]) {
+				q->stats.max_wait[prio] = t;
+			}
+#endif /* PGW_STATISTICS */
+			return b;
+		}
+	}
+	return PGW_PBUF_NONE;
+}
+
+#if PGW_STATISTICS
+void
+pgw_txq_stats_send(pgw_txq_stats_t *s, u8_t prio, u8_t sent, u32_t start)
+{
+	start = clock_cycles() - start;
+	s->queued[prio]++;
+	if (!sent) {
+		s->dropped[prio]++;
+		return;
+	}
+	s->sent[prio]++;
+	s->busy[prio] += start;
+	if (start > s->max_busy[prio]) {
+		s->max_busy[prio] = start;
+	}
+}
+
+#define pgw_ticks_ms(t)		((unsigned long)(t) * 1000 / CLOCK_SECOND)
+#define pgw_cycles_us(c)	((unsigned long)((c) / (CLOCK_CYCLES_HZ / 1000000UL)))
+
+/**
+ * \brief 	Prints one CSV line per traffic class of a queue: "txq", the queue
+ * 			name, the class, frames queued and dropped, mean and maximum time
+ * 			queued (in ms), the longest the queue has been, and mean and 
+ * 			maximum time spent in the driver (in us, only measured for drivers
+ * 			without a queue).
+ */
+void
+pgw_txq_print(const char *name, pgw_txq_stats_t *s)
+{
+	static const char *classes[PGW_TXQ_CLASSES] = { "control", "bulk" };
+	u8_t prio;
+
+	for (prio = 0; prio < PGW_TXQ_CLASSES; prio++) {
+		printf("txq,%s,%s,%lu,%lu,%lu,%lu,%u,%lu,%lu\n", name, classes[prio],
+				(unsigned long)s->queued[prio], (unsigned long)s->dropped[prio],
+				s->sent[prio] == 0 ? 0 : pgw_ticks_ms(s->wait[prio] / s->sent[prio]),
+				pgw_ticks_ms(s->max_wait[prio]), s->max_depth,
+				s->sent[prio] == 0 ? 0 : pgw_cycles_us(s->busy[prio] / s->sent[prio]),
+				pgw_cycles_us(s->max_busy[prio]));
+	}
+}
+#endif /* PGW_STATISTICS */
@@ -0,0 +1,140 @@
+/**
+ * \file		pgw_txq.h
+ *
+ * \brief		Bounded egress queues of the 6LoWPAN-ND proxy-gateway
+ *
+ * 				Frames waiting for an interface are kept in a queue, in small
+ * 				buffers of the packet buffer pool (see pgw_pbuf.h). A queue holds
+ * 				two traffic classes: ND messages (control) and everything else
+ * 				(bulk). Control frames are always sent first, and the last
+ * 				PGW_TXQ_RESERVED buffers of a queue and of the pool are kept for
+ * 				them, so that a burst of bulk traffic cannot delay or drop the
+ * 				registration of a 6LN. A frame that does not fit is dropped
+ * 				(tail drop) and counted.
+ *
+ * 				Only the radio has a queue. The ENC28J60 has a single frame in
+ * 				its TX buffer, and eth_driver sendv() writes a frame into it at SPI
+ * 				speed and returns once it is on the wire, 10 Mb/s later. A queued
+ * 				Ethernet frame (up to 1294 bytes) would not fit in a small buffer.
+ * 				Ethernet frames are still accounted for like those of a queue,
+ * 				see pgw_txq_stats_send().
+ *
+ * \author		Luis Maqueda <luis@sen.se>
+ */
+
+#ifndef PGW_TXQ_H_
+#define PGW_TXQ_H_
+
+#include "contiki.h"
+#include "net/mac/mac.h"
+#include "net/p-gw/pgw.h"
+#include "net/p-gw/pgw_pbuf.h"
+
+/* Buffers of a queue and of the pool that bulk frames cannot take */
+#ifdef PGW_CONF_TXQ_RESERVED
+#define PGW_TXQ_RESERVED PGW_CONF_TXQ_RESERVED
+#else
+#define PGW_TXQ_RESERVED 2
+#endif /* PGW_CONF_TXQ_RESERVED */
+
+/* Longest frame: a whole IEEE 802.15.4 frame */
+#define PGW_TXQ_FRAME_LEN	127
+
+#if PGW_PBUF_SIZE < PGW_TXQ_FRAME_LEN
+#error "PGW_PBUF_SIZE must hold a PGW_TXQ_FRAME_LEN frame"
+#endif
+
+#if PGW_PBUF_NUM <= PGW_TXQ_RESERVED
+#error "PGW_PBUF_NUM must be larger than PGW_TXQ_RESERVED"
+#endif
+
+/* Traffic classes, in order of priority */
+#define PGW_TXQ_CONTROL		0		/* ND messages (RS, RA, NS, NA, redirect) */
+#define PGW_TXQ_BULK			1		/* Anything else */
+#define PGW_TXQ_CLASSES		2
+
+/* What a queue keeps about the frame in a buffer, besides its contents */
+typedef struct {
+	pgw_pbuf_t next;
+	/* Time at which it was queued */
+	clock_time_t queued;
+	/* Called once the frame has been sent (may be NULL) */
+	mac_callback_t sent;
+	void *ptr;
+	/* Times it may be sent if it requests an acknowledgment */
+	u8_t transmissions;
+} pgw_txq_frame_t;
+
+extern pgw_txq_frame_t pgw_txq_frames[PGW_PBUF_NUM];
+
+#define pgw_txq_frame(b)	(&pgw_txq_frames[b])
+
+#if PGW_STATISTICS
+/* Egress queue statistics, per traffic class */
+typedef struct {
+	u32_t queued[PGW_TXQ_CLASSES];	/* Frames queued */
+	u32_t dropped[PGW_TXQ_CLASSES];	/* Frames dropped because the queue was full */
+	u32_t sent[PGW_TXQ_CLASSES];		/* Frames taken from the queue to be sent */
+	u32_t wait[PGW_TXQ_CLASSES];		/* Sum of the time frames were queued (ticks) */
+	clock_time_t max_wait[PGW_TXQ_CLASSES];	/* Longest time a frame was queued */
+	u32_t busy[PGW_TXQ_CLASSES];		/* Sum of the clock_cycles() spent in the driver */
+	u32_t max_busy[PGW_TXQ_CLASSES];	/* Longest time a frame spent in the driver */
+	u8_t max_depth;									/* Most frames queued at once */
+} pgw_txq_stats_t;
+#endif /* PGW_STATISTICS */
+
+/* An egress queue: a FIFO of frames per traffic class */
+typedef struct {
+	pgw_pbuf_t head[PGW_TXQ_CLASSES];
+	pgw_pbuf_t tail[PGW_TXQ_CLASSES];
+	u8_t depth;
+	u8_t limit;
+#if PGW_STATISTICS
+	pgw_txq_stats_t stats;
+#endif /* PGW_STATISTICS */
+} pgw_txq_t;
+
+/*
+ * Class of the packet being sent, set by pgw_fwd_output() for the interface
+ * drivers, which only see frames.
+ */
+extern u8_t pgw_txq_class;
+
+/* Initializes an empty queue holding at most limit frames */
+void pgw_txq_init(pgw_txq_t *q, u8_t limit);
+
+/*
+ * Returns a buffer for a frame of len bytes and class prio, or PGW_PBUF_NONE
+ * if the frame must be dropped (the drop is counted). The frame is queued 
+ * with pgw_txq_push().
+ */
+pgw_pbuf_t pgw_txq_alloc(pgw_txq_t *q, u8_t prio, u8_t len);
+void pgw_txq_push(pgw_txq_t *q, pgw_pbuf_t b, u8_t prio);
+
+/* Number of frames of class prio that can still be queued */
+u8_t pgw_txq_room(pgw_txq_t *q, u8_t prio);
+
+/* Counts n frames of class prio dropped before being queued */
+void pgw_txq_drop(pgw_txq_t *q, u8_t prio, u8_t n);
+
+/*
+ * Removes the next frame to send (control frames first) from the queue, or
+ * returns PGW_PBUF_NONE if it is empty. The buffer is released with 
+ * pgw_pbuf_unref() once the frame has been sent.
+ */
+pgw_pbuf_t pgw_txq_pop(pgw_txq_t *q);
+
+#define pgw_txq_empty(q)	((q)->depth == 0)
+
+#if PGW_STATISTICS
+/*
+ * Accounts for a frame of class prio handed straight to a driver that sends 
+ * it before returning, clock_cycles() being start when it was handed: it is 
+ * counted as queued, then as sent or, if the driver did not take it, dropped.
+ */
+void pgw_txq_stats_send(pgw_txq_stats_t *s, u8_t prio, u8_t sent, u32_t start);
+
+void pgw_txq_print(const char *name, pgw_txq_stats_t *s);
+#endif /* PGW_STATISTICS */
+
+#endif /*PGW_TXQ_H_*/
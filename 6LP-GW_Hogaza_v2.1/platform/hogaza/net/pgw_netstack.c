@@ -1,8 +1,12 @@
 #include "net/pgw_netstack.h"
+#include "net/p-gw/pgw_pbuf.h"
 
 void
 pgw_netstack_init(void)
 {
+	/* The packet buffers, before any layer takes one */
+	pgw_pbuf_init();
+
 	NETSTACK_ETHERNET.init();
 	NETSTACK_MAC_ETH.init();
 
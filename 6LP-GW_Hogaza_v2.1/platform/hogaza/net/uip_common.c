@@ -3,8 +3,10 @@
 /* This file holds common variables and functions which are common to both,
  * the IPv4 and the IPv6 stacks */
 
+#include <stdint.h>
 #include "contiki.h"
 #include "contiki-net.h"
+#include "net/uip_common.h"
 
 #define UIP_IP_BUF		((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIPV4_IP_BUF	((struct uipv4_ip_hdr *)&uip_buf[UIP_LLH_LEN])
@@ -39,8 +41,9 @@ uip_add32(u8_t *op32, u16_t op16)
 }
 
 /*---------------------------------------------------------------------------*/
+/* Byte pair at a time, for data at an odd address */
 static u16_t
-chksum(u16_t sum, const u8_t *data, u16_t len)
+chksum_bytes(u16_t sum, const u8_t *data, u16_t len)
 {
   u16_t t;
   const u8_t *dataptr;
@@ -70,11 +73,96 @@ chksum(u16_t sum, const u8_t *data, u16_t len)
   return sum;
 }
 
+/*---------------------------------------------------------------------------*/
+/*
+ * The one's complement sum does not depend on the byte order (RFC 1071), so
+ * the words are added as they are in memory and the result is swapped once.
+ * uip_htons() converts between the sum in host byte order and the sum of the
+ * words as loaded.
+ */
+u16_t
+uip_chksum_add(u16_t sum, const u8_t *data, u16_t len)
+{
+#if UIP_CHKSUM_WIDE
+  uint64_t acc;
+  const uint32_t *w32;
+#else
+  u32_t acc;
+#endif /* UIP_CHKSUM_WIDE */
+  const u16_t *w;
+  u16_t t;
+
+  if((uintptr_t)data & 1) {
+    return chksum_bytes(sum, data, len);
+  }
+  
+  acc = uip_htons(sum);
+  w = (const u16_t *)data;
+#if UIP_CHKSUM_WIDE
+  if(((uintptr_t)w & 2) && len >= 2) {
+    acc += *w++;
+    len -= 2;
+  }
+  w32 = (const uint32_t *)w;
+  while(len >= 16) {
+    acc += w32[0];
+    acc += w32[1];
+    acc += w32[2];
+    acc += w32[3];
+    w32 += 4;
+    len -= 16;
+  }
+  while(len >= 4) {
+    acc += *w32++;
+    len -= 4;
+  }
+  w = (const u16_t *)w32;
+#else
+  while(len >= 8) {
+    acc += w[0];
+    acc += w[1];
+    acc += w[2];
+    acc += w[3];
+    w += 4;
+    len -= 8;
+  }
+#endif /* UIP_CHKSUM_WIDE */
+  while(len >= 2) {
+    acc += *w++;
+    len -= 2;
+  }
+  if(len) {
+    /* The last byte is padded with a zero byte */
+    t = 0;
+    *(u8_t *)&t = *(const u8_t *)w;
+    acc += t;
+  }
+  
+  /* Fold the carries */
+#if UIP_CHKSUM_WIDE
+  acc = (acc & 0xffffffff) + (acc >> 32);
+  acc = (acc & 0xffffffff) + (acc >> 32);
+#endif /* UIP_CHKSUM_WIDE */
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  
+  return uip_htons((u16_t)acc);
+}
+
+/*---------------------------------------------------------------------------*/
+u16_t
+uip_chksum_pseudo(const u8_t *addrs, u8_t addrlen, u16_t len, u8_t proto)
+{
+  /* IP protocol and length fields. This addition cannot carry. */
+  return uip_chksum_add(len + proto, addrs, 2 * addrlen);
+}
+
 /*---------------------------------------------------------------------------*/
 u16_t
 uip_chksum(u16_t *data, u16_t len)
 {
-  return uip_htons(chksum(0, (u8_t *)data, len));
+  return uip_htons(uip_chksum_add(0, (u8_t *)data, len));
 }
 
 /*---------------------------------------------------------------------------*/
@@ -84,7 +172,7 @@ uip_ipchksum(void)
 {
   u16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
   PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -95,7 +183,7 @@ uipv4_ipchksum(void)
 {
   u16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIPV4_IPH_LEN);
+  sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], UIPV4_IPH_LEN);
   DEBUG_PRINTF("uipv4_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -111,26 +199,21 @@ upper_layer_chksum(u8_t ip_version, u8_t proto)
 	  upper_layer_len = (((u16_t)(UIPV4_IP_BUF->len[0]) << 8) + UIPV4_IP_BUF->len[1]) - UIPV4_IPH_LEN;
   
 	  /* First sum pseudoheader. */
-	  
-	  /* IP protocol and length fields. This addition cannot carry. */
-	  sum = upper_layer_len + proto;
-	  /* Sum IP source and destination addresses. */
-	  sum = chksum(sum, (u8_t *)&UIPV4_IP_BUF->srcipaddr, 2 * sizeof(uip_ip4addr_t));
+	  sum = uip_chksum_pseudo((u8_t *)&UIPV4_IP_BUF->srcipaddr, sizeof(uip_ip4addr_t),
+	  												upper_layer_len, proto);
 	
 	  /* Sum TCP header and data. */
-	  sum = chksum(sum, &uip_buf[UIPV4_IPH_LEN + UIP_LLH_LEN],
+	  sum = uip_chksum_add(sum, &uip_buf[UIPV4_IPH_LEN + UIP_LLH_LEN],
 		       upper_layer_len);  
   } else {
 	  upper_layer_len = (((u16_t)(UIP_IP_BUF->len[0]) << 8) + UIP_IP_BUF->len[1] - uip_ext_len) ;
 	  
 	  /* First sum pseudoheader. */
-	  /* IP protocol and length fields. This addition cannot carry. */
-	  sum = upper_layer_len + proto;
-	  /* Sum IP source and destination addresses. */
-	  sum = chksum(sum, (u8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+	  sum = uip_chksum_pseudo((u8_t *)&UIP_IP_BUF->srcipaddr, sizeof(uip_ipaddr_t),
+	  												upper_layer_len, proto);
 	
 	  /* Sum TCP header and data. */
-	  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
+	  sum = uip_chksum_add(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
 	               upper_layer_len);
   
   }
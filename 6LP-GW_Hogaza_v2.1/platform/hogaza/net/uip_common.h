@@ -6,4 +6,23 @@
 
 extern u8_t uip_acc32[4];
 
+/*
+ * Checksum kernel. The MSP430 adds 16-bit words into a 32-bit accumulator,
+ * i.e. an add with carry per word. Hosts (UIP_CONF_CHKSUM_WIDE) add 32-bit 
+ * words into a 64-bit accumulator. Both fold the carries once at the end.
+ */
+#ifdef UIP_CONF_CHKSUM_WIDE
+#define UIP_CHKSUM_WIDE UIP_CONF_CHKSUM_WIDE
+#else
+#define UIP_CHKSUM_WIDE 0
+#endif /* UIP_CONF_CHKSUM_WIDE */
+
+/* Adds len bytes of data to the one's complement sum (host byte order) */
+u16_t uip_chksum_add(u16_t sum, const u8_t *data, u16_t len);
+/* 
+ * Sum of a pseudo-header: source and destination addresses (addrs, 2 * 
+ * addrlen bytes), upper-layer length and protocol 
+ */
+u16_t uip_chksum_pseudo(const u8_t *addrs, u8_t addrlen, u16_t len, u8_t proto);
+
 #endif /*UIP_COMMON_H_*/
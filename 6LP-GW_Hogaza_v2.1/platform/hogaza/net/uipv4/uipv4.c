@@ -238,86 +238,7 @@ uip_add32(u8_t *op32, u16_t op16)
 
 #endif /* UIP_ARCH_ADD32 */
 
-#if ! UIP_ARCH_CHKSUM
-/*---------------------------------------------------------------------------*/
-static u16_t
-chksum(u16_t sum, const u8_t *data, u16_t len)
-{
-  u16_t t;
-  const u8_t *dataptr;
-  const u8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {	/* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
-    dataptr += 2;
-  }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
-  }
-
-  /* Return sum in host byte order. */
-  return sum;
-}
-/*---------------------------------------------------------------------------*/
-#ifndef UIP_ARCH_IPCHKSUM
-u16_t
-uipv4_ipchksum(void)
-{
-  u16_t sum;
-
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIPV4_IPH_LEN);
-  DEBUG_PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
-  return (sum == 0) ? 0xffff : uip_htons(sum);
-}
-#endif
-/*---------------------------------------------------------------------------*/
-static u16_t
-upper_layer_chksum(u8_t proto)
-{
-  u16_t upper_layer_len;
-  u16_t sum;
-  
-  upper_layer_len = (((u16_t)(BUF->len[0]) << 8) + BUF->len[1]) - UIPV4_IPH_LEN;
-  
-  /* First sum pseudoheader. */
-  
-  /* IP protocol and length fields. This addition cannot carry. */
-  sum = upper_layer_len + proto;
-  /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (u8_t *)&BUF->srcipaddr, 2 * sizeof(uip_ip4addr_t));
-
-  /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIPV4_IPH_LEN + UIP_LLH_LEN],
-	       upper_layer_len);
-    
-  return (sum == 0) ? 0xffff : uip_htons(sum);
-}
-/*---------------------------------------------------------------------------*/
-u16_t
-uipv4_udpchksum(void)
-{
-  return upper_layer_chksum(UIP_PROTO_UDP);
-}
-/*---------------------------------------------------------------------------*/
-u16_t
-uipv4_tcpchksum(void)
-{
-  return upper_layer_chksum(UIP_PROTO_TCP);
-}
-/*---------------------------------------------------------------------------*/
-#endif /* UIP_ARCH_CHKSUM */
+/* The checksum functions of both stacks are in net/uip_common.c */
 /*---------------------------------------------------------------------------*/
 void
 uipv4_init(void)
@@ -44,7 +44,8 @@
 #include <msp430f5435a.h>
 #include "sys/rtimer.h"
 
-#define RTIMER_ARCH_SECOND (4096U*2)
+/* TA0R counts ACLK/8 in continuous mode, see clock_arch.c */
+#define RTIMER_ARCH_SECOND (32768U/8)
 
 #define rtimer_arch_now() (TA0R)
 
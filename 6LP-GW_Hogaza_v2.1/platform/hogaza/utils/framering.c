@@ -0,0 +1,185 @@
+/**
+ * \file		framering.c
+ *
+ * \brief		Frame ring implementation
+ *
+ * 					Frames are stored as a length byte followed by the frame. A
+ * 					frame never wraps around the end of the buffer: if it does not
+ * 					fit, FRAMERING_WRAP is written in place of the length and the
+ * 					frame is stored at the beginning. iHead == iTail means empty,
+ * 					so the tail is never allowed to catch up with the head.
+ */
+
+#include "utils/framering.h"
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+/* Length byte telling the consumer to go on at the beginning of the buffer */
+#define FRAMERING_WRAP			0xFF
+/*---------------------------------------------------------------------------*/
+
+/**
+* @fn      framering_init
+*
+* @brief   Initialize a frame ring. The buffer itself must be allocated by the
+*          application. Must not be called while the ring is in use.
+*
+* @param   pRing - pointer to the frame ring
+* 		   buffer - the actual buffer where frames are to be stored
+* 		   len	- buffer length
+*
+* @return  none
+*/
+/*----------------------------------------------------------------------------*/
+void
+framering_init(framering_t *pRing, u8_t *buffer, u16_t len)
+{
+  pRing->pData = buffer;
+  pRing->len = len;
+  pRing->iHead = 0;
+  pRing->iTail = 0;
+  pRing->iReserved = 0;
+  pRing->overflows = 0;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      framering_reserve
+ *
+ * @brief   Reserves room for a frame of up to maxLen bytes. The frame is
+ *          written through the returned pointer and handed to the consumer
+ *          by framering_commit(). It is discarded if not committed before
+ *          the next reservation. Producer side.
+ *
+ * @param   pRing - pointer to the frame ring
+ *          maxLen - maximum frame length (at most FRAMERING_MAX_FRAME)
+ *
+ * @return  Where the frame is to be written, or NULL if the ring is full (the
+ *          overflow counter is then incremented, see framering_overflows())
+ */
+/*----------------------------------------------------------------------------*/
+u8_t *
+framering_reserve(framering_t *pRing, u8_t maxLen)
+{
+  u16_t head = pRing->iHead;
+  u16_t tail = pRing->iTail;
+  u16_t need = (u16_t)maxLen + 1;
+
+  if (tail >= head) {
+    /* Free space is after the tail and before the head (minus one byte) */
+    if (tail + need < pRing->len) {
+      pRing->iReserved = tail;
+    } else if (need < head) {
+      pRing->iReserved = 0;
+    } else {
+      pRing->overflows++;
+      return NULL;
+    }
+  } else if (tail + need < head) {
+    pRing->iReserved = tail;
+  } else {
+    pRing->overflows++;
+    return NULL;
+  }
+  return (u8_t *)&pRing->pData[pRing->iReserved + 1];
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      framering_commit
+ *
+ * @brief   Hands the frame written after framering_reserve() to the consumer.
+ *          Producer side.
+ *
+ * @param   pRing - pointer to the frame ring
+ *          len - frame length (at most the length reserved)
+ *
+ * @return  none
+ */
+/*----------------------------------------------------------------------------*/
+void
+framering_commit(framering_t *pRing, u8_t len)
+{
+  u16_t frame = pRing->iReserved;
+
+  pRing->pData[frame] = len;
+  if (frame != pRing->iTail) {
+    /* Reserved at the beginning: tell the consumer to skip the end */
+    pRing->pData[pRing->iTail] = FRAMERING_WRAP;
+  }
+  /* The frame is visible to the consumer from here on */
+  pRing->iTail = frame + 1 + len;
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      framering_peek
+ *
+ * @brief   Gets the oldest frame, leaving it in the ring. It can be read in
+ *          place until framering_release() is called. Consumer side.
+ *
+ * @param   pRing - pointer to the frame ring
+ *          pFrame - where the pointer to the frame is returned
+ *
+ * @return  The frame length, 0 if the ring is empty
+ */
+/*----------------------------------------------------------------------------*/
+u8_t
+framering_peek(framering_t *pRing, u8_t **pFrame)
+{
+  u16_t head = pRing->iHead;
+
+  if (head == pRing->iTail) {
+    return 0;
+  }
+  if (pRing->pData[head] == FRAMERING_WRAP) {
+    /* The producer went on at the beginning */
+    head = 0;
+    pRing->iHead = 0;
+  }
+  *pFrame = (u8_t *)&pRing->pData[head + 1];
+  return pRing->pData[head];
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      framering_release
+ *
+ * @brief   Removes the frame returned by framering_peek(), whose memory is
+ *          then given back to the producer. Consumer side.
+ *
+ * @param   pRing - pointer to the frame ring
+ *
+ * @return  none
+ */
+/*----------------------------------------------------------------------------*/
+void
+framering_release(framering_t *pRing)
+{
+  u16_t head = pRing->iHead;
+
+  if (head != pRing->iTail) {
+    pRing->iHead = head + 1 + pRing->pData[head];
+  }
+}
+/*----------------------------------------------------------------------------*/
+
+/**
+ * @fn      framering_overflows
+ *
+ * @brief   Returns the number of reservations refused because the ring was
+ *          full. It is up to the producer whether the frame was dropped.
+ *
+ * @param   pRing - pointer to the frame ring
+ *
+ * @return  Number of reservations refused since framering_init()
+ */
+/*----------------------------------------------------------------------------*/
+u16_t
+framering_overflows(framering_t *pRing)
+{
+  return pRing->overflows;
+}
+/*----------------------------------------------------------------------------*/
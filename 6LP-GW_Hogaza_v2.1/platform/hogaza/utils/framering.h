@@ -0,0 +1,60 @@
+/**
+ * \file		framering.h
+ *
+ * \brief		Frame ring definitions and declarations.
+ *
+ * 					A single-producer/single-consumer ring of length-prefixed
+ * 					frames, stored contiguously so that they can be written and
+ * 					read in place. The producer (e.g. an interrupt routine) only
+ * 					writes iTail and the consumer only writes iHead, so neither
+ * 					side needs to disable interrupts.
+ */
+
+#ifndef _FRAMERING_H
+#define _FRAMERING_H
+
+#include "contiki.h"
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Largest frame that can be stored (the length prefix is one byte and 0xFF
+ * marks the wrap-around).
+ */
+#define FRAMERING_MAX_FRAME		254
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Frame ring data-type definition
+ */
+/*----------------------------------------------------------------------------*/
+typedef struct {
+    volatile u8_t *pData;
+    u16_t len;
+    /* Next frame to be read, written by the consumer only */
+    volatile u16_t iHead;
+    /* Next free byte, written by the producer only */
+    volatile u16_t iTail;
+    /* Offset of the frame reserved by the producer */
+    u16_t iReserved;
+    /* Reservations refused because the ring was full, written by the producer */
+    volatile u16_t overflows;
+} framering_t;
+/*----------------------------------------------------------------------------*/
+
+/**
+ * EXTERNAL FUNCTIONS
+ */
+/*----------------------------------------------------------------------------*/
+void  framering_init(framering_t *pRing, u8_t *buffer, u16_t len);
+/* Producer side */
+u8_t *framering_reserve(framering_t *pRing, u8_t maxLen);
+void  framering_commit(framering_t *pRing, u8_t len);
+/* Consumer side */
+u8_t  framering_peek(framering_t *pRing, u8_t **pFrame);
+void  framering_release(framering_t *pRing);
+u16_t framering_overflows(framering_t *pRing);
+/*----------------------------------------------------------------------------*/
+
+#endif /*_FRAMERING_H */
+
+/*----------------------------------------------------------------------------*/